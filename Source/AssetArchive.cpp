@@ -0,0 +1,166 @@
+#include "AssetArchive.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+	constexpr uint32_t ARCHIVE_MAGIC = 0x4B505256; // "VRPK"
+	constexpr uint32_t ARCHIVE_VERSION = 1;
+	constexpr uint64_t DATA_ALIGNMENT = 16;
+
+	struct ArchiveHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t entryCount;
+	};
+
+	struct ArchiveEntry
+	{
+		uint64_t nameOffset;
+		uint64_t nameSize;
+		uint64_t dataOffset;
+		uint64_t dataSize;
+	};
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	bool InRange(uint64_t offset, uint64_t size, uint64_t fileSize)
+	{
+		return offset <= fileSize && size <= fileSize - offset;
+	}
+}
+
+AssetArchive::AssetArchive(const std::string& path) : m_file(path)
+{
+	const char* pData = m_file.GetData();
+	const uint64_t fileSize = m_file.GetSize();
+
+	// Validate everything before handing out views into the file
+	ArchiveHeader header{};
+	if (fileSize < sizeof(header))
+	{
+		throw std::runtime_error("Invalid asset archive " + path);
+	}
+	memcpy(&header, pData, sizeof(header));
+	if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION
+		|| header.entryCount > (fileSize - sizeof(header)) / sizeof(ArchiveEntry))
+	{
+		throw std::runtime_error("Invalid asset archive " + path);
+	}
+
+	m_files.reserve(header.entryCount);
+	for (uint64_t i = 0; i < header.entryCount; i++)
+	{
+		ArchiveEntry entry;
+		memcpy(&entry, pData + sizeof(header) + i * sizeof(entry), sizeof(entry));
+		if (!InRange(entry.nameOffset, entry.nameSize, fileSize) || !InRange(entry.dataOffset, entry.dataSize, fileSize))
+		{
+			throw std::runtime_error("Invalid asset archive " + path);
+		}
+		m_files.emplace(std::string_view(pData + entry.nameOffset, entry.nameSize),
+			std::string_view(pData + entry.dataOffset, entry.dataSize));
+	}
+}
+
+std::string_view AssetArchive::Find(const std::string& name) const
+{
+	auto it = m_files.find(NormalizeArchivePath(name));
+	return it != m_files.end() ? it->second : std::string_view();
+}
+
+std::string NormalizeArchivePath(const std::string& path)
+{
+	std::vector<std::string> segments;
+	size_t start = 0;
+	while (start <= path.size())
+	{
+		size_t end = path.find_first_of("/\\", start);
+		if (end == std::string::npos)
+		{
+			end = path.size();
+		}
+		std::string segment = path.substr(start, end - start);
+		if (segment == "..")
+		{
+			// Leading ".." segments are kept, since there is nothing to resolve them against
+			if (!segments.empty() && segments.back() != "..")
+			{
+				segments.pop_back();
+			}
+			else
+			{
+				segments.push_back(segment);
+			}
+		}
+		else if (!segment.empty() && segment != ".")
+		{
+			segments.push_back(segment);
+		}
+		start = end + 1;
+	}
+
+	std::string ret;
+	for (const auto& segment : segments)
+	{
+		if (!ret.empty())
+		{
+			ret += '/';
+		}
+		ret += segment;
+	}
+	return ret;
+}
+
+void WriteAssetArchive(const std::string& archivePath, const std::string& rootDirectory,
+	const std::vector<std::string>& files)
+{
+	// Lay out the names right after the entry table, then the contents
+	std::vector<std::string> names;
+	std::vector<MemoryMappedFile> contents;
+	std::vector<ArchiveEntry> entries(files.size());
+	uint64_t offset = sizeof(ArchiveHeader) + files.size() * sizeof(ArchiveEntry);
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		names.push_back(NormalizeArchivePath(files[i]));
+		entries[i].nameOffset = offset;
+		entries[i].nameSize = names[i].size();
+		offset += names[i].size();
+	}
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		contents.emplace_back(rootDirectory + "/" + names[i]);
+		offset = AlignUp(offset, DATA_ALIGNMENT);
+		entries[i].dataOffset = offset;
+		entries[i].dataSize = contents[i].GetSize();
+		offset += contents[i].GetSize();
+	}
+
+	std::ofstream ofs(archivePath, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+	{
+		throw std::runtime_error("Failed to open " + archivePath + " for writing");
+	}
+	const ArchiveHeader header{ ARCHIVE_MAGIC, ARCHIVE_VERSION, files.size() };
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	ofs.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(ArchiveEntry));
+	for (const auto& name : names)
+	{
+		ofs.write(name.data(), name.size());
+	}
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		const char zeros[DATA_ALIGNMENT] = {};
+		ofs.write(zeros, entries[i].dataOffset - static_cast<uint64_t>(ofs.tellp()));
+		ofs.write(contents[i].GetData(), contents[i].GetSize());
+	}
+	if (!ofs)
+	{
+		throw std::runtime_error("Failed to write " + archivePath);
+	}
+}
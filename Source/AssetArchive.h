@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "MemoryMappedFile.h"
+
+// Read-only packed archive of asset files. The whole archive is memory-mapped once and files
+// are served as views into the mapping, so reading a multi-file asset costs no per-file open.
+// The file is a header and an entry table followed by the entry names and then the file
+// contents, each starting on a 16-byte boundary.
+class AssetArchive
+{
+public:
+	AssetArchive() = default;
+	// Throws if the archive can't be opened or is malformed
+	explicit AssetArchive(const std::string& path);
+
+	AssetArchive(const AssetArchive& other) = delete;
+	AssetArchive& operator=(const AssetArchive& other) = delete;
+	AssetArchive(AssetArchive&& other) noexcept = default;
+	AssetArchive& operator=(AssetArchive&& other) noexcept = default;
+
+	// Contents of the named file, or an empty view with a null data pointer if there is none.
+	// Names are relative to the directory the archive was packed from, and are matched after
+	// NormalizeArchivePath.
+	std::string_view Find(const std::string& name) const;
+
+	size_t GetFileCount() const { return m_files.size(); }
+
+private:
+	MemoryMappedFile m_file;
+	// Names and contents both point into the mapping
+	std::unordered_map<std::string_view, std::string_view> m_files;
+};
+
+// Forward slashes, with "." and ".." segments resolved and no leading "./"
+std::string NormalizeArchivePath(const std::string& path);
+
+// Packs the given files, named by their paths relative to rootDirectory, into a new archive.
+// Throws if a file can't be read or the archive can't be written.
+void WriteAssetArchive(const std::string& archivePath, const std::string& rootDirectory,
+	const std::vector<std::string>& files);
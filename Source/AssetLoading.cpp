@@ -0,0 +1,24 @@
+#include "AssetLoading.h"
+
+#include "ThreadPool.h"
+
+AssetHandle<Model> LoadModelAsync(const std::string& path, const ModelLoadOptions& options)
+{
+	// LoadModel spreads its own work across the pool too, which is safe from inside a pool task
+	return AssetHandle<Model>(ThreadPool::GetDefault().Submit([path, options]() {
+		return LoadModel(path, options);
+	}));
+}
+
+AssetHandle<TextureData> LoadTextureDataAsync(const std::string& path, TextureCompression compression, bool linear)
+{
+	return AssetHandle<TextureData>(ThreadPool::GetDefault().Submit([path, compression, linear]() {
+		TextureData data = LoadTextureData(path);
+		if (compression == TextureCompression::eNone || data.format != 0)
+		{
+			return data;
+		}
+		GenerateMipChain(data, linear);
+		return CompressTexture(data, compression, linear);
+	}));
+}
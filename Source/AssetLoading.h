@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <future>
+#include <string>
+
+#include "ModelLoading.h"
+#include "TextureLoading.h"
+#include "TextureProcessing.h"
+
+// Asynchronous loading of the CPU side of assets (file reads, decoding and mesh processing) on
+// the worker pool. The render loop polls the handles each frame and uploads whatever has become
+// ready, since uploads go through the ResourceManager on the render thread.
+
+// Result of an asynchronous load. Move-only, like the future it wraps.
+template<typename T>
+class AssetHandle
+{
+public:
+	AssetHandle() = default;
+	explicit AssetHandle(std::future<T> future) : m_future(std::move(future))
+	{
+	}
+
+	// True while the handle holds a load whose result hasn't been taken yet
+	explicit operator bool() const
+	{
+		return m_future.valid();
+	}
+
+	// Non-blocking check for whether the load has finished, successfully or not
+	bool IsReady() const
+	{
+		return m_future.valid() && m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	// Takes the result, blocking until it is ready. Rethrows any exception thrown by the load.
+	T Take()
+	{
+		return m_future.get();
+	}
+
+private:
+	std::future<T> m_future;
+};
+
+AssetHandle<Model> LoadModelAsync(const std::string& path, const ModelLoadOptions& options = {});
+// With a compression other than eNone, decoded images also get their full mip chain generated
+// and are block-compressed on the worker, so linear picks the color space for both. KTX2
+// textures are returned as stored either way.
+AssetHandle<TextureData> LoadTextureDataAsync(const std::string& path,
+	TextureCompression compression = TextureCompression::eNone, bool linear = false);
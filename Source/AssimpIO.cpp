@@ -0,0 +1,126 @@
+#include "AssimpIO.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+namespace
+{
+	// Read-only stream over a block of memory, which it may also own the mapping of
+	class MappedIOStream : public Assimp::IOStream
+	{
+	public:
+		MappedIOStream(std::string_view data, MemoryMappedFile&& file = {}) :
+			m_file(std::move(file)), m_data(data), m_position(0)
+		{
+		}
+
+		size_t Read(void* pvBuffer, size_t pSize, size_t pCount) override
+		{
+			if (pSize == 0)
+			{
+				return 0;
+			}
+			// Like fread, only whole elements are read
+			const size_t count = std::min(pCount, (m_data.size() - m_position) / pSize);
+			memcpy(pvBuffer, m_data.data() + m_position, count * pSize);
+			m_position += count * pSize;
+			return count;
+		}
+
+		size_t Write(const void*, size_t, size_t) override
+		{
+			return 0;
+		}
+
+		aiReturn Seek(size_t pOffset, aiOrigin pOrigin) override
+		{
+			size_t position;
+			switch (pOrigin)
+			{
+			case aiOrigin_SET: position = pOffset; break;
+			case aiOrigin_CUR: position = m_position + pOffset; break;
+			// The offset is negative for aiOrigin_END, so this wraps around to the right place
+			case aiOrigin_END: position = m_data.size() + pOffset; break;
+			default: return aiReturn_FAILURE;
+			}
+			if (position > m_data.size())
+			{
+				return aiReturn_FAILURE;
+			}
+			m_position = position;
+			return aiReturn_SUCCESS;
+		}
+
+		size_t Tell() const override
+		{
+			return m_position;
+		}
+
+		size_t FileSize() const override
+		{
+			return m_data.size();
+		}
+
+		void Flush() override
+		{
+		}
+
+	private:
+		MemoryMappedFile m_file;
+		std::string_view m_data;
+		size_t m_position;
+	};
+}
+
+bool MappedIOSystem::Exists(const char* pFile) const
+{
+	if (m_pArchive && m_pArchive->Find(pFile).data())
+	{
+		return true;
+	}
+	std::error_code ec;
+	return std::filesystem::is_regular_file(pFile, ec);
+}
+
+char MappedIOSystem::getOsSeparator() const
+{
+	// Archive names always use forward slashes, and so can every OS we run on
+	return '/';
+}
+
+Assimp::IOStream* MappedIOSystem::Open(const char* pFile, const char* pMode)
+{
+	if (strchr(pMode, 'w') || strchr(pMode, 'a') || strchr(pMode, '+'))
+	{
+		return nullptr;
+	}
+
+	if (m_pArchive)
+	{
+		std::string_view data = m_pArchive->Find(pFile);
+		if (data.data())
+		{
+			return new MappedIOStream(data);
+		}
+	}
+
+	// Assimp expects a null stream rather than an exception for files that don't exist
+	if (!Exists(pFile))
+	{
+		return nullptr;
+	}
+	MemoryMappedFile file(pFile);
+	std::string_view data(file.GetData(), file.GetSize());
+	if (std::find(m_openedFiles.begin(), m_openedFiles.end(), pFile) == m_openedFiles.end())
+	{
+		m_openedFiles.push_back(pFile);
+	}
+	return new MappedIOStream(data, std::move(file));
+}
+
+void MappedIOSystem::Close(Assimp::IOStream* pFile)
+{
+	delete pFile;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include "AssetArchive.h"
+
+// Assimp file system that reads from memory instead of through stdio. Files come from the
+// archive if one is given and contains them, and are otherwise memory-mapped from disk. Either
+// way Assimp's reads are plain copies out of a mapping, with no buffered reads or seeks in
+// between. Only reading is supported.
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+	// The archive must outlive the IO system
+	explicit MappedIOSystem(const AssetArchive* pArchive = nullptr) : m_pArchive(pArchive)
+	{
+	}
+
+	bool Exists(const char* pFile) const override;
+	char getOsSeparator() const override;
+	Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override;
+	void Close(Assimp::IOStream* pFile) override;
+
+	// Every file that was opened from disk rather than from the archive, in the order opened
+	const std::vector<std::string>& GetOpenedFiles() const { return m_openedFiles; }
+
+private:
+	const AssetArchive* m_pArchive;
+	std::vector<std::string> m_openedFiles;
+};
@@ -0,0 +1,1034 @@
+#include "GltfLoading.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+
+#include "MemoryMappedFile.h"
+
+namespace
+{
+	constexpr uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+	constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+	constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+	// Accessor component types
+	constexpr uint32_t GLTF_BYTE = 5120;
+	constexpr uint32_t GLTF_UNSIGNED_BYTE = 5121;
+	constexpr uint32_t GLTF_SHORT = 5122;
+	constexpr uint32_t GLTF_UNSIGNED_SHORT = 5123;
+	constexpr uint32_t GLTF_UNSIGNED_INT = 5125;
+	constexpr uint32_t GLTF_FLOAT = 5126;
+
+	// Primitive modes
+	constexpr uint32_t GLTF_TRIANGLES = 4;
+	constexpr uint32_t GLTF_TRIANGLE_STRIP = 5;
+	constexpr uint32_t GLTF_TRIANGLE_FAN = 6;
+
+	// Minimal JSON document tree, enough for glTF. Strings are views of the source text, except
+	// for the rare ones with escapes, which are decoded into the parser's arena.
+	struct JsonValue
+	{
+		enum class Type
+		{
+			eNull,
+			eBool,
+			eNumber,
+			eString,
+			eArray,
+			eObject
+		};
+
+		Type type = Type::eNull;
+		double number = 0.0;
+		std::string_view string;
+		std::vector<JsonValue> elements;
+		// Member names of an object, parallel to elements
+		std::vector<std::string_view> keys;
+
+		// Missing members and out of range elements are null
+		const JsonValue& operator[](std::string_view key) const
+		{
+			if (type == Type::eObject)
+			{
+				for (size_t i = 0; i < keys.size(); i++)
+				{
+					if (keys[i] == key)
+					{
+						return elements[i];
+					}
+				}
+			}
+			return GetNull();
+		}
+		const JsonValue& operator[](size_t index) const
+		{
+			return type == Type::eArray && index < elements.size() ? elements[index] : GetNull();
+		}
+
+		bool IsNull() const { return type == Type::eNull; }
+		size_t Size() const { return type == Type::eArray ? elements.size() : 0; }
+		double AsNumber(double fallback) const { return type == Type::eNumber ? number : fallback; }
+		bool AsBool(bool fallback) const { return type == Type::eBool ? number != 0.0 : fallback; }
+		std::string_view AsString() const { return type == Type::eString ? string : std::string_view(); }
+
+		// Indices, counts and byte offsets, which must be non-negative integers
+		uint64_t AsUint(uint64_t fallback) const
+		{
+			if (type == Type::eNull)
+			{
+				return fallback;
+			}
+			if (type != Type::eNumber || number < 0.0 || number > 9007199254740992.0 || std::floor(number) != number)
+			{
+				throw std::runtime_error("Invalid glTF: expected a non-negative integer");
+			}
+			return static_cast<uint64_t>(number);
+		}
+
+		static const JsonValue& GetNull()
+		{
+			static const JsonValue s_null;
+			return s_null;
+		}
+	};
+
+	class JsonParser
+	{
+	public:
+		JsonParser(std::string_view text, std::deque<std::string>& arena) : m_text(text), m_pos(0), m_arena(arena)
+		{
+		}
+
+		JsonValue Parse()
+		{
+			JsonValue value = ParseValue(0);
+			SkipWhitespace();
+			if (m_pos != m_text.size())
+			{
+				Fail();
+			}
+			return value;
+		}
+
+	private:
+		// Deeper documents are rejected rather than risking the stack
+		static constexpr int MAX_DEPTH = 128;
+
+		[[noreturn]] void Fail() const
+		{
+			throw std::runtime_error("Invalid glTF: malformed JSON at offset " + std::to_string(m_pos));
+		}
+
+		void SkipWhitespace()
+		{
+			while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+			{
+				m_pos++;
+			}
+		}
+
+		bool Consume(char c)
+		{
+			SkipWhitespace();
+			if (m_pos < m_text.size() && m_text[m_pos] == c)
+			{
+				m_pos++;
+				return true;
+			}
+			return false;
+		}
+
+		void Expect(char c)
+		{
+			if (!Consume(c))
+			{
+				Fail();
+			}
+		}
+
+		bool ConsumeLiteral(std::string_view literal)
+		{
+			if (m_text.substr(m_pos, literal.size()) == literal)
+			{
+				m_pos += literal.size();
+				return true;
+			}
+			return false;
+		}
+
+		JsonValue ParseValue(int depth)
+		{
+			SkipWhitespace();
+			if (m_pos >= m_text.size() || depth > MAX_DEPTH)
+			{
+				Fail();
+			}
+
+			JsonValue value;
+			const char c = m_text[m_pos];
+			if (c == '{')
+			{
+				m_pos++;
+				value.type = JsonValue::Type::eObject;
+				if (!Consume('}'))
+				{
+					do
+					{
+						SkipWhitespace();
+						value.keys.push_back(ParseString());
+						Expect(':');
+						value.elements.push_back(ParseValue(depth + 1));
+					} while (Consume(','));
+					Expect('}');
+				}
+			}
+			else if (c == '[')
+			{
+				m_pos++;
+				value.type = JsonValue::Type::eArray;
+				if (!Consume(']'))
+				{
+					do
+					{
+						value.elements.push_back(ParseValue(depth + 1));
+					} while (Consume(','));
+					Expect(']');
+				}
+			}
+			else if (c == '"')
+			{
+				value.type = JsonValue::Type::eString;
+				value.string = ParseString();
+			}
+			else if (ConsumeLiteral("true"))
+			{
+				value.type = JsonValue::Type::eBool;
+				value.number = 1.0;
+			}
+			else if (ConsumeLiteral("false"))
+			{
+				value.type = JsonValue::Type::eBool;
+			}
+			else if (!ConsumeLiteral("null"))
+			{
+				value.type = JsonValue::Type::eNumber;
+				const char* pEnd = m_text.data() + m_text.size();
+				auto result = std::from_chars(m_text.data() + m_pos, pEnd, value.number);
+				if (result.ec != std::errc())
+				{
+					Fail();
+				}
+				m_pos = result.ptr - m_text.data();
+			}
+			return value;
+		}
+
+		uint32_t ParseHex4()
+		{
+			uint32_t code = 0;
+			auto result = std::from_chars(m_text.data() + m_pos, m_text.data() + std::min(m_pos + 4, m_text.size()), code, 16);
+			if (result.ec != std::errc() || result.ptr != m_text.data() + m_pos + 4)
+			{
+				Fail();
+			}
+			m_pos += 4;
+			return code;
+		}
+
+		std::string_view ParseString()
+		{
+			if (m_pos >= m_text.size() || m_text[m_pos] != '"')
+			{
+				Fail();
+			}
+			const size_t start = ++m_pos;
+
+			// Strings without escapes are used in place
+			while (m_pos < m_text.size() && m_text[m_pos] != '\\')
+			{
+				if (m_text[m_pos] == '"')
+				{
+					return m_text.substr(start, m_pos++ - start);
+				}
+				m_pos++;
+			}
+
+			std::string decoded(m_text.substr(start, m_pos - start));
+			while (m_pos < m_text.size())
+			{
+				const char c = m_text[m_pos++];
+				if (c == '"')
+				{
+					m_arena.push_back(std::move(decoded));
+					return m_arena.back();
+				}
+				if (c != '\\')
+				{
+					decoded += c;
+					continue;
+				}
+				if (m_pos >= m_text.size())
+				{
+					Fail();
+				}
+				const char escape = m_text[m_pos++];
+				switch (escape)
+				{
+				case '"': case '\\': case '/': decoded += escape; break;
+				case 'b': decoded += '\b'; break;
+				case 'f': decoded += '\f'; break;
+				case 'n': decoded += '\n'; break;
+				case 'r': decoded += '\r'; break;
+				case 't': decoded += '\t'; break;
+				case 'u':
+				{
+					uint32_t code = ParseHex4();
+					// Characters outside the basic plane are written as UTF-16 surrogate pairs
+					if (code >= 0xD800 && code < 0xDC00 && ConsumeLiteral("\\u"))
+					{
+						const uint32_t low = ParseHex4();
+						if (low < 0xDC00 || low >= 0xE000)
+						{
+							Fail();
+						}
+						code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					}
+					AppendUtf8(decoded, code);
+					break;
+				}
+				default:
+					Fail();
+				}
+			}
+			Fail();
+		}
+
+		static void AppendUtf8(std::string& str, uint32_t code)
+		{
+			if (code < 0x80)
+			{
+				str += static_cast<char>(code);
+			}
+			else if (code < 0x800)
+			{
+				str += static_cast<char>(0xC0 | (code >> 6));
+				str += static_cast<char>(0x80 | (code & 0x3F));
+			}
+			else if (code < 0x10000)
+			{
+				str += static_cast<char>(0xE0 | (code >> 12));
+				str += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				str += static_cast<char>(0x80 | (code & 0x3F));
+			}
+			else
+			{
+				str += static_cast<char>(0xF0 | (code >> 18));
+				str += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+				str += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				str += static_cast<char>(0x80 | (code & 0x3F));
+			}
+		}
+
+		std::string_view m_text;
+		size_t m_pos;
+		std::deque<std::string>& m_arena;
+	};
+
+	// Decodes standard base64, as used by data URIs
+	std::vector<char> DecodeBase64(std::string_view text)
+	{
+		auto decodeChar = [](char c) -> int {
+			if (c >= 'A' && c <= 'Z') return c - 'A';
+			if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+			if (c >= '0' && c <= '9') return c - '0' + 52;
+			if (c == '+') return 62;
+			if (c == '/') return 63;
+			return -1;
+		};
+
+		std::vector<char> ret;
+		ret.reserve(text.size() / 4 * 3);
+		uint32_t bits = 0;
+		int bitCount = 0;
+		for (char c : text)
+		{
+			if (c == '=')
+			{
+				break;
+			}
+			const int value = decodeChar(c);
+			if (value < 0)
+			{
+				throw std::runtime_error("Invalid glTF: malformed base64 data URI");
+			}
+			bits = (bits << 6) | static_cast<uint32_t>(value);
+			bitCount += 6;
+			if (bitCount >= 8)
+			{
+				bitCount -= 8;
+				ret.push_back(static_cast<char>((bits >> bitCount) & 0xFF));
+			}
+		}
+		return ret;
+	}
+
+	// Resolves the percent-encoding of a relative URI
+	std::string DecodeUri(std::string_view uri)
+	{
+		std::string ret;
+		ret.reserve(uri.size());
+		for (size_t i = 0; i < uri.size(); i++)
+		{
+			uint32_t code = 0;
+			if (uri[i] == '%' && i + 2 < uri.size()
+				&& std::from_chars(uri.data() + i + 1, uri.data() + i + 3, code, 16).ptr == uri.data() + i + 3)
+			{
+				ret += static_cast<char>(code);
+				i += 2;
+			}
+			else
+			{
+				ret += uri[i];
+			}
+		}
+		return ret;
+	}
+
+	size_t GetComponentSize(uint32_t componentType)
+	{
+		switch (componentType)
+		{
+		case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return 1;
+		case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+		case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return 4;
+		default: return 0;
+		}
+	}
+
+	uint32_t GetComponentCount(std::string_view type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4" || type == "MAT2") return 4;
+		if (type == "MAT3") return 9;
+		if (type == "MAT4") return 16;
+		return 0;
+	}
+
+	// Reads one component as a float, applying the normalization rules of the spec if needed
+	float ReadComponent(const char* pSrc, uint32_t componentType, bool normalized)
+	{
+		switch (componentType)
+		{
+		case GLTF_BYTE:
+		{
+			int8_t value;
+			memcpy(&value, pSrc, sizeof(value));
+			return normalized ? std::max(value / 127.0f, -1.0f) : value;
+		}
+		case GLTF_UNSIGNED_BYTE:
+		{
+			uint8_t value;
+			memcpy(&value, pSrc, sizeof(value));
+			return normalized ? value / 255.0f : value;
+		}
+		case GLTF_SHORT:
+		{
+			int16_t value;
+			memcpy(&value, pSrc, sizeof(value));
+			return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+		}
+		case GLTF_UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			memcpy(&value, pSrc, sizeof(value));
+			return normalized ? value / 65535.0f : value;
+		}
+		case GLTF_UNSIGNED_INT:
+		{
+			uint32_t value;
+			memcpy(&value, pSrc, sizeof(value));
+			return static_cast<float>(value);
+		}
+		default:
+		{
+			float value;
+			memcpy(&value, pSrc, sizeof(value));
+			return value;
+		}
+		}
+	}
+
+	// Resolved accessor, pointing at its first element
+	struct Accessor
+	{
+		const char* pData;
+		size_t stride;
+		size_t count;
+		uint32_t componentType;
+		uint32_t componentCount;
+		bool normalized;
+	};
+
+	// Converts indices of the given primitive mode to a triangle list. glTF front faces are
+	// counterclockwise, so the last two corners of every triangle are swapped.
+	std::vector<uint32_t> ToTriangleList(const std::vector<uint32_t>& indices, uint32_t mode)
+	{
+		std::vector<uint32_t> ret;
+		if (mode == GLTF_TRIANGLES)
+		{
+			ret.resize(indices.size() / 3 * 3);
+			for (size_t i = 0; i < ret.size(); i += 3)
+			{
+				ret[i] = indices[i];
+				ret[i + 1] = indices[i + 2];
+				ret[i + 2] = indices[i + 1];
+			}
+		}
+		else if (indices.size() >= 3)
+		{
+			ret.reserve((indices.size() - 2) * 3);
+			for (size_t i = 0; i + 2 < indices.size(); i++)
+			{
+				if (mode == GLTF_TRIANGLE_FAN)
+				{
+					ret.insert(ret.end(), { indices[0], indices[i + 2], indices[i + 1] });
+				}
+				else if (i % 2 == 0)
+				{
+					ret.insert(ret.end(), { indices[i], indices[i + 2], indices[i + 1] });
+				}
+				else
+				{
+					ret.insert(ret.end(), { indices[i + 1], indices[i + 2], indices[i] });
+				}
+			}
+		}
+		return ret;
+	}
+
+	// glTF matrices are column-major and act on column vectors, which is the same memory layout
+	// as a row-major DirectXMath matrix acting on row vectors
+	DirectX::XMMATRIX GetNodeTransform(const JsonValue& node)
+	{
+		using namespace DirectX;
+
+		const JsonValue& matrix = node["matrix"];
+		if (matrix.Size() == 16)
+		{
+			XMFLOAT4X4 transform;
+			for (size_t i = 0; i < 16; i++)
+			{
+				transform.m[i / 4][i % 4] = static_cast<float>(matrix[i].AsNumber(0.0));
+			}
+			return XMLoadFloat4x4(&transform);
+		}
+
+		const JsonValue& t = node["translation"];
+		const JsonValue& r = node["rotation"];
+		const JsonValue& s = node["scale"];
+		auto get = [](const JsonValue& array, size_t i, double fallback) {
+			return static_cast<float>(array[i].AsNumber(fallback));
+		};
+		return XMMatrixScaling(get(s, 0, 1.0), get(s, 1, 1.0), get(s, 2, 1.0))
+			* XMMatrixRotationQuaternion(XMVectorSet(get(r, 0, 0.0), get(r, 1, 0.0), get(r, 2, 0.0), get(r, 3, 1.0)))
+			* XMMatrixTranslation(get(t, 0, 0.0), get(t, 1, 0.0), get(t, 2, 0.0));
+	}
+
+	// Gives every instance its own copy of its mesh with the instance transform applied, leaving
+	// identity instances. Mirroring transforms flip the winding, which is undone.
+	void BakeInstances(SourceModel& model)
+	{
+		using namespace DirectX;
+
+		std::vector<SourceMesh> baked;
+		baked.reserve(model.instances.size());
+		for (MeshInstance& instance : model.instances)
+		{
+			const SourceMesh& src = model.meshes[instance.meshIndex];
+			const XMMATRIX transform = XMLoadFloat4x4(&instance.transform);
+			XMVECTOR determinant;
+			const XMMATRIX normalTransform = XMMatrixTranspose(XMMatrixInverse(&determinant, transform));
+
+			SourceMesh mesh;
+			mesh.vertexCount = src.vertexCount;
+			mesh.indices = src.indices;
+			mesh.storage = src.storage;
+			mesh.texcoords = src.texcoords;
+			std::vector<XMFLOAT3> positions(src.vertexCount);
+			std::vector<XMFLOAT3> normals(src.vertexCount);
+			std::vector<XMFLOAT3> tangents(src.tangents ? src.vertexCount : 0);
+			for (uint32_t i = 0; i < src.vertexCount; i++)
+			{
+				const XMFLOAT3 position = src.positions.Get<XMFLOAT3>(i);
+				const XMFLOAT3 normal = src.normals.Get<XMFLOAT3>(i);
+				XMStoreFloat3(&positions[i], XMVector3TransformCoord(XMLoadFloat3(&position), transform));
+				XMStoreFloat3(&normals[i], XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&normal), normalTransform)));
+				if (src.tangents)
+				{
+					const XMFLOAT3 tangent = src.tangents.Get<XMFLOAT3>(i);
+					XMStoreFloat3(&tangents[i], XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&tangent), transform)));
+				}
+			}
+			mesh.positions = mesh.Store(std::move(positions));
+			mesh.normals = mesh.Store(std::move(normals));
+			if (src.tangents)
+			{
+				mesh.tangents = mesh.Store(std::move(tangents));
+			}
+			if (XMVectorGetX(determinant) < 0.0f)
+			{
+				for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+				{
+					std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+				}
+			}
+
+			instance.meshIndex = static_cast<uint32_t>(baked.size());
+			XMStoreFloat4x4(&instance.transform, XMMatrixIdentity());
+			baked.push_back(std::move(mesh));
+		}
+		model.meshes = std::move(baked);
+	}
+
+	class GltfImporter
+	{
+	public:
+		explicit GltfImporter(const std::string& path) : m_path(path)
+		{
+		}
+
+		SourceModel Import(const ModelLoadOptions& options)
+		{
+			ParseFile();
+			LoadBuffers();
+
+			SourceModel ret;
+			ret.dependencies = std::move(m_dependencies);
+
+			// glTF meshes are lists of primitives, each of which becomes one of our meshes
+			const JsonValue& meshes = m_json["meshes"];
+			m_meshPrimitives.resize(meshes.Size());
+			for (size_t i = 0; i < meshes.Size(); i++)
+			{
+				m_meshPrimitives[i].first = static_cast<uint32_t>(ret.meshes.size());
+				const JsonValue& primitives = meshes[i]["primitives"];
+				for (size_t j = 0; j < primitives.Size(); j++)
+				{
+					const uint32_t mode = static_cast<uint32_t>(primitives[j]["mode"].AsUint(GLTF_TRIANGLES));
+					if (mode == GLTF_TRIANGLES || mode == GLTF_TRIANGLE_STRIP || mode == GLTF_TRIANGLE_FAN)
+					{
+						ret.meshes.push_back(ImportPrimitive(primitives[j], mode));
+					}
+				}
+				m_meshPrimitives[i].second = static_cast<uint32_t>(ret.meshes.size());
+			}
+
+			// Without scenes, every node that isn't a child is a root
+			const JsonValue& nodes = m_json["nodes"];
+			const JsonValue& scene = m_json["scenes"][m_json["scene"].AsUint(0)];
+			std::vector<uint32_t> roots;
+			if (!scene.IsNull())
+			{
+				for (const JsonValue& root : scene["nodes"].elements)
+				{
+					roots.push_back(static_cast<uint32_t>(root.AsUint(0)));
+				}
+			}
+			else if (m_json["scenes"].IsNull())
+			{
+				std::vector<bool> isChild(nodes.Size());
+				for (const JsonValue& node : nodes.elements)
+				{
+					for (const JsonValue& child : node["children"].elements)
+					{
+						const uint64_t index = child.AsUint(0);
+						if (index < isChild.size())
+						{
+							isChild[index] = true;
+						}
+					}
+				}
+				for (uint32_t i = 0; i < isChild.size(); i++)
+				{
+					if (!isChild[i])
+					{
+						roots.push_back(i);
+					}
+				}
+			}
+
+			std::vector<bool> visited(nodes.Size());
+			for (uint32_t root : roots)
+			{
+				ProcessNode(root, DirectX::XMMatrixIdentity(), visited, ret.instances);
+			}
+
+			if (options.preTransformVertices)
+			{
+				BakeInstances(ret);
+			}
+			return ret;
+		}
+
+	private:
+		[[noreturn]] void Fail(const std::string& message) const
+		{
+			throw std::runtime_error("Failed to import " + m_path + ": " + message);
+		}
+
+		void ParseFile()
+		{
+			m_file = std::make_shared<MemoryMappedFile>(m_path);
+			const char* pData = m_file->GetData();
+			const size_t size = m_file->GetSize();
+
+			uint32_t magic = 0;
+			if (size >= sizeof(magic))
+			{
+				memcpy(&magic, pData, sizeof(magic));
+			}
+
+			std::string_view json(pData, size);
+			if (magic == GLB_MAGIC)
+			{
+				// 12-byte header of magic, version and total length, then chunks of length, type
+				// and data, starting with the JSON
+				uint32_t header[3];
+				if (size < sizeof(header))
+				{
+					Fail("truncated GLB header");
+				}
+				memcpy(header, pData, sizeof(header));
+				if (header[1] != 2)
+				{
+					Fail("unsupported GLB version " + std::to_string(header[1]));
+				}
+				const size_t length = std::min<size_t>(header[2], size);
+
+				json = std::string_view();
+				for (size_t offset = sizeof(header); offset + 8 <= length;)
+				{
+					uint32_t chunk[2];
+					memcpy(chunk, pData + offset, sizeof(chunk));
+					offset += sizeof(chunk);
+					if (chunk[0] > length - offset)
+					{
+						Fail("truncated GLB chunk");
+					}
+					if (chunk[1] == GLB_CHUNK_JSON && json.empty())
+					{
+						json = std::string_view(pData + offset, chunk[0]);
+					}
+					else if (chunk[1] == GLB_CHUNK_BIN && !m_binaryChunk.first)
+					{
+						m_binaryChunk = { pData + offset, chunk[0] };
+					}
+					// Chunks are padded to 4 bytes
+					offset += (chunk[0] + 3) & ~size_t(3);
+				}
+				if (json.empty())
+				{
+					Fail("GLB has no JSON chunk");
+				}
+			}
+
+			// Skip a UTF-8 byte order mark
+			if (json.substr(0, 3) == "\xEF\xBB\xBF")
+			{
+				json.remove_prefix(3);
+			}
+			m_json = JsonParser(json, m_arena).Parse();
+
+			if (m_json["asset"]["version"].AsString().substr(0, 2) != "2.")
+			{
+				Fail("only glTF 2.0 is supported");
+			}
+		}
+
+		// Buffers are kept alive by every mesh, whichever ones it actually references
+		void LoadBuffers()
+		{
+			m_storage.push_back(m_file);
+
+			const std::string directory = m_path.substr(0, m_path.find_last_of("/\\") + 1);
+			const JsonValue& buffers = m_json["buffers"];
+			for (size_t i = 0; i < buffers.Size(); i++)
+			{
+				const JsonValue& buffer = buffers[i];
+				const uint64_t byteLength = buffer["byteLength"].AsUint(0);
+				const std::string_view uri = buffer["uri"].AsString();
+
+				std::pair<const char*, size_t> range;
+				if (uri.empty())
+				{
+					// Only the first buffer may refer to the GLB binary chunk
+					if (i != 0 || !m_binaryChunk.first)
+					{
+						Fail("buffer " + std::to_string(i) + " has no data");
+					}
+					range = m_binaryChunk;
+				}
+				else if (uri.substr(0, 5) == "data:")
+				{
+					const size_t dataStart = uri.find(";base64,");
+					if (dataStart == std::string_view::npos)
+					{
+						Fail("buffer " + std::to_string(i) + " has a data URI that isn't base64");
+					}
+					auto pDecoded = std::make_shared<const std::vector<char>>(DecodeBase64(uri.substr(dataStart + 8)));
+					range = { pDecoded->data(), pDecoded->size() };
+					m_storage.push_back(std::move(pDecoded));
+				}
+				else
+				{
+					const std::string bufferPath = directory + DecodeUri(uri);
+					auto pFile = std::make_shared<const MemoryMappedFile>(bufferPath);
+					range = { pFile->GetData(), pFile->GetSize() };
+					m_storage.push_back(std::move(pFile));
+					m_dependencies.push_back(bufferPath);
+				}
+
+				if (range.second < byteLength)
+				{
+					Fail("buffer " + std::to_string(i) + " is shorter than its byteLength");
+				}
+				m_buffers.push_back(range);
+			}
+		}
+
+		Accessor GetAccessor(uint64_t index) const
+		{
+			const JsonValue& accessor = m_json["accessors"][index];
+			if (accessor.IsNull())
+			{
+				Fail("accessor " + std::to_string(index) + " doesn't exist");
+			}
+			if (!accessor["sparse"].IsNull())
+			{
+				Fail("sparse accessors aren't supported");
+			}
+			const JsonValue& bufferView = m_json["bufferViews"][accessor["bufferView"].AsUint(UINT64_MAX)];
+			if (bufferView.IsNull())
+			{
+				Fail("accessors without a valid buffer view aren't supported");
+			}
+
+			Accessor ret{};
+			ret.componentType = static_cast<uint32_t>(accessor["componentType"].AsUint(0));
+			ret.componentCount = GetComponentCount(accessor["type"].AsString());
+			ret.count = accessor["count"].AsUint(0);
+			ret.normalized = accessor["normalized"].AsBool(false);
+			const size_t elementSize = GetComponentSize(ret.componentType) * ret.componentCount;
+			if (elementSize == 0)
+			{
+				Fail("accessor " + std::to_string(index) + " has an invalid type");
+			}
+
+			const uint64_t bufferIndex = bufferView["buffer"].AsUint(UINT64_MAX);
+			if (bufferIndex >= m_buffers.size())
+			{
+				Fail("buffer view references a missing buffer");
+			}
+			const auto& buffer = m_buffers[bufferIndex];
+			const uint64_t viewOffset = bufferView["byteOffset"].AsUint(0);
+			const uint64_t viewLength = bufferView["byteLength"].AsUint(0);
+			const uint64_t accessorOffset = accessor["byteOffset"].AsUint(0);
+			ret.stride = bufferView["byteStride"].AsUint(elementSize);
+			if (viewOffset + viewLength > buffer.second
+				|| (ret.count > 0 && accessorOffset + ret.stride * (ret.count - 1) + elementSize > viewLength))
+			{
+				Fail("accessor " + std::to_string(index) + " is out of bounds");
+			}
+			ret.pData = buffer.first + viewOffset + accessorOffset;
+			return ret;
+		}
+
+		// Float data is referenced in place, anything else is converted
+		template<typename T>
+		AttributeView ReadAttribute(const Accessor& accessor, SourceMesh& mesh) const
+		{
+			constexpr uint32_t componentCount = sizeof(T) / sizeof(float);
+			if (accessor.count != mesh.vertexCount || accessor.componentCount < componentCount)
+			{
+				Fail("vertex attribute has the wrong count or type");
+			}
+			if (accessor.componentType == GLTF_FLOAT && accessor.stride >= sizeof(T))
+			{
+				return { accessor.pData, accessor.stride };
+			}
+
+			const size_t componentSize = GetComponentSize(accessor.componentType);
+			std::vector<T> converted(accessor.count);
+			for (size_t i = 0; i < accessor.count; i++)
+			{
+				float components[componentCount];
+				for (uint32_t c = 0; c < componentCount; c++)
+				{
+					components[c] = ReadComponent(accessor.pData + i * accessor.stride + c * componentSize,
+						accessor.componentType, accessor.normalized);
+				}
+				memcpy(&converted[i], components, sizeof(T));
+			}
+			return mesh.Store(std::move(converted));
+		}
+
+		std::vector<uint32_t> ReadIndices(const Accessor& accessor) const
+		{
+			if (accessor.componentCount != 1 || (accessor.componentType != GLTF_UNSIGNED_BYTE
+				&& accessor.componentType != GLTF_UNSIGNED_SHORT && accessor.componentType != GLTF_UNSIGNED_INT))
+			{
+				Fail("indices must be unsigned integer scalars");
+			}
+
+			std::vector<uint32_t> ret(accessor.count);
+			for (size_t i = 0; i < accessor.count; i++)
+			{
+				const char* pSrc = accessor.pData + i * accessor.stride;
+				if (accessor.componentType == GLTF_UNSIGNED_BYTE)
+				{
+					ret[i] = static_cast<uint8_t>(*pSrc);
+				}
+				else if (accessor.componentType == GLTF_UNSIGNED_SHORT)
+				{
+					uint16_t index;
+					memcpy(&index, pSrc, sizeof(index));
+					ret[i] = index;
+				}
+				else
+				{
+					memcpy(&ret[i], pSrc, sizeof(ret[i]));
+				}
+			}
+			return ret;
+		}
+
+		SourceMesh ImportPrimitive(const JsonValue& primitive, uint32_t mode) const
+		{
+			using namespace DirectX;
+
+			const JsonValue& attributes = primitive["attributes"];
+			if (attributes["POSITION"].IsNull())
+			{
+				Fail("primitive has no positions");
+			}
+
+			SourceMesh mesh;
+			mesh.storage = m_storage;
+			const Accessor positions = GetAccessor(attributes["POSITION"].AsUint(0));
+			if (positions.count > UINT32_MAX)
+			{
+				Fail("primitive has too many vertices");
+			}
+			mesh.vertexCount = static_cast<uint32_t>(positions.count);
+			mesh.positions = ReadAttribute<XMFLOAT3>(positions, mesh);
+			if (!attributes["NORMAL"].IsNull())
+			{
+				mesh.normals = ReadAttribute<XMFLOAT3>(GetAccessor(attributes["NORMAL"].AsUint(0)), mesh);
+			}
+			if (!attributes["TEXCOORD_0"].IsNull())
+			{
+				mesh.texcoords = ReadAttribute<XMFLOAT2>(GetAccessor(attributes["TEXCOORD_0"].AsUint(0)), mesh);
+				// Tangents are only used together with texcoords. The handedness in w is dropped.
+				if (!attributes["TANGENT"].IsNull())
+				{
+					mesh.tangents = ReadAttribute<XMFLOAT3>(GetAccessor(attributes["TANGENT"].AsUint(0)), mesh);
+				}
+			}
+
+			std::vector<uint32_t> indices;
+			if (!primitive["indices"].IsNull())
+			{
+				indices = ReadIndices(GetAccessor(primitive["indices"].AsUint(0)));
+			}
+			else
+			{
+				indices.resize(mesh.vertexCount);
+				for (uint32_t i = 0; i < mesh.vertexCount; i++)
+				{
+					indices[i] = i;
+				}
+			}
+			for (uint32_t index : indices)
+			{
+				if (index >= mesh.vertexCount)
+				{
+					Fail("index out of range");
+				}
+			}
+			mesh.indices = ToTriangleList(indices, mode);
+
+			if (!mesh.normals)
+			{
+				GenerateNormals(mesh);
+			}
+			if (mesh.texcoords && !mesh.tangents)
+			{
+				GenerateTangents(mesh);
+			}
+			return mesh;
+		}
+
+		// Records an instance for every primitive of the node's mesh and those of its
+		// descendants. Nodes may only appear once in the hierarchy.
+		void ProcessNode(uint64_t index, DirectX::FXMMATRIX parentTransform, std::vector<bool>& visited,
+			std::vector<MeshInstance>& instances) const
+		{
+			using namespace DirectX;
+
+			const JsonValue& node = m_json["nodes"][index];
+			if (node.IsNull() || visited[index])
+			{
+				Fail("invalid node hierarchy");
+			}
+			visited[index] = true;
+
+			const XMMATRIX transform = GetNodeTransform(node) * parentTransform;
+			const uint64_t mesh = node["mesh"].AsUint(UINT64_MAX);
+			if (mesh != UINT64_MAX)
+			{
+				if (mesh >= m_meshPrimitives.size())
+				{
+					Fail("node references a missing mesh");
+				}
+				MeshInstance instance{};
+				XMStoreFloat4x4(&instance.transform, transform);
+				for (uint32_t i = m_meshPrimitives[mesh].first; i < m_meshPrimitives[mesh].second; i++)
+				{
+					instance.meshIndex = i;
+					instances.push_back(instance);
+				}
+			}
+
+			for (const JsonValue& child : node["children"].elements)
+			{
+				ProcessNode(child.AsUint(0), transform, visited, instances);
+			}
+		}
+
+		std::string m_path;
+		std::shared_ptr<const MemoryMappedFile> m_file;
+		std::deque<std::string> m_arena;
+		JsonValue m_json;
+		std::pair<const char*, size_t> m_binaryChunk = { nullptr, 0 };
+		// Data and size of every buffer, which may point into a mapping or a decoded data URI
+		std::vector<std::pair<const char*, size_t>> m_buffers;
+		std::vector<std::shared_ptr<const void>> m_storage;
+		// External buffer files, which the mesh cache has to check as well as the glTF itself
+		std::vector<std::string> m_dependencies;
+		// Range of our meshes made from each glTF mesh
+		std::vector<std::pair<uint32_t, uint32_t>> m_meshPrimitives;
+	};
+}
+
+SourceModel ImportGltf(const std::string& path, const ModelLoadOptions& options)
+{
+	return GltfImporter(path).Import(options);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+#include "MeshImport.h"
+
+// Native glTF 2.0 importer for .gltf files, with external or embedded base64 buffers, and .glb
+// files. Buffer files and the GLB binary chunk are memory-mapped and float attributes are
+// referenced in place, so only indices, normalized integer attributes and missing normals and
+// tangents are converted or generated. Every primitive becomes one mesh. Triangle lists, strips
+// and fans are supported; points and lines are skipped.
+SourceModel ImportGltf(const std::string& path, const ModelLoadOptions& options);
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// 64-bit non-cryptographic hash (XXH64 algorithm). Used to key cooked asset caches and
+// to detect duplicate uploads, so it needs to run at close to memory bandwidth.
+namespace HashDetail
+{
+	constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+	constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+	constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+	constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+	constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+	inline uint64_t Rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t Read64(const uint8_t* p)
+	{
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint64_t Round(uint64_t acc, uint64_t input)
+	{
+		acc += input * PRIME2;
+		acc = Rotl(acc, 31);
+		return acc * PRIME1;
+	}
+
+	inline uint64_t MergeRound(uint64_t acc, uint64_t val)
+	{
+		acc ^= Round(0, val);
+		return acc * PRIME1 + PRIME4;
+	}
+}
+
+inline uint64_t Hash64(const void* pData, size_t size, uint64_t seed = 0)
+{
+	using namespace HashDetail;
+
+	const uint8_t* p = static_cast<const uint8_t*>(pData);
+	const uint8_t* const end = p + size;
+	uint64_t h;
+
+	if (size >= 32)
+	{
+		const uint8_t* const limit = end - 32;
+		uint64_t v1 = seed + PRIME1 + PRIME2;
+		uint64_t v2 = seed + PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME1;
+		do
+		{
+			v1 = Round(v1, Read64(p));
+			v2 = Round(v2, Read64(p + 8));
+			v3 = Round(v3, Read64(p + 16));
+			v4 = Round(v4, Read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+		h = MergeRound(h, v1);
+		h = MergeRound(h, v2);
+		h = MergeRound(h, v3);
+		h = MergeRound(h, v4);
+	}
+	else
+	{
+		h = seed + PRIME5;
+	}
+
+	h += static_cast<uint64_t>(size);
+
+	while (p + 8 <= end)
+	{
+		h ^= Round(0, Read64(p));
+		h = Rotl(h, 27) * PRIME1 + PRIME4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= static_cast<uint64_t>(Read32(p)) * PRIME1;
+		h = Rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		h ^= (*p) * PRIME5;
+		h = Rotl(h, 11) * PRIME1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
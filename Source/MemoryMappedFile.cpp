@@ -0,0 +1,101 @@
+#include "MemoryMappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MemoryMappedFile::MemoryMappedFile(const std::string& path) : MemoryMappedFile()
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Failed to open file " + path);
+	}
+	m_file = file;
+
+	LARGE_INTEGER size{};
+	GetFileSizeEx(file, &size);
+	m_size = static_cast<size_t>(size.QuadPart);
+
+	// Empty files can't be mapped, but are still valid to read
+	if (m_size == 0)
+	{
+		return;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		throw std::runtime_error("Failed to map file " + path);
+	}
+	m_mapping = mapping;
+
+	m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_data)
+	{
+		throw std::runtime_error("Failed to map file " + path);
+	}
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+	if (m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file)
+	{
+		CloseHandle(m_file);
+	}
+}
+#else
+MemoryMappedFile::MemoryMappedFile(const std::string& path) : MemoryMappedFile()
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw std::runtime_error("Failed to open file " + path);
+	}
+
+	struct stat st{};
+	fstat(fd, &st);
+	m_size = static_cast<size_t>(st.st_size);
+
+	// Empty files can't be mapped, but are still valid to read
+	if (m_size > 0)
+	{
+		void* ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error("Failed to map file " + path);
+		}
+		madvise(ptr, m_size, MADV_SEQUENTIAL);
+		m_data = static_cast<const char*>(ptr);
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+	if (m_data)
+	{
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+}
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <utility>
+
+// RAII class for a read-only memory mapping of a whole file
+class MemoryMappedFile
+{
+public:
+	MemoryMappedFile() : m_data(nullptr), m_size(0), m_file(nullptr), m_mapping(nullptr)
+	{
+	}
+	explicit MemoryMappedFile(const std::string& path);
+	~MemoryMappedFile();
+
+	MemoryMappedFile(const MemoryMappedFile& other) = delete;
+	MemoryMappedFile& operator=(const MemoryMappedFile& other) = delete;
+
+	MemoryMappedFile(MemoryMappedFile&& other) noexcept : MemoryMappedFile()
+	{
+		swap(*this, other);
+	}
+	MemoryMappedFile& operator=(MemoryMappedFile&& other) noexcept
+	{
+		swap(*this, other);
+		return *this;
+	}
+
+	explicit operator bool() const
+	{
+		return m_data != nullptr;
+	}
+
+	const char* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+	friend void swap(MemoryMappedFile& first, MemoryMappedFile& second)
+	{
+		using std::swap;
+		swap(first.m_data, second.m_data);
+		swap(first.m_size, second.m_size);
+		swap(first.m_file, second.m_file);
+		swap(first.m_mapping, second.m_mapping);
+	}
+
+private:
+	const char* m_data;
+	size_t m_size;
+	// OS handles, only used on Windows
+	void* m_file;
+	void* m_mapping;
+};
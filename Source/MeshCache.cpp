@@ -0,0 +1,333 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "Hash.h"
+#include "MemoryMappedFile.h"
+
+namespace
+{
+	constexpr uint32_t MESH_CACHE_MAGIC = 0x4853454D; // "MESH"
+	constexpr uint64_t PAGE_SIZE = 4096;
+
+	struct MeshCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint64_t meshCount;
+		uint64_t instanceCount;
+		uint64_t dependencyCount;
+		uint64_t dependencyPathsSize;
+	};
+
+	// Dependency paths are stored back to back after the dependency table
+	struct DependencyEntry
+	{
+		uint64_t pathOffset;
+		uint64_t pathSize;
+	};
+
+	// Variable-length arrays stored per mesh, in file order
+	enum class MeshBlob
+	{
+		eVertices,
+		eIndices,
+		eMeshlets,
+		eMeshletVertices,
+		eMeshletTriangles,
+		eLods,
+		eLodIndices,
+		eCount
+	};
+
+	struct BlobRange
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct MeshCacheEntry
+	{
+		uint32_t vertexType;
+		uint32_t indexType;
+		DirectX::XMFLOAT3 boundsCenter;
+		DirectX::XMFLOAT3 boundsExtents;
+		DirectX::XMFLOAT3 sphereCenter;
+		float sphereRadius;
+		VertexQuantization quantization;
+		BlobRange blobs[static_cast<size_t>(MeshBlob::eCount)];
+	};
+
+	// Byte views of each blob of a mesh, in MeshBlob order
+	std::array<std::pair<const char*, uint64_t>, static_cast<size_t>(MeshBlob::eCount)> GetBlobs(const Mesh& mesh)
+	{
+		return { {
+			{ mesh.vertices.data(), mesh.vertices.size() },
+			{ reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t) },
+			{ reinterpret_cast<const char*>(mesh.meshlets.data()), mesh.meshlets.size() * sizeof(Meshlet) },
+			{ reinterpret_cast<const char*>(mesh.meshletVertices.data()), mesh.meshletVertices.size() * sizeof(uint32_t) },
+			{ reinterpret_cast<const char*>(mesh.meshletTriangles.data()), mesh.meshletTriangles.size() },
+			{ reinterpret_cast<const char*>(mesh.lods.data()), mesh.lods.size() * sizeof(MeshLod) },
+			{ reinterpret_cast<const char*>(mesh.lodIndices.data()), mesh.lodIndices.size() * sizeof(uint32_t) }
+		} };
+	}
+
+	// Resizes the vector to fit the blob and copies it in. Returns false if the size isn't a
+	// whole number of elements.
+	template<typename T>
+	bool ReadBlob(const char* pData, const BlobRange& range, std::vector<T>& dst)
+	{
+		if (range.size % sizeof(T) != 0)
+		{
+			return false;
+		}
+		dst.resize(range.size / sizeof(T));
+		memcpy(dst.data(), pData + range.offset, range.size);
+		return true;
+	}
+
+	constexpr uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Folds the size and modification time of each dependency into the key, so that editing a
+	// file the source refers to invalidates the cache without hashing its contents on every
+	// load. Returns false if a dependency can't be accessed.
+	bool AddDependenciesToKey(uint64_t& key, const std::vector<std::string>& dependencies)
+	{
+		for (const std::string& path : dependencies)
+		{
+			std::error_code ec;
+			const uint64_t stamp[2] = {
+				std::filesystem::file_size(path, ec),
+				static_cast<uint64_t>(std::filesystem::last_write_time(path, ec).time_since_epoch().count())
+			};
+			if (ec)
+			{
+				return false;
+			}
+			key = Hash64(stamp, sizeof(stamp), key);
+		}
+		return true;
+	}
+
+	void WritePadding(std::ofstream& ofs, uint64_t size)
+	{
+		static const char zeros[PAGE_SIZE] = {};
+		while (size > 0)
+		{
+			uint64_t count = std::min(size, PAGE_SIZE);
+			ofs.write(zeros, count);
+			size -= count;
+		}
+	}
+}
+
+uint64_t ComputeMeshCacheKey(const std::string& sourcePath, uint64_t importSettingsHash)
+{
+	MemoryMappedFile file(sourcePath);
+	uint64_t seed = importSettingsHash ^ MESH_CACHE_VERSION;
+	return Hash64(file.GetData(), file.GetSize(), seed);
+}
+
+bool ReadMeshCache(const std::string& cachePath, uint64_t key, Model& model)
+{
+	std::error_code ec;
+	if (!std::filesystem::exists(cachePath, ec))
+	{
+		return false;
+	}
+
+	MemoryMappedFile file(cachePath);
+	const char* pData = file.GetData();
+	const uint64_t fileSize = file.GetSize();
+
+	// Validate the header before trusting anything else in the file
+	if (fileSize < sizeof(MeshCacheHeader))
+	{
+		return false;
+	}
+	MeshCacheHeader header;
+	memcpy(&header, pData, sizeof(header));
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION)
+	{
+		return false;
+	}
+	if (header.meshCount > fileSize / sizeof(MeshCacheEntry) || header.instanceCount > fileSize / sizeof(MeshInstance)
+		|| header.dependencyCount > fileSize / sizeof(DependencyEntry) || header.dependencyPathsSize > fileSize)
+	{
+		return false;
+	}
+	const uint64_t instanceTableOffset = sizeof(MeshCacheHeader) + header.meshCount * sizeof(MeshCacheEntry);
+	const uint64_t dependencyTableOffset = instanceTableOffset + header.instanceCount * sizeof(MeshInstance);
+	const uint64_t dependencyPathsOffset = dependencyTableOffset + header.dependencyCount * sizeof(DependencyEntry);
+	const uint64_t tableEnd = dependencyPathsOffset + header.dependencyPathsSize;
+	if (tableEnd > fileSize)
+	{
+		return false;
+	}
+
+	// The stored key covers the dependencies as they were when the cache was written
+	std::vector<std::string> dependencies(header.dependencyCount);
+	for (uint64_t i = 0; i < header.dependencyCount; i++)
+	{
+		DependencyEntry dependency;
+		memcpy(&dependency, pData + dependencyTableOffset + i * sizeof(DependencyEntry), sizeof(dependency));
+		if (dependency.pathOffset > header.dependencyPathsSize
+			|| dependency.pathSize > header.dependencyPathsSize - dependency.pathOffset)
+		{
+			return false;
+		}
+		dependencies[i].assign(pData + dependencyPathsOffset + dependency.pathOffset, dependency.pathSize);
+	}
+	if (!AddDependenciesToKey(key, dependencies) || header.key != key)
+	{
+		return false;
+	}
+
+	Model ret;
+	ret.instances.resize(header.instanceCount);
+	memcpy(ret.instances.data(), pData + instanceTableOffset, header.instanceCount * sizeof(MeshInstance));
+	for (const auto& instance : ret.instances)
+	{
+		if (instance.meshIndex >= header.meshCount)
+		{
+			return false;
+		}
+	}
+
+	ret.meshes.resize(header.meshCount);
+	const char* pEntries = pData + sizeof(MeshCacheHeader);
+	for (uint64_t i = 0; i < header.meshCount; i++)
+	{
+		MeshCacheEntry entry;
+		memcpy(&entry, pEntries + i * sizeof(MeshCacheEntry), sizeof(entry));
+
+		const VertexType type = static_cast<VertexType>(entry.vertexType);
+		if (GetVertexSize(type) == 0 || entry.indexType > static_cast<uint32_t>(IndexType::eUint32))
+		{
+			return false;
+		}
+		for (const auto& blob : entry.blobs)
+		{
+			if (blob.offset > fileSize || blob.size > fileSize - blob.offset)
+			{
+				return false;
+			}
+		}
+
+		// Blobs are copied straight out of the mapping with no further conversion
+		Mesh& mesh = ret.meshes[i];
+		mesh.type = type;
+		mesh.indexType = static_cast<IndexType>(entry.indexType);
+		mesh.bounds = DirectX::BoundingBox(entry.boundsCenter, entry.boundsExtents);
+		mesh.boundingSphere = DirectX::BoundingSphere(entry.sphereCenter, entry.sphereRadius);
+		mesh.quantization = entry.quantization;
+		auto blob = [&](MeshBlob b) -> const BlobRange& { return entry.blobs[static_cast<size_t>(b)]; };
+		bool valid = ReadBlob(pData, blob(MeshBlob::eVertices), mesh.vertices)
+			&& ReadBlob(pData, blob(MeshBlob::eIndices), mesh.indices)
+			&& ReadBlob(pData, blob(MeshBlob::eMeshlets), mesh.meshlets)
+			&& ReadBlob(pData, blob(MeshBlob::eMeshletVertices), mesh.meshletVertices)
+			&& ReadBlob(pData, blob(MeshBlob::eMeshletTriangles), mesh.meshletTriangles)
+			&& ReadBlob(pData, blob(MeshBlob::eLods), mesh.lods)
+			&& ReadBlob(pData, blob(MeshBlob::eLodIndices), mesh.lodIndices);
+		if (!valid || mesh.vertices.size() % GetVertexSize(type) != 0)
+		{
+			return false;
+		}
+	}
+
+	model = std::move(ret);
+	return true;
+}
+
+bool WriteMeshCache(const std::string& cachePath, uint64_t key, const Model& model,
+	const std::vector<std::string>& dependencies)
+{
+	const std::vector<Mesh>& meshes = model.meshes;
+	if (!AddDependenciesToKey(key, dependencies))
+	{
+		return false;
+	}
+
+	std::vector<DependencyEntry> dependencyEntries(dependencies.size());
+	std::string dependencyPaths;
+	for (size_t i = 0; i < dependencies.size(); i++)
+	{
+		dependencyEntries[i] = DependencyEntry{ dependencyPaths.size(), dependencies[i].size() };
+		dependencyPaths += dependencies[i];
+	}
+	const uint64_t tablesSize = sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheEntry)
+		+ model.instances.size() * sizeof(MeshInstance) + dependencyEntries.size() * sizeof(DependencyEntry)
+		+ dependencyPaths.size();
+
+	// Lay out the blobs after the tables, each starting on a new page
+	std::vector<MeshCacheEntry> entries(meshes.size());
+	uint64_t offset = AlignUp(tablesSize, PAGE_SIZE);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const Mesh& mesh = meshes[i];
+		MeshCacheEntry& entry = entries[i];
+		entry.vertexType = static_cast<uint32_t>(mesh.type);
+		entry.indexType = static_cast<uint32_t>(mesh.indexType);
+		entry.boundsCenter = mesh.bounds.Center;
+		entry.boundsExtents = mesh.bounds.Extents;
+		entry.sphereCenter = mesh.boundingSphere.Center;
+		entry.sphereRadius = mesh.boundingSphere.Radius;
+		entry.quantization = mesh.quantization;
+
+		const auto blobs = GetBlobs(mesh);
+		for (size_t j = 0; j < blobs.size(); j++)
+		{
+			entry.blobs[j] = BlobRange{ offset, blobs[j].second };
+			offset = AlignUp(offset + blobs[j].second, PAGE_SIZE);
+		}
+	}
+
+	// Write to a temporary file first so that an interrupted write never leaves a corrupt cache
+	const std::string tmpPath = cachePath + ".tmp";
+	{
+		std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!ofs)
+		{
+			return false;
+		}
+
+		MeshCacheHeader header{ MESH_CACHE_MAGIC, MESH_CACHE_VERSION, key, meshes.size(), model.instances.size(),
+			dependencyEntries.size(), dependencyPaths.size() };
+		ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		ofs.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+		ofs.write(reinterpret_cast<const char*>(model.instances.data()), model.instances.size() * sizeof(MeshInstance));
+		ofs.write(reinterpret_cast<const char*>(dependencyEntries.data()), dependencyEntries.size() * sizeof(DependencyEntry));
+		ofs.write(dependencyPaths.data(), dependencyPaths.size());
+		uint64_t written = tablesSize;
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const auto blobs = GetBlobs(meshes[i]);
+			for (size_t j = 0; j < blobs.size(); j++)
+			{
+				const BlobRange& range = entries[i].blobs[j];
+				WritePadding(ofs, range.offset - written);
+				ofs.write(blobs[j].first, range.size);
+				written = range.offset + range.size;
+			}
+		}
+		WritePadding(ofs, offset - written);
+
+		if (!ofs)
+		{
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, cachePath, ec);
+	return !ec;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ModelLoading.h"
+
+// Cooked binary mesh cache. The file is a small header, mesh table, instance table and
+// dependency list followed by the per-mesh arrays (vertices, indices, meshlets), each aligned to
+// a page boundary so they can be read straight out of a memory mapping.
+
+// Bump whenever the layout of the file or of any cached structure changes
+constexpr uint32_t MESH_CACHE_VERSION = 7;
+
+// Computes the key that a cache file must match to be valid for the given source file. Files the
+// source refers to are checked separately, against the dependency list stored in the cache.
+uint64_t ComputeMeshCacheKey(const std::string& sourcePath, uint64_t importSettingsHash);
+
+// Returns false if the cache file doesn't exist, doesn't match the key, or any of its
+// dependencies is missing or has a different size or modification time than when it was written
+bool ReadMeshCache(const std::string& cachePath, uint64_t key, Model& model);
+
+// Returns false if the cache file or one of the dependencies couldn't be accessed
+bool WriteMeshCache(const std::string& cachePath, uint64_t key, const Model& model,
+	const std::vector<std::string>& dependencies);
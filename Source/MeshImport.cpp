@@ -0,0 +1,572 @@
+#include "MeshImport.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "MeshOptimization.h"
+#include "ThreadPool.h"
+
+template<size_t N>
+void InterleaveStreams(char* pDst, size_t stride, size_t count, const std::array<VertexStream, N>& streams,
+	bool allowSimd)
+{
+	size_t i = 0;
+#if defined(_M_X64) || defined(__SSE2__)
+	// Each attribute is moved with a single unaligned 16-byte load and store. The extra lane
+	// read comes from the next source element, and the extra lane written is overwritten by the
+	// next stream or the next vertex, which is why the last vertex is left to the scalar loop
+	// below.
+	if (allowSimd)
+	{
+		for (; i + 1 < count; i++)
+		{
+			char* pVertex = pDst + i * stride;
+			for (const auto& stream : streams)
+			{
+				__m128 value = _mm_loadu_ps(reinterpret_cast<const float*>(stream.src.pData + i * stream.src.stride));
+				if (stream.size == 12)
+				{
+					_mm_storeu_ps(reinterpret_cast<float*>(pVertex + stream.dstOffset), value);
+				}
+				else
+				{
+					_mm_storel_pi(reinterpret_cast<__m64*>(pVertex + stream.dstOffset), value);
+				}
+			}
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		char* pVertex = pDst + i * stride;
+		for (const auto& stream : streams)
+		{
+			memcpy(pVertex + stream.dstOffset, stream.src.pData + i * stream.src.stride, stream.size);
+		}
+	}
+}
+
+template void InterleaveStreams<2>(char*, size_t, size_t, const std::array<VertexStream, 2>&, bool);
+template void InterleaveStreams<4>(char*, size_t, size_t, const std::array<VertexStream, 4>&, bool);
+
+namespace
+{
+	uint16_t QuantizeUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+	}
+
+	int16_t QuantizeSnorm16(float value)
+	{
+		float scaled = std::clamp(value, -1.0f, 1.0f) * 32767.0f;
+		return static_cast<int16_t>(scaled >= 0.0f ? scaled + 0.5f : scaled - 0.5f);
+	}
+
+	// Octahedral encoding of a unit vector, decoded by OctahedralDecode in the shaders
+	DirectX::PackedVector::XMSHORTN2 EncodeOctahedral(const DirectX::XMFLOAT3& n)
+	{
+		float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		float u = l1 > 0.0f ? n.x / l1 : 0.0f;
+		float v = l1 > 0.0f ? n.y / l1 : 0.0f;
+		// Fold the lower hemisphere over the diagonals
+		if (n.z < 0.0f)
+		{
+			float foldedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+			float foldedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+			u = foldedU;
+			v = foldedV;
+		}
+		return { QuantizeSnorm16(u), QuantizeSnorm16(v) };
+	}
+
+	// Writes the vertices in one of the packed formats, along with the parameters to decode them
+	void PackVertices(const SourceMesh& mesh, Mesh& ret)
+	{
+		using namespace DirectX;
+		using namespace DirectX::PackedVector;
+
+		// Positions are quantized relative to the mesh bounds
+		VertexQuantization& quantization = ret.quantization;
+		quantization.positionOffset = XMFLOAT3(ret.bounds.Center.x - ret.bounds.Extents.x,
+			ret.bounds.Center.y - ret.bounds.Extents.y, ret.bounds.Center.z - ret.bounds.Extents.z);
+		quantization.positionScale = XMFLOAT3(2.0f * ret.bounds.Extents.x,
+			2.0f * ret.bounds.Extents.y, 2.0f * ret.bounds.Extents.z);
+		const XMFLOAT3 invPositionScale(
+			quantization.positionScale.x > 0.0f ? 1.0f / quantization.positionScale.x : 0.0f,
+			quantization.positionScale.y > 0.0f ? 1.0f / quantization.positionScale.y : 0.0f,
+			quantization.positionScale.z > 0.0f ? 1.0f / quantization.positionScale.z : 0.0f);
+		auto packPosition = [&](const XMFLOAT3& p) {
+			return XMUSHORTN4{
+				QuantizeUnorm16((p.x - quantization.positionOffset.x) * invPositionScale.x),
+				QuantizeUnorm16((p.y - quantization.positionOffset.y) * invPositionScale.y),
+				QuantizeUnorm16((p.z - quantization.positionOffset.z) * invPositionScale.z),
+				uint16_t(0)
+			};
+		};
+
+		if (mesh.texcoords)
+		{
+			assert(mesh.tangents);
+
+			// Texcoords may be outside [0, 1] for tiling, so they get their own range
+			XMFLOAT2 texcoordMin(FLT_MAX, FLT_MAX);
+			XMFLOAT2 texcoordMax(-FLT_MAX, -FLT_MAX);
+			for (uint32_t i = 0; i < mesh.vertexCount; i++)
+			{
+				const XMFLOAT2 texcoord = mesh.texcoords.Get<XMFLOAT2>(i);
+				texcoordMin = XMFLOAT2(std::min(texcoordMin.x, texcoord.x), std::min(texcoordMin.y, texcoord.y));
+				texcoordMax = XMFLOAT2(std::max(texcoordMax.x, texcoord.x), std::max(texcoordMax.y, texcoord.y));
+			}
+			if (mesh.vertexCount == 0)
+			{
+				texcoordMin = texcoordMax = XMFLOAT2(0.0f, 0.0f);
+			}
+			quantization.texcoordOffset = texcoordMin;
+			quantization.texcoordScale = XMFLOAT2(texcoordMax.x - texcoordMin.x, texcoordMax.y - texcoordMin.y);
+			const XMFLOAT2 invTexcoordScale(
+				quantization.texcoordScale.x > 0.0f ? 1.0f / quantization.texcoordScale.x : 0.0f,
+				quantization.texcoordScale.y > 0.0f ? 1.0f / quantization.texcoordScale.y : 0.0f);
+
+			ret.type = VertexType::eP3N3T3U2Packed;
+			ret.vertices.resize(mesh.vertexCount * sizeof(VertexP3N3T3U2Packed));
+			auto* pVertices = reinterpret_cast<VertexP3N3T3U2Packed*>(ret.vertices.data());
+			for (uint32_t i = 0; i < mesh.vertexCount; i++)
+			{
+				const XMFLOAT2 texcoord = mesh.texcoords.Get<XMFLOAT2>(i);
+				pVertices[i] = VertexP3N3T3U2Packed{
+					packPosition(mesh.positions.Get<XMFLOAT3>(i)),
+					EncodeOctahedral(mesh.normals.Get<XMFLOAT3>(i)),
+					EncodeOctahedral(mesh.tangents.Get<XMFLOAT3>(i)),
+					XMUSHORTN2{
+						QuantizeUnorm16((texcoord.x - texcoordMin.x) * invTexcoordScale.x),
+						QuantizeUnorm16((texcoord.y - texcoordMin.y) * invTexcoordScale.y)
+					}
+				};
+			}
+		}
+		else
+		{
+			ret.type = VertexType::eP3N3Packed;
+			ret.vertices.resize(mesh.vertexCount * sizeof(VertexP3N3Packed));
+			auto* pVertices = reinterpret_cast<VertexP3N3Packed*>(ret.vertices.data());
+			for (uint32_t i = 0; i < mesh.vertexCount; i++)
+			{
+				pVertices[i] = VertexP3N3Packed{
+					packPosition(mesh.positions.Get<XMFLOAT3>(i)),
+					EncodeOctahedral(mesh.normals.Get<XMFLOAT3>(i))
+				};
+			}
+		}
+	}
+
+	// Box of the positions, along with the indices of the points that lie on each of its faces
+	struct PositionBounds
+	{
+		DirectX::BoundingBox box;
+		uint32_t minIndex[3] = {};
+		uint32_t maxIndex[3] = {};
+	};
+
+	// Min/max reduction over the positions. As in the interleaving, each position is read with a
+	// single unaligned 16-byte load whose extra lane is ignored, so the last one is left to the
+	// scalar loop, and meshes with a single position skip the SIMD path entirely.
+	PositionBounds ComputeBoundingBox(const AttributeView& positions, uint32_t count)
+	{
+		using namespace DirectX;
+
+		PositionBounds ret;
+		XMFLOAT3 minimum = positions.Get<XMFLOAT3>(0);
+		XMFLOAT3 maximum = minimum;
+		float* pMinimum = &minimum.x;
+		float* pMaximum = &maximum.x;
+		uint32_t i = 1;
+#if defined(_M_X64) || defined(__SSE2__)
+		if (count >= 2)
+		{
+			auto load = [&](uint32_t index) {
+				return _mm_loadu_ps(reinterpret_cast<const float*>(positions.pData + index * positions.stride));
+			};
+			// Where a lane improves, take the index of the point that improved it
+			auto select = [](__m128 mask, __m128i index, __m128i current) {
+				const __m128i m = _mm_castps_si128(mask);
+				return _mm_or_si128(_mm_and_si128(m, index), _mm_andnot_si128(m, current));
+			};
+			// Two sets of accumulators, so that consecutive min and max operations don't wait on
+			// each other
+			__m128 min0 = load(0);
+			__m128 max0 = min0;
+			__m128 min1 = min0;
+			__m128 max1 = min0;
+			__m128i minIndex0 = _mm_setzero_si128();
+			__m128i maxIndex0 = minIndex0;
+			__m128i minIndex1 = minIndex0;
+			__m128i maxIndex1 = minIndex0;
+			for (; i + 2 < count; i += 2)
+			{
+				const __m128 a = load(i);
+				const __m128 b = load(i + 1);
+				const __m128i indexA = _mm_set1_epi32(static_cast<int>(i));
+				const __m128i indexB = _mm_set1_epi32(static_cast<int>(i + 1));
+				minIndex0 = select(_mm_cmplt_ps(a, min0), indexA, minIndex0);
+				maxIndex0 = select(_mm_cmpgt_ps(a, max0), indexA, maxIndex0);
+				minIndex1 = select(_mm_cmplt_ps(b, min1), indexB, minIndex1);
+				maxIndex1 = select(_mm_cmpgt_ps(b, max1), indexB, maxIndex1);
+				min0 = _mm_min_ps(min0, a);
+				max0 = _mm_max_ps(max0, a);
+				min1 = _mm_min_ps(min1, b);
+				max1 = _mm_max_ps(max1, b);
+			}
+
+			float lanes[4][4];
+			uint32_t indices[4][4];
+			_mm_storeu_ps(lanes[0], min0);
+			_mm_storeu_ps(lanes[1], min1);
+			_mm_storeu_ps(lanes[2], max0);
+			_mm_storeu_ps(lanes[3], max1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(indices[0]), minIndex0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(indices[1]), minIndex1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(indices[2]), maxIndex0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(indices[3]), maxIndex1);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const bool lowerMin = lanes[1][axis] < lanes[0][axis];
+				pMinimum[axis] = lanes[lowerMin ? 1 : 0][axis];
+				ret.minIndex[axis] = indices[lowerMin ? 1 : 0][axis];
+				const bool higherMax = lanes[3][axis] > lanes[2][axis];
+				pMaximum[axis] = lanes[higherMax ? 3 : 2][axis];
+				ret.maxIndex[axis] = indices[higherMax ? 3 : 2][axis];
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			const XMFLOAT3 p = positions.Get<XMFLOAT3>(i);
+			const float* pP = &p.x;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (pP[axis] < pMinimum[axis])
+				{
+					pMinimum[axis] = pP[axis];
+					ret.minIndex[axis] = i;
+				}
+				if (pP[axis] > pMaximum[axis])
+				{
+					pMaximum[axis] = pP[axis];
+					ret.maxIndex[axis] = i;
+				}
+			}
+		}
+
+		ret.box.Center = XMFLOAT3(0.5f * (minimum.x + maximum.x), 0.5f * (minimum.y + maximum.y), 0.5f * (minimum.z + maximum.z));
+		ret.box.Extents = XMFLOAT3(0.5f * (maximum.x - minimum.x), 0.5f * (maximum.y - minimum.y), 0.5f * (maximum.z - minimum.z));
+		return ret;
+	}
+
+	float DistanceSquared(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		const float x = a.x - b.x;
+		const float y = a.y - b.y;
+		const float z = a.z - b.z;
+		return x * x + y * y + z * z;
+	}
+
+	// Bounding sphere of the positions. Ritter's sphere is usually the tighter one, but the sphere
+	// around the box center wins on some shapes, so the smaller of the two is kept. Both come out
+	// of a single pass over the positions.
+	DirectX::BoundingSphere ComputeMeshSphere(const AttributeView& positions, uint32_t count,
+		const PositionBounds& bounds)
+	{
+		using namespace DirectX;
+
+		// Ritter's sphere starts from the pair of axis extremes that lie farthest apart
+		XMFLOAT3 a = positions.Get<XMFLOAT3>(bounds.minIndex[0]);
+		XMFLOAT3 b = positions.Get<XMFLOAT3>(bounds.maxIndex[0]);
+		float diameterSquared = DistanceSquared(a, b);
+		for (int axis = 1; axis < 3; axis++)
+		{
+			const XMFLOAT3 p = positions.Get<XMFLOAT3>(bounds.minIndex[axis]);
+			const XMFLOAT3 q = positions.Get<XMFLOAT3>(bounds.maxIndex[axis]);
+			const float d = DistanceSquared(p, q);
+			if (d > diameterSquared)
+			{
+				a = p;
+				b = q;
+				diameterSquared = d;
+			}
+		}
+
+		const XMFLOAT3& boxCenter = bounds.box.Center;
+		XMFLOAT3 center(0.5f * (a.x + b.x), 0.5f * (a.y + b.y), 0.5f * (a.z + b.z));
+		float radiusSquared = 0.25f * diameterSquared;
+		float radius = std::sqrt(radiusSquared);
+		float boxRadiusSquared = 0.0f;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const XMFLOAT3 p = positions.Get<XMFLOAT3>(i);
+			boxRadiusSquared = std::max(boxRadiusSquared, DistanceSquared(p, boxCenter));
+
+			// Only the points outside the sphere need the actual distance
+			const float distanceSquared = DistanceSquared(p, center);
+			if (distanceSquared > radiusSquared)
+			{
+				const float distance = std::sqrt(distanceSquared);
+				const float newRadius = 0.5f * (radius + distance);
+				const float shift = (newRadius - radius) / distance;
+				center = XMFLOAT3(center.x + (p.x - center.x) * shift, center.y + (p.y - center.y) * shift,
+					center.z + (p.z - center.z) * shift);
+				radius = newRadius;
+				radiusSquared = radius * radius;
+			}
+		}
+
+		const float boxRadius = std::sqrt(boxRadiusSquared);
+		return boxRadius < radius ? BoundingSphere(boxCenter, boxRadius) : BoundingSphere(center, radius);
+	}
+
+	Mesh BuildMesh(SourceMesh& mesh, const ModelLoadOptions& options, IndexOptimizationStats& indexStats,
+		MeshletStats& meshletStats)
+	{
+		using namespace DirectX;
+
+		assert(mesh.positions);
+		assert(mesh.normals);
+
+		Mesh ret;
+		ret.indices = std::move(mesh.indices);
+
+		// Bounds are computed straight from the source positions
+		if (mesh.vertexCount > 0)
+		{
+			const PositionBounds bounds = ComputeBoundingBox(mesh.positions, mesh.vertexCount);
+			ret.bounds = bounds.box;
+			ret.boundingSphere = ComputeMeshSphere(mesh.positions, mesh.vertexCount, bounds);
+		}
+
+		if (options.quantizeVertices)
+		{
+			PackVertices(mesh, ret);
+		}
+		else if (mesh.texcoords)
+		{
+			assert(mesh.tangents);
+			ret.type = VertexType::eP3N3T3U2;
+			ret.vertices.resize(mesh.vertexCount * sizeof(VertexP3N3T3U2));
+			InterleaveStreams(ret.vertices.data(), sizeof(VertexP3N3T3U2), mesh.vertexCount,
+				std::array<VertexStream, 4>{
+					VertexStream{ mesh.positions, offsetof(VertexP3N3T3U2, position), 12 },
+					VertexStream{ mesh.normals, offsetof(VertexP3N3T3U2, normal), 12 },
+					VertexStream{ mesh.tangents, offsetof(VertexP3N3T3U2, tangent), 12 },
+					VertexStream{ mesh.texcoords, offsetof(VertexP3N3T3U2, texcoord), 8 }
+				});
+		}
+		else
+		{
+			ret.type = VertexType::eP3N3;
+			ret.vertices.resize(mesh.vertexCount * sizeof(VertexP3N3));
+			InterleaveStreams(ret.vertices.data(), sizeof(VertexP3N3), mesh.vertexCount,
+				std::array<VertexStream, 2>{
+					VertexStream{ mesh.positions, offsetof(VertexP3N3, position), 12 },
+					VertexStream{ mesh.normals, offsetof(VertexP3N3, normal), 12 }
+				});
+		}
+
+		ret.indexType = SelectIndexType(mesh.vertexCount);
+
+		// Meshlets are built from the final triangle order
+		if (options.optimizeIndices)
+		{
+			indexStats = OptimizeIndices(ret);
+		}
+		// Levels of detail index the vertices in their final order
+		if (options.lodCount > 0)
+		{
+			BuildLods(ret, options.lodCount);
+		}
+		if (options.buildMeshlets)
+		{
+			meshletStats = BuildMeshlets(ret);
+		}
+		return ret;
+	}
+
+	// Vertex cache statistics of the whole model, weighting each mesh by its triangle count for
+	// the ACMR and by its vertex count for the ATVR
+	IndexOptimizationStats CombineIndexOptimizationStats(const std::vector<Mesh>& meshes,
+		const std::vector<IndexOptimizationStats>& stats)
+	{
+		IndexOptimizationStats ret{};
+		double triangleCount = 0.0;
+		double vertexCount = 0.0;
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			double triangles = static_cast<double>(meshes[i].indices.size() / 3);
+			double vertices = static_cast<double>(meshes[i].vertices.size() / GetVertexSize(meshes[i].type));
+			ret.before.acmr += stats[i].before.acmr * triangles;
+			ret.after.acmr += stats[i].after.acmr * triangles;
+			ret.before.atvr += stats[i].before.atvr * vertices;
+			ret.after.atvr += stats[i].after.atvr * vertices;
+			triangleCount += triangles;
+			vertexCount += vertices;
+			ret.optimizeTime += stats[i].optimizeTime;
+		}
+		if (triangleCount > 0.0)
+		{
+			ret.before.acmr /= triangleCount;
+			ret.after.acmr /= triangleCount;
+			ret.before.atvr /= vertexCount;
+			ret.after.atvr /= vertexCount;
+		}
+		return ret;
+	}
+
+	// Meshlet statistics of the whole model, weighting each mesh's averages by its meshlet count
+	MeshletStats CombineMeshletStats(const std::vector<MeshletStats>& stats)
+	{
+		MeshletStats ret{};
+		for (const auto& meshStats : stats)
+		{
+			const double meshlets = static_cast<double>(meshStats.meshletCount);
+			ret.averageVertexReuse += meshStats.averageVertexReuse * meshlets;
+			ret.averageVertexCount += meshStats.averageVertexCount * meshlets;
+			ret.averageTriangleCount += meshStats.averageTriangleCount * meshlets;
+			ret.meshletCount += meshStats.meshletCount;
+			ret.buildTime += meshStats.buildTime;
+		}
+		if (ret.meshletCount > 0)
+		{
+			const double meshletCount = static_cast<double>(ret.meshletCount);
+			ret.averageVertexReuse /= meshletCount;
+			ret.averageVertexCount /= meshletCount;
+			ret.averageTriangleCount /= meshletCount;
+		}
+		return ret;
+	}
+}
+
+void GenerateNormals(SourceMesh& mesh)
+{
+	using namespace DirectX;
+
+	assert(mesh.positions);
+
+	// The unnormalized cross product is already weighted by twice the triangle area. Triangles
+	// are wound clockwise, so the outward normal is (p2 - p0) x (p1 - p0).
+	std::vector<XMFLOAT3> normals(mesh.vertexCount, XMFLOAT3(0.0f, 0.0f, 0.0f));
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const uint32_t i0 = mesh.indices[i], i1 = mesh.indices[i + 1], i2 = mesh.indices[i + 2];
+		const XMFLOAT3 p0 = mesh.positions.Get<XMFLOAT3>(i0);
+		const XMFLOAT3 p1 = mesh.positions.Get<XMFLOAT3>(i1);
+		const XMFLOAT3 p2 = mesh.positions.Get<XMFLOAT3>(i2);
+		const XMFLOAT3 e1(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+		const XMFLOAT3 e2(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+		const XMFLOAT3 normal(e2.y * e1.z - e2.z * e1.y, e2.z * e1.x - e2.x * e1.z, e2.x * e1.y - e2.y * e1.x);
+		for (uint32_t index : { i0, i1, i2 })
+		{
+			normals[index].x += normal.x;
+			normals[index].y += normal.y;
+			normals[index].z += normal.z;
+		}
+	}
+
+	for (XMFLOAT3& n : normals)
+	{
+		const float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+		n = length > 0.0f ? XMFLOAT3(n.x / length, n.y / length, n.z / length) : XMFLOAT3(0.0f, 0.0f, 1.0f);
+	}
+	mesh.normals = mesh.Store(std::move(normals));
+}
+
+void GenerateTangents(SourceMesh& mesh)
+{
+	using namespace DirectX;
+
+	assert(mesh.positions && mesh.normals && mesh.texcoords);
+
+	// Accumulate the texture space u direction of every triangle on its corners
+	std::vector<XMFLOAT3> tangents(mesh.vertexCount, XMFLOAT3(0.0f, 0.0f, 0.0f));
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const uint32_t i0 = mesh.indices[i], i1 = mesh.indices[i + 1], i2 = mesh.indices[i + 2];
+		const XMFLOAT3 p0 = mesh.positions.Get<XMFLOAT3>(i0);
+		const XMFLOAT3 p1 = mesh.positions.Get<XMFLOAT3>(i1);
+		const XMFLOAT3 p2 = mesh.positions.Get<XMFLOAT3>(i2);
+		const XMFLOAT2 t0 = mesh.texcoords.Get<XMFLOAT2>(i0);
+		const XMFLOAT2 t1 = mesh.texcoords.Get<XMFLOAT2>(i1);
+		const XMFLOAT2 t2 = mesh.texcoords.Get<XMFLOAT2>(i2);
+
+		const XMFLOAT3 e1(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+		const XMFLOAT3 e2(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+		const float du1 = t1.x - t0.x, dv1 = t1.y - t0.y;
+		const float du2 = t2.x - t0.x, dv2 = t2.y - t0.y;
+		const float det = du1 * dv2 - du2 * dv1;
+		if (std::abs(det) < FLT_EPSILON)
+		{
+			continue;
+		}
+		// Only the direction matters, so the sign of the determinant is all that's needed to
+		// weight each triangle by its area
+		const float r = det > 0.0f ? 1.0f : -1.0f;
+		const XMFLOAT3 tangent((e1.x * dv2 - e2.x * dv1) * r, (e1.y * dv2 - e2.y * dv1) * r, (e1.z * dv2 - e2.z * dv1) * r);
+		for (uint32_t index : { i0, i1, i2 })
+		{
+			tangents[index].x += tangent.x;
+			tangents[index].y += tangent.y;
+			tangents[index].z += tangent.z;
+		}
+	}
+
+	// Gram-Schmidt against the normal. Vertices without a usable direction get any vector
+	// perpendicular to the normal.
+	for (uint32_t i = 0; i < mesh.vertexCount; i++)
+	{
+		const XMFLOAT3 n = mesh.normals.Get<XMFLOAT3>(i);
+		XMFLOAT3& t = tangents[i];
+		const float d = n.x * t.x + n.y * t.y + n.z * t.z;
+		t = XMFLOAT3(t.x - n.x * d, t.y - n.y * d, t.z - n.z * d);
+		float length = std::sqrt(t.x * t.x + t.y * t.y + t.z * t.z);
+		if (length < 1e-6f)
+		{
+			t = std::abs(n.x) < 0.9f ? XMFLOAT3(0.0f, n.z, -n.y) : XMFLOAT3(-n.z, 0.0f, n.x);
+			length = std::sqrt(t.x * t.x + t.y * t.y + t.z * t.z);
+		}
+		if (length > 0.0f)
+		{
+			t = XMFLOAT3(t.x / length, t.y / length, t.z / length);
+		}
+	}
+	mesh.tangents = mesh.Store(std::move(tangents));
+}
+
+Model BuildModel(SourceModel&& source, const ModelLoadOptions& options, ModelLoadStats* pStats)
+{
+	Model ret;
+	ret.instances = std::move(source.instances);
+
+	// Meshes are independent, so convert them across the worker pool. Each job writes only its
+	// own slot of the output.
+	ret.meshes.resize(source.meshes.size());
+	std::vector<IndexOptimizationStats> indexStats(source.meshes.size());
+	std::vector<MeshletStats> meshletStats(source.meshes.size());
+	ThreadPool::GetDefault().ParallelFor(source.meshes.size(), [&](size_t i) {
+		ret.meshes[i] = BuildMesh(source.meshes[i], options, indexStats[i], meshletStats[i]);
+	});
+
+	if (pStats && options.optimizeIndices)
+	{
+		pStats->indexStats = CombineIndexOptimizationStats(ret.meshes, indexStats);
+	}
+	if (pStats && options.buildMeshlets)
+	{
+		pStats->meshletStats = CombineMeshletStats(meshletStats);
+	}
+	return ret;
+}
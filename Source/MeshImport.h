@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ModelLoading.h"
+
+// Format-independent input to mesh conversion. Each importer describes its meshes as attribute
+// views, which may point straight into the importer's own arrays or into a file mapping, and
+// the shared conversion turns them into Mesh. Whatever the views point into must stay alive
+// until the model is built.
+
+// Strided view of an array of float attributes. Elements must not overlap, since the vertex
+// interleaving reads 16 bytes from the start of every element but the last.
+struct AttributeView
+{
+	const char* pData = nullptr;
+	// Distance in bytes between consecutive elements
+	size_t stride = 0;
+
+	explicit operator bool() const
+	{
+		return pData != nullptr;
+	}
+
+	// Elements are read with memcpy since they aren't necessarily aligned inside a file
+	template<typename T>
+	T Get(size_t i) const
+	{
+		T value;
+		memcpy(&value, pData + i * stride, sizeof(T));
+		return value;
+	}
+};
+
+// One attribute array and where it goes in the interleaved vertex
+struct VertexStream
+{
+	AttributeView src;
+	uint32_t dstOffset;
+	// Number of bytes to copy per vertex, either 8 or 12
+	uint32_t size;
+};
+
+// Interleaves separate attribute arrays into a vertex buffer in place. Streams must be given in
+// increasing order of destination offset. The SSE path is used where it's available unless
+// allowSimd is false, which ModelLoadBench uses to time the plain copy loop on its own.
+// Instantiated for 2 and 4 streams.
+template<size_t N>
+void InterleaveStreams(char* pDst, size_t stride, size_t count, const std::array<VertexStream, N>& streams,
+	bool allowSimd = true);
+
+struct SourceMesh
+{
+	uint32_t vertexCount = 0;
+	// float3 positions, normals and tangents and float2 texcoords. Positions and normals are
+	// required, and tangents are required whenever there are texcoords. Any components past
+	// those (such as the handedness of a glTF tangent) are ignored.
+	AttributeView positions;
+	AttributeView normals;
+	AttributeView tangents;
+	AttributeView texcoords;
+	// Triangle list, wound clockwise
+	std::vector<uint32_t> indices;
+
+	// Keeps alive any attribute arrays the importer had to convert or generate
+	std::vector<std::shared_ptr<const void>> storage;
+
+	// Takes ownership of an attribute array and returns a view of it
+	template<typename T>
+	AttributeView Store(std::vector<T>&& data)
+	{
+		auto pData = std::make_shared<const std::vector<T>>(std::move(data));
+		storage.push_back(pData);
+		return { reinterpret_cast<const char*>(pData->data()), sizeof(T) };
+	}
+};
+
+struct SourceModel
+{
+	std::vector<SourceMesh> meshes;
+	std::vector<MeshInstance> instances;
+	// Other files on disk that the import read, such as external glTF buffers
+	std::vector<std::string> dependencies;
+};
+
+// Computes smooth per-vertex normals, weighting each triangle by its area
+void GenerateNormals(SourceMesh& mesh);
+
+// Computes per-vertex tangents from the texcoords, orthogonal to the normals
+void GenerateTangents(SourceMesh& mesh);
+
+// Converts every mesh in parallel, applying the processing passes selected by options. The
+// index arrays are moved out of the source meshes. If pStats is given, the statistics of the
+// enabled passes are filled in.
+Model BuildModel(SourceModel&& source, const ModelLoadOptions& options, ModelLoadStats* pStats = nullptr);
@@ -0,0 +1,1164 @@
+#include "MeshOptimization.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "Hash.h"
+
+using namespace DirectX;
+
+namespace
+{
+	constexpr uint8_t NOT_IN_MESHLET = 0xFF;
+
+	XMFLOAT3 Subtract(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	float LengthSquared(const XMFLOAT3& a)
+	{
+		return Dot(a, a);
+	}
+
+	// Outward facing normal of a triangle, not normalized. Triangles are wound clockwise
+	// after import (aiProcess_FlipWindingOrder), so the usual cross product is negated.
+	XMFLOAT3 TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2)
+	{
+		return Cross(Subtract(p2, p0), Subtract(p1, p0));
+	}
+
+	// Vertex to triangle adjacency, stored as one flat array with per-vertex offsets
+	struct TriangleAdjacency
+	{
+		TriangleAdjacency(const uint32_t* indices, size_t indexCount, size_t vertexCount) :
+			offsets(vertexCount + 1, 0), triangles(indexCount), liveCounts(vertexCount, 0)
+		{
+			for (size_t i = 0; i < indexCount; i++)
+			{
+				offsets[indices[i] + 1]++;
+			}
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				offsets[i + 1] += offsets[i];
+			}
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++)
+			{
+				triangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+				liveCounts[indices[i]]++;
+			}
+		}
+
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+		// Per vertex, how many of its triangles haven't been consumed yet by the pass using this
+		std::vector<uint32_t> liveCounts;
+	};
+
+	// FIFO post-transform cache. Rather than a queue, every vertex remembers when it was last
+	// inserted; it is still cached if fewer than cacheSize insertions happened since.
+	class FifoCache
+	{
+	public:
+		FifoCache(size_t vertexCount, uint32_t cacheSize) :
+			m_timestamps(vertexCount, 0), m_time(cacheSize + 1), m_cacheSize(cacheSize)
+		{
+		}
+
+		// Returns true if the vertex had to be transformed
+		bool Access(uint32_t vertex)
+		{
+			if (m_time - m_timestamps[vertex] > m_cacheSize)
+			{
+				m_timestamps[vertex] = m_time++;
+				return true;
+			}
+			return false;
+		}
+
+		uint32_t AccessTriangle(const uint32_t* triangle)
+		{
+			return Access(triangle[0]) + Access(triangle[1]) + Access(triangle[2]);
+		}
+
+		void Flush()
+		{
+			m_time += m_cacheSize + 1;
+		}
+
+	private:
+		std::vector<uint64_t> m_timestamps;
+		uint64_t m_time;
+		uint64_t m_cacheSize;
+	};
+
+	// Computes the bounding sphere and normal cone of a finished meshlet
+	void ComputeMeshletBounds(Meshlet& meshlet, const XMFLOAT3* positions,
+		const uint32_t* meshletVertices, const uint8_t* meshletTriangles)
+	{
+		// Gather the triangle corners as global indices, so the sphere helper can be shared
+		uint32_t corners[MESHLET_MAX_TRIANGLES * 3];
+		for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++)
+		{
+			corners[i] = meshletVertices[meshletTriangles[i]];
+		}
+		BoundingSphere sphere = ComputeBoundingSphere(positions, corners, meshlet.triangleCount * 3);
+		meshlet.center = sphere.Center;
+		meshlet.radius = sphere.Radius;
+
+		// The cone axis is the average triangle normal, and its spread is the largest angle
+		// between the axis and any normal
+		XMFLOAT3 normals[MESHLET_MAX_TRIANGLES];
+		uint32_t normalCount = 0;
+		XMFLOAT3 axis(0.0f, 0.0f, 0.0f);
+		for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+		{
+			XMFLOAT3 n = TriangleNormal(positions[corners[3 * i]], positions[corners[3 * i + 1]],
+				positions[corners[3 * i + 2]]);
+			float length = std::sqrt(LengthSquared(n));
+			// Degenerate triangles are never rasterized, so they don't constrain the cone
+			if (length > 0.0f)
+			{
+				n = XMFLOAT3(n.x / length, n.y / length, n.z / length);
+				normals[normalCount++] = n;
+				axis = XMFLOAT3(axis.x + n.x, axis.y + n.y, axis.z + n.z);
+			}
+		}
+
+		float axisLength = std::sqrt(LengthSquared(axis));
+		if (normalCount == 0 || axisLength == 0.0f)
+		{
+			// A cutoff of 1 makes the cone test always fail, so the meshlet is never cone culled
+			meshlet.coneAxis = XMFLOAT3(0.0f, 0.0f, 1.0f);
+			meshlet.coneCutoff = 1.0f;
+			return;
+		}
+		axis = XMFLOAT3(axis.x / axisLength, axis.y / axisLength, axis.z / axisLength);
+
+		float minDot = 1.0f;
+		for (uint32_t i = 0; i < normalCount; i++)
+		{
+			minDot = std::min(minDot, Dot(axis, normals[i]));
+		}
+
+		meshlet.coneAxis = axis;
+		// Normals spread over a hemisphere or more can't all face away from a viewer
+		meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+	}
+
+	// Sum of squared distances to a set of weighted planes, as the symmetric matrix A, vector b
+	// and constant c of x^T A x + 2 b^T x + c
+	struct Quadric
+	{
+		float a00, a11, a22;
+		float a10, a20, a21;
+		float b0, b1, b2;
+		float c;
+		float weight;
+	};
+
+	// Quadric of the plane through p with unit normal n
+	Quadric PlaneQuadric(const XMFLOAT3& p, const XMFLOAT3& n, float weight)
+	{
+		float d = -Dot(n, p);
+		return Quadric{
+			weight * n.x * n.x, weight * n.y * n.y, weight * n.z * n.z,
+			weight * n.y * n.x, weight * n.z * n.x, weight * n.z * n.y,
+			weight * d * n.x, weight * d * n.y, weight * d * n.z,
+			weight * d * d,
+			weight
+		};
+	}
+
+	void AddQuadric(Quadric& q, const Quadric& other)
+	{
+		q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+		q.a10 += other.a10; q.a20 += other.a20; q.a21 += other.a21;
+		q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+		q.c += other.c;
+		q.weight += other.weight;
+	}
+
+	// Weighted sum of squared distances from p to the planes, not normalized
+	float EvaluateQuadric(const Quadric& q, const XMFLOAT3& p)
+	{
+		float rx = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z;
+		float ry = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z;
+		float rz = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z;
+		float r = rx * p.x + ry * p.y + rz * p.z + 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+		return std::max(r, 0.0f);
+	}
+
+	// Extra weight of the planes that keep borders in place, relative to triangle planes
+	constexpr float BORDER_WEIGHT = 10.0f;
+
+	enum class SimplifyVertexKind : uint8_t
+	{
+		// Interior vertex with a single set of attributes, can collapse onto any neighbor
+		eManifold,
+		// On an open border, can only collapse along it
+		eBorder,
+		// On an attribute seam, a border corner or a non-manifold edge, never moves
+		eLocked
+	};
+
+	// Edge collapse simplifier working on a welded view of the mesh: vertices with the same
+	// position share one quadric and one kind, so seams are seen as connected surface
+	class Simplifier
+	{
+	public:
+		Simplifier(const std::vector<XMFLOAT3>& positions, const std::vector<uint32_t>& indices) :
+			m_positions(positions), m_indices(indices), m_remap(positions.size()),
+			m_quadrics(positions.size(), Quadric{}), m_error(0.0f)
+		{
+			m_indices.resize(indices.size() - indices.size() % 3);
+			WeldPositions();
+			UpdateTopology();
+			ComputeQuadrics();
+		}
+
+		// Collapses edges until at most targetTriangleCount triangles remain or no collapse is
+		// possible. Returns false in the latter case.
+		bool Simplify(size_t targetTriangleCount);
+
+		const std::vector<uint32_t>& GetIndices() const { return m_indices; }
+		// Largest distance to the original surface introduced so far
+		float GetError() const { return std::sqrt(m_error); }
+
+	private:
+		struct Collapse
+		{
+			uint32_t from;
+			uint32_t to;
+			float cost;
+		};
+
+		void WeldPositions();
+		TriangleAdjacency UpdateTopology();
+		void ComputeQuadrics();
+		bool CanCollapse(uint32_t from, uint32_t to) const;
+		float CollapseCost(uint32_t from, uint32_t to) const;
+		bool HasTriangleFlips(uint32_t from, uint32_t to, const TriangleAdjacency& adjacency) const;
+
+		const std::vector<XMFLOAT3>& m_positions;
+		std::vector<uint32_t> m_indices;
+		// First vertex with the same position as each vertex, and m_indices mapped through it
+		std::vector<uint32_t> m_remap;
+		std::vector<uint32_t> m_welded;
+		std::vector<uint32_t> m_wedgeCounts;
+		std::vector<SimplifyVertexKind> m_kinds;
+		// Neighbors along the border, for border vertices
+		std::vector<uint32_t> m_borderNext;
+		std::vector<uint32_t> m_borderPrev;
+		std::vector<Quadric> m_quadrics;
+		// Largest squared error of any collapse so far
+		float m_error;
+	};
+
+	void Simplifier::WeldPositions()
+	{
+		const size_t vertexCount = m_positions.size();
+		std::unordered_map<uint64_t, uint32_t> firstByPosition;
+		firstByPosition.reserve(vertexCount);
+		m_wedgeCounts.assign(vertexCount, 0);
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			// Positions are compared bit for bit; a hash collision just leaves the vertex unwelded
+			const XMFLOAT3& p = m_positions[i];
+			auto result = firstByPosition.emplace(Hash64(&p, sizeof(p)), i);
+			uint32_t first = result.first->second;
+			m_remap[i] = memcmp(&m_positions[first], &p, sizeof(p)) == 0 ? first : i;
+			m_wedgeCounts[m_remap[i]]++;
+		}
+	}
+
+	// Rebuilds the welded triangles and their adjacency, and classifies the welded vertices
+	TriangleAdjacency Simplifier::UpdateTopology()
+	{
+		const size_t vertexCount = m_positions.size();
+		m_welded.resize(m_indices.size());
+		for (size_t i = 0; i < m_indices.size(); i++)
+		{
+			m_welded[i] = m_remap[m_indices[i]];
+		}
+		TriangleAdjacency adjacency(m_welded.data(), m_welded.size(), vertexCount);
+
+		m_kinds.assign(vertexCount, SimplifyVertexKind::eManifold);
+		m_borderNext.assign(vertexCount, UINT32_MAX);
+		m_borderPrev.assign(vertexCount, UINT32_MAX);
+		std::vector<uint8_t> borderEdgeCounts(vertexCount, 0);
+
+		// Every triangle using directed edge a -> b also uses a, so both the edge and its
+		// opposite can be counted from the triangles around a. The edge is on a border if its
+		// opposite doesn't exist, and non-manifold if either appears more than once.
+		for (size_t i = 0; i < m_welded.size(); i += 3)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t a = m_welded[i + k];
+				uint32_t b = m_welded[i + (k + 1) % 3];
+				uint32_t sameCount = 0;
+				uint32_t oppositeCount = 0;
+				for (uint32_t j = adjacency.offsets[a]; j < adjacency.offsets[a + 1]; j++)
+				{
+					const uint32_t* triangle = &m_welded[3 * adjacency.triangles[j]];
+					for (uint32_t e = 0; e < 3; e++)
+					{
+						sameCount += triangle[e] == a && triangle[(e + 1) % 3] == b;
+						oppositeCount += triangle[e] == b && triangle[(e + 1) % 3] == a;
+					}
+				}
+				if (sameCount > 1 || oppositeCount > 1)
+				{
+					m_kinds[a] = SimplifyVertexKind::eLocked;
+					m_kinds[b] = SimplifyVertexKind::eLocked;
+				}
+				else if (oppositeCount == 0)
+				{
+					m_borderNext[a] = b;
+					m_borderPrev[b] = a;
+					borderEdgeCounts[a] = static_cast<uint8_t>(std::min(borderEdgeCounts[a] + 1, 255));
+					borderEdgeCounts[b] = static_cast<uint8_t>(std::min(borderEdgeCounts[b] + 1, 255));
+				}
+			}
+		}
+
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			if (m_remap[i] != i || m_kinds[i] == SimplifyVertexKind::eLocked)
+			{
+				continue;
+			}
+			if (m_wedgeCounts[i] > 1)
+			{
+				m_kinds[i] = SimplifyVertexKind::eLocked;
+			}
+			else if (borderEdgeCounts[i] > 0)
+			{
+				// A simple border vertex has exactly one border edge in and one out
+				m_kinds[i] = borderEdgeCounts[i] == 2 ? SimplifyVertexKind::eBorder : SimplifyVertexKind::eLocked;
+			}
+		}
+		return adjacency;
+	}
+
+	void Simplifier::ComputeQuadrics()
+	{
+		for (size_t i = 0; i < m_indices.size(); i += 3)
+		{
+			uint32_t v0 = m_remap[m_indices[i]];
+			uint32_t v1 = m_remap[m_indices[i + 1]];
+			uint32_t v2 = m_remap[m_indices[i + 2]];
+			const XMFLOAT3& p0 = m_positions[v0];
+			const XMFLOAT3& p1 = m_positions[v1];
+			const XMFLOAT3& p2 = m_positions[v2];
+			XMFLOAT3 normal = TriangleNormal(p0, p1, p2);
+			float length = std::sqrt(LengthSquared(normal));
+			if (length == 0.0f)
+			{
+				continue;
+			}
+			// Weighted by area, so that many small triangles don't outweigh a large one
+			Quadric q = PlaneQuadric(p0, XMFLOAT3(normal.x / length, normal.y / length, normal.z / length),
+				length * 0.5f);
+			AddQuadric(m_quadrics[v0], q);
+			AddQuadric(m_quadrics[v1], q);
+			AddQuadric(m_quadrics[v2], q);
+
+			// Border edges also get a plane perpendicular to the triangle, which penalizes moving
+			// the border sideways
+			const uint32_t corners[] = { v0, v1, v2 };
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t a = corners[k];
+				uint32_t b = corners[(k + 1) % 3];
+				if (m_borderNext[a] != b)
+				{
+					continue;
+				}
+				XMFLOAT3 edge = Subtract(m_positions[b], m_positions[a]);
+				XMFLOAT3 edgeNormal = Cross(edge, normal);
+				float edgeNormalLength = std::sqrt(LengthSquared(edgeNormal));
+				if (edgeNormalLength == 0.0f)
+				{
+					continue;
+				}
+				edgeNormal = XMFLOAT3(edgeNormal.x / edgeNormalLength, edgeNormal.y / edgeNormalLength,
+					edgeNormal.z / edgeNormalLength);
+				Quadric borderQuadric = PlaneQuadric(m_positions[a], edgeNormal,
+					BORDER_WEIGHT * LengthSquared(edge));
+				AddQuadric(m_quadrics[a], borderQuadric);
+				AddQuadric(m_quadrics[b], borderQuadric);
+			}
+		}
+	}
+
+	// Takes welded vertices
+	bool Simplifier::CanCollapse(uint32_t from, uint32_t to) const
+	{
+		switch (m_kinds[from])
+		{
+		case SimplifyVertexKind::eManifold:
+			return true;
+		case SimplifyVertexKind::eBorder:
+			return m_borderNext[from] == to || m_borderPrev[from] == to;
+		default:
+			return false;
+		}
+	}
+
+	// Squared distance error of moving from onto to, normalized by the total plane weight
+	float Simplifier::CollapseCost(uint32_t from, uint32_t to) const
+	{
+		const Quadric& qFrom = m_quadrics[from];
+		const Quadric& qTo = m_quadrics[to];
+		float weight = qFrom.weight + qTo.weight;
+		float error = EvaluateQuadric(qFrom, m_positions[to]) + EvaluateQuadric(qTo, m_positions[to]);
+		return weight > 0.0f ? error / weight : error;
+	}
+
+	// Whether moving from onto to would turn any remaining triangle around, or squash it into a
+	// sliver. Takes welded vertices.
+	bool Simplifier::HasTriangleFlips(uint32_t from, uint32_t to, const TriangleAdjacency& adjacency) const
+	{
+		for (uint32_t i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++)
+		{
+			const uint32_t* triangle = &m_welded[3 * adjacency.triangles[i]];
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			{
+				// Becomes degenerate and is removed
+				continue;
+			}
+			XMFLOAT3 p[3];
+			XMFLOAT3 moved[3];
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				p[k] = m_positions[triangle[k]];
+				moved[k] = triangle[k] == from ? m_positions[to] : p[k];
+			}
+			XMFLOAT3 before = TriangleNormal(p[0], p[1], p[2]);
+			XMFLOAT3 after = TriangleNormal(moved[0], moved[1], moved[2]);
+			if (Dot(before, after) <= 0.25f * std::sqrt(LengthSquared(before) * LengthSquared(after)))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool Simplifier::Simplify(size_t targetTriangleCount)
+	{
+		const size_t vertexCount = m_positions.size();
+		std::vector<Collapse> collapses;
+		std::vector<uint32_t> collapseTargets(vertexCount);
+		std::vector<bool> touched(vertexCount);
+
+		while (m_indices.size() / 3 > targetTriangleCount)
+		{
+			const TriangleAdjacency adjacency = UpdateTopology();
+
+			// Every triangle edge is a candidate, in whichever direction is cheaper
+			collapses.clear();
+			for (size_t i = 0; i < m_indices.size(); i += 3)
+			{
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					uint32_t a = m_indices[i + k];
+					uint32_t b = m_indices[i + (k + 1) % 3];
+					uint32_t weldedA = m_welded[i + k];
+					uint32_t weldedB = m_welded[i + (k + 1) % 3];
+					if (weldedA == weldedB)
+					{
+						continue;
+					}
+					bool canAB = CanCollapse(weldedA, weldedB);
+					bool canBA = CanCollapse(weldedB, weldedA);
+					float costAB = canAB ? CollapseCost(weldedA, weldedB) : FLT_MAX;
+					float costBA = canBA ? CollapseCost(weldedB, weldedA) : FLT_MAX;
+					if (canAB && costAB <= costBA)
+					{
+						collapses.push_back(Collapse{ a, b, costAB });
+					}
+					else if (canBA)
+					{
+						collapses.push_back(Collapse{ b, a, costBA });
+					}
+				}
+			}
+
+			if (collapses.empty())
+			{
+				return false;
+			}
+
+			// Apply the cheapest collapses. Each usually removes two triangles, so aim for half the
+			// remaining difference per pass. The whole neighborhood of a collapsed vertex is
+			// frozen for the rest of the pass, so that flip checks see the final positions.
+			// Collapses far more expensive than the goal'th cheapest one are left for later
+			// passes, when cheaper ones may have opened up again. Most edges are listed twice.
+			const size_t triangleCount = m_indices.size() / 3;
+			const size_t goal = std::max<size_t>((triangleCount - targetTriangleCount) / 2, 1);
+			auto byCost = [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; };
+			auto goalCollapse = collapses.begin() + std::min(2 * goal, collapses.size() - 1);
+			std::nth_element(collapses.begin(), goalCollapse, collapses.end(), byCost);
+			const float costLimit = 3.0f * goalCollapse->cost;
+
+			// Collapses under the limit are tried first, so only those need sorting up front
+			auto usable = std::partition(collapses.begin(), collapses.end(), [&](const Collapse& collapse) {
+				return collapse.cost <= costLimit;
+			});
+			std::sort(collapses.begin(), usable, byCost);
+			std::fill(collapseTargets.begin(), collapseTargets.end(), UINT32_MAX);
+			std::fill(touched.begin(), touched.end(), false);
+			size_t collapseCount = 0;
+			auto applyCollapses = [&](std::vector<Collapse>::iterator first, std::vector<Collapse>::iterator last) {
+				for (auto it = first; it != last && collapseCount < goal; ++it)
+				{
+					uint32_t from = m_remap[it->from];
+					uint32_t to = m_remap[it->to];
+					if (touched[from] || touched[to] || HasTriangleFlips(from, to, adjacency))
+					{
+						continue;
+					}
+					for (uint32_t i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++)
+					{
+						const uint32_t* triangle = &m_welded[3 * adjacency.triangles[i]];
+						touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+					}
+					touched[to] = true;
+
+					// Movable vertices have a single wedge, so it->from is the only vertex to remap
+					assert(m_wedgeCounts[from] == 1 && it->from == from);
+					collapseTargets[from] = it->to;
+					AddQuadric(m_quadrics[to], m_quadrics[from]);
+					m_error = std::max(m_error, it->cost);
+					collapseCount++;
+				}
+			};
+			applyCollapses(collapses.begin(), usable);
+			// If every collapse under the limit was blocked, the pass still has to make progress
+			if (collapseCount == 0)
+			{
+				std::sort(usable, collapses.end(), byCost);
+				applyCollapses(usable, collapses.end());
+			}
+			if (collapseCount == 0)
+			{
+				return false;
+			}
+
+			// Rewrite the triangles and drop the ones that became degenerate
+			size_t writeIdx = 0;
+			for (size_t i = 0; i < m_indices.size(); i += 3)
+			{
+				uint32_t triangle[3];
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					uint32_t index = m_indices[i + k];
+					triangle[k] = collapseTargets[index] != UINT32_MAX ? collapseTargets[index] : index;
+				}
+				uint32_t w0 = m_remap[triangle[0]];
+				uint32_t w1 = m_remap[triangle[1]];
+				uint32_t w2 = m_remap[triangle[2]];
+				if (w0 != w1 && w1 != w2 && w0 != w2)
+				{
+					memcpy(&m_indices[writeIdx], triangle, sizeof(triangle));
+					writeIdx += 3;
+				}
+			}
+			m_indices.resize(writeIdx);
+		}
+		return true;
+	}
+}
+
+std::vector<XMFLOAT3> GetVertexPositions(const Mesh& mesh)
+{
+	const size_t stride = GetVertexSize(mesh.type);
+	assert(stride > 0);
+	const size_t vertexCount = mesh.vertices.size() / stride;
+	std::vector<XMFLOAT3> ret(vertexCount);
+
+	// Every vertex format starts with its position
+	const char* pSrc = mesh.vertices.data();
+	if (mesh.type == VertexType::eP3N3Packed || mesh.type == VertexType::eP3N3T3U2Packed)
+	{
+		const VertexQuantization& q = mesh.quantization;
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			PackedVector::XMUSHORTN4 p;
+			memcpy(&p, pSrc + i * stride, sizeof(p));
+			ret[i] = XMFLOAT3(q.positionOffset.x + q.positionScale.x * (p.x / 65535.0f),
+				q.positionOffset.y + q.positionScale.y * (p.y / 65535.0f),
+				q.positionOffset.z + q.positionScale.z * (p.z / 65535.0f));
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			memcpy(&ret[i], pSrc + i * stride, sizeof(XMFLOAT3));
+		}
+	}
+	return ret;
+}
+
+BoundingSphere ComputeBoundingSphere(const XMFLOAT3* positions, const uint32_t* indices, size_t indexCount)
+{
+	if (indexCount == 0)
+	{
+		return BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.0f);
+	}
+
+	// Start from two far apart points: the farthest from an arbitrary point, then the
+	// farthest from that
+	auto farthestFrom = [&](const XMFLOAT3& p) {
+		uint32_t best = indices[0];
+		float bestDistance = -1.0f;
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			float distance = LengthSquared(Subtract(positions[indices[i]], p));
+			if (distance > bestDistance)
+			{
+				bestDistance = distance;
+				best = indices[i];
+			}
+		}
+		return best;
+	};
+	const XMFLOAT3& a = positions[farthestFrom(positions[indices[0]])];
+	const XMFLOAT3& b = positions[farthestFrom(a)];
+
+	XMFLOAT3 center((a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f, (a.z + b.z) * 0.5f);
+	float radius = std::sqrt(LengthSquared(Subtract(b, a))) * 0.5f;
+
+	// Grow the sphere to include any point left outside it
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		const XMFLOAT3& p = positions[indices[i]];
+		XMFLOAT3 offset = Subtract(p, center);
+		float distance = std::sqrt(LengthSquared(offset));
+		if (distance > radius)
+		{
+			float newRadius = (radius + distance) * 0.5f;
+			float shift = (newRadius - radius) / distance;
+			center = XMFLOAT3(center.x + offset.x * shift, center.y + offset.y * shift, center.z + offset.z * shift);
+			radius = newRadius;
+		}
+	}
+	return BoundingSphere(center, radius);
+}
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize)
+{
+	indexCount -= indexCount % 3;
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t transformedCount = 0;
+	size_t referencedCount = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		transformedCount += cache.Access(indices[i]);
+		if (!referenced[indices[i]])
+		{
+			referenced[indices[i]] = true;
+			referencedCount++;
+		}
+	}
+
+	VertexCacheStats stats{};
+	if (indexCount > 0)
+	{
+		stats.acmr = static_cast<double>(transformedCount) / (indexCount / 3);
+		stats.atvr = static_cast<double>(transformedCount) / referencedCount;
+	}
+	return stats;
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	indexCount -= indexCount % 3;
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	TriangleAdjacency adjacency(indices, indexCount, vertexCount);
+	std::vector<uint32_t>& liveCounts = adjacency.liveCounts;
+	std::vector<uint64_t> timestamps(vertexCount, 0);
+	uint64_t time = cacheSize + 1;
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+	// Recently used vertices, to continue from when a fan runs out of candidates
+	std::vector<uint32_t> deadEnds;
+	deadEnds.reserve(indexCount);
+	std::vector<uint32_t> candidates;
+	size_t cursor = 0;
+
+	// Emit every remaining triangle around the fanning vertex, then move on to one of the
+	// vertices just touched
+	int64_t fan = indices[0];
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (uint32_t i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; i++)
+		{
+			uint32_t triangle = adjacency.triangles[i];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t vertex = indices[3 * triangle + k];
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveCounts[vertex]--;
+				if (time - timestamps[vertex] > cacheSize)
+				{
+					timestamps[vertex] = time++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// Prefer the oldest candidate that will still be cached once its own fan is emitted
+		// (each triangle adds at most two vertices); other live candidates come after those
+		fan = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (liveCounts[vertex] == 0)
+			{
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - timestamps[vertex] + 2 * liveCounts[vertex] <= cacheSize)
+			{
+				priority = static_cast<int64_t>(time - timestamps[vertex]);
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fan = vertex;
+			}
+		}
+
+		// Dead end: back up through recently used vertices, then scan for any live vertex
+		while (fan < 0 && !deadEnds.empty())
+		{
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveCounts[vertex] > 0)
+			{
+				fan = vertex;
+			}
+		}
+		while (fan < 0 && cursor < vertexCount)
+		{
+			if (liveCounts[cursor] > 0)
+			{
+				fan = static_cast<int64_t>(cursor);
+			}
+			cursor++;
+		}
+	}
+
+	assert(output.size() == indexCount);
+	memcpy(indices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const XMFLOAT3* positions, size_t vertexCount,
+	float threshold, uint32_t cacheSize)
+{
+	indexCount -= indexCount % 3;
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Hard boundaries are where the cache-optimized order restarts, ie. where a triangle
+	// misses on all three vertices. Moving those clusters around costs nothing.
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<size_t> hardBoundaries;
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		if (cache.AccessTriangle(indices + 3 * i) == 3 || i == 0)
+		{
+			hardBoundaries.push_back(i);
+		}
+	}
+	hardBoundaries.push_back(triangleCount);
+
+	// Soft boundaries split hard clusters further wherever the ACMR of the part split off
+	// is already within the threshold of the ACMR of the whole cluster
+	std::vector<size_t> clusters;
+	for (size_t c = 0; c + 1 < hardBoundaries.size(); c++)
+	{
+		const size_t start = hardBoundaries[c];
+		const size_t end = hardBoundaries[c + 1];
+
+		cache.Flush();
+		uint32_t clusterMisses = 0;
+		for (size_t i = start; i < end; i++)
+		{
+			clusterMisses += cache.AccessTriangle(indices + 3 * i);
+		}
+		const float clusterThreshold = threshold * clusterMisses / (end - start);
+
+		cache.Flush();
+		clusters.push_back(start);
+		size_t splitStart = start;
+		uint32_t misses = 0;
+		for (size_t i = start; i + 1 < end; i++)
+		{
+			misses += cache.AccessTriangle(indices + 3 * i);
+			if (misses <= clusterThreshold * (i + 1 - splitStart))
+			{
+				clusters.push_back(i + 1);
+				splitStart = i + 1;
+				misses = 0;
+				cache.Flush();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+	const size_t clusterCount = clusters.size() - 1;
+
+	// Sort clusters so the ones facing away from the mesh center are drawn first (Sander et
+	// al. 2007): those are the ones most likely to occlude the rest
+	XMFLOAT3 meshCenter(0.0f, 0.0f, 0.0f);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		const XMFLOAT3& p = positions[indices[i]];
+		meshCenter = XMFLOAT3(meshCenter.x + p.x, meshCenter.y + p.y, meshCenter.z + p.z);
+	}
+	meshCenter = XMFLOAT3(meshCenter.x / indexCount, meshCenter.y / indexCount, meshCenter.z / indexCount);
+
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		// Summing unnormalized normals weights each triangle by its area
+		XMFLOAT3 center(0.0f, 0.0f, 0.0f);
+		XMFLOAT3 normal(0.0f, 0.0f, 0.0f);
+		for (size_t i = clusters[c]; i < clusters[c + 1]; i++)
+		{
+			const XMFLOAT3& p0 = positions[indices[3 * i]];
+			const XMFLOAT3& p1 = positions[indices[3 * i + 1]];
+			const XMFLOAT3& p2 = positions[indices[3 * i + 2]];
+			center = XMFLOAT3(center.x + p0.x + p1.x + p2.x, center.y + p0.y + p1.y + p2.y,
+				center.z + p0.z + p1.z + p2.z);
+			XMFLOAT3 n = TriangleNormal(p0, p1, p2);
+			normal = XMFLOAT3(normal.x + n.x, normal.y + n.y, normal.z + n.z);
+		}
+		float cornerCount = 3.0f * (clusters[c + 1] - clusters[c]);
+		center = XMFLOAT3(center.x / cornerCount, center.y / cornerCount, center.z / cornerCount);
+		float normalLength = std::sqrt(LengthSquared(normal));
+		sortKeys[c] = normalLength > 0.0f ? Dot(Subtract(center, meshCenter), normal) / normalLength : 0.0f;
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		order[c] = static_cast<uint32_t>(c);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+	for (uint32_t c : order)
+	{
+		output.insert(output.end(), indices + 3 * clusters[c], indices + 3 * clusters[c + 1]);
+	}
+	memcpy(indices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+void OptimizeVertexFetch(Mesh& mesh)
+{
+	const size_t stride = GetVertexSize(mesh.type);
+	assert(stride > 0);
+	const size_t vertexCount = mesh.vertices.size() / stride;
+
+	// Number vertices in the order the index buffer first uses them
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	uint32_t nextVertex = 0;
+	for (uint32_t& index : mesh.indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = nextVertex++;
+		}
+		index = remap[index];
+	}
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		if (remap[i] == UINT32_MAX)
+		{
+			remap[i] = nextVertex++;
+		}
+	}
+
+	std::vector<char> vertices(mesh.vertices.size());
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		memcpy(vertices.data() + remap[i] * stride, mesh.vertices.data() + i * stride, stride);
+	}
+	mesh.vertices.swap(vertices);
+
+	for (uint32_t& vertex : mesh.meshletVertices)
+	{
+		vertex = remap[vertex];
+	}
+}
+
+IndexOptimizationStats OptimizeIndices(Mesh& mesh)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	const std::vector<XMFLOAT3> positions = GetVertexPositions(mesh);
+	uint32_t* indices = mesh.indices.data();
+	const size_t indexCount = mesh.indices.size();
+
+	IndexOptimizationStats stats{};
+	stats.before = AnalyzeVertexCache(indices, indexCount, positions.size());
+	OptimizeVertexCache(indices, indexCount, positions.size());
+	OptimizeOverdraw(indices, indexCount, positions.data(), positions.size());
+	// Renumbering vertices doesn't change which corners hit the cache, so stats are taken here
+	stats.after = AnalyzeVertexCache(indices, indexCount, positions.size());
+	OptimizeVertexFetch(mesh);
+
+	stats.optimizeTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	return stats;
+}
+
+void BuildLods(Mesh& mesh, uint32_t lodCount, float ratio)
+{
+	mesh.lods.clear();
+	mesh.lodIndices.clear();
+
+	const std::vector<XMFLOAT3> positions = GetVertexPositions(mesh);
+
+	// All levels come from one simplifier, so quadrics and errors accumulate relative to the
+	// original surface rather than to the previous level
+	Simplifier simplifier(positions, mesh.indices);
+	size_t previousTriangleCount = mesh.indices.size() / 3;
+	for (uint32_t i = 0; i < lodCount; i++)
+	{
+		const size_t target = static_cast<size_t>(previousTriangleCount * ratio);
+		bool reachedTarget = simplifier.Simplify(target);
+		const std::vector<uint32_t>& indices = simplifier.GetIndices();
+
+		// Keep a level that stalled early only if it still saves a meaningful amount
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0 || 10 * triangleCount > 9 * previousTriangleCount)
+		{
+			break;
+		}
+
+		MeshLod lod{};
+		lod.indexOffset = static_cast<uint32_t>(mesh.lodIndices.size());
+		lod.indexCount = static_cast<uint32_t>(indices.size());
+		lod.error = simplifier.GetError();
+		mesh.lodIndices.insert(mesh.lodIndices.end(), indices.begin(), indices.end());
+		OptimizeVertexCache(mesh.lodIndices.data() + lod.indexOffset, lod.indexCount, positions.size());
+		mesh.lods.push_back(lod);
+
+		previousTriangleCount = triangleCount;
+		if (!reachedTarget)
+		{
+			break;
+		}
+	}
+}
+
+MeshletStats BuildMeshlets(Mesh& mesh)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	const std::vector<XMFLOAT3> positions = GetVertexPositions(mesh);
+	const uint32_t* indices = mesh.indices.data();
+	const size_t indexCount = mesh.indices.size() - mesh.indices.size() % 3;
+	const size_t triangleCount = indexCount / 3;
+	const size_t vertexCount = positions.size();
+
+	TriangleAdjacency adjacency(indices, indexCount, vertexCount);
+	std::vector<uint32_t>& liveTriangleCounts = adjacency.liveCounts;
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint8_t> localIndices(vertexCount, NOT_IN_MESHLET);
+
+	mesh.meshlets.clear();
+	mesh.meshletVertices.clear();
+	mesh.meshletTriangles.clear();
+	mesh.meshletVertices.reserve(vertexCount + vertexCount / 4);
+	mesh.meshletTriangles.reserve(indexCount);
+
+	Meshlet current{};
+	XMFLOAT3 centroidSum(0.0f, 0.0f, 0.0f);
+
+	auto newVertexCount = [&](uint32_t triangle) {
+		uint32_t count = 0;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			count += localIndices[indices[3 * triangle + k]] == NOT_IN_MESHLET;
+		}
+		return count;
+	};
+
+	auto flushMeshlet = [&]() {
+		if (current.triangleCount == 0)
+		{
+			return;
+		}
+		ComputeMeshletBounds(current, positions.data(), mesh.meshletVertices.data() + current.vertexOffset,
+			mesh.meshletTriangles.data() + 3 * current.triangleOffset);
+		for (uint32_t i = 0; i < current.vertexCount; i++)
+		{
+			localIndices[mesh.meshletVertices[current.vertexOffset + i]] = NOT_IN_MESHLET;
+		}
+		mesh.meshlets.push_back(current);
+
+		current = Meshlet{};
+		current.vertexOffset = static_cast<uint32_t>(mesh.meshletVertices.size());
+		current.triangleOffset = static_cast<uint32_t>(mesh.meshletTriangles.size() / 3);
+		centroidSum = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	};
+
+	// Greedily grow each meshlet by the neighboring triangle that adds the fewest new vertices,
+	// breaking ties by distance to the meshlet centroid to keep the bounds tight
+	uint32_t lastTriangle = UINT32_MAX;
+	size_t seedCursor = 0;
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		uint32_t best = UINT32_MAX;
+		uint32_t bestNew = UINT32_MAX;
+		float bestDistance = 0.0f;
+		auto consider = [&](uint32_t triangle) {
+			if (emitted[triangle])
+			{
+				return;
+			}
+			uint32_t added = newVertexCount(triangle);
+			if (added > bestNew)
+			{
+				return;
+			}
+			const XMFLOAT3& p0 = positions[indices[3 * triangle]];
+			const XMFLOAT3& p1 = positions[indices[3 * triangle + 1]];
+			const XMFLOAT3& p2 = positions[indices[3 * triangle + 2]];
+			float scale = 1.0f / std::max(current.vertexCount, 1u);
+			XMFLOAT3 centroid(centroidSum.x * scale, centroidSum.y * scale, centroidSum.z * scale);
+			XMFLOAT3 triangleCenter((p0.x + p1.x + p2.x) / 3.0f, (p0.y + p1.y + p2.y) / 3.0f,
+				(p0.z + p1.z + p2.z) / 3.0f);
+			float distance = LengthSquared(Subtract(triangleCenter, centroid));
+			if (added < bestNew || distance < bestDistance)
+			{
+				best = triangle;
+				bestNew = added;
+				bestDistance = distance;
+			}
+		};
+		auto considerNeighbors = [&](uint32_t vertex) {
+			if (liveTriangleCounts[vertex] == 0)
+			{
+				return;
+			}
+			for (uint32_t i = adjacency.offsets[vertex]; i < adjacency.offsets[vertex + 1]; i++)
+			{
+				consider(adjacency.triangles[i]);
+			}
+		};
+
+		// Neighbors of the last triangle first, then of the whole meshlet
+		if (lastTriangle != UINT32_MAX)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				considerNeighbors(indices[3 * lastTriangle + k]);
+			}
+		}
+		if (best == UINT32_MAX)
+		{
+			for (uint32_t i = 0; i < current.vertexCount; i++)
+			{
+				considerNeighbors(mesh.meshletVertices[current.vertexOffset + i]);
+			}
+		}
+		// Otherwise continue from the next unused triangle in index order
+		if (best == UINT32_MAX)
+		{
+			while (emitted[seedCursor])
+			{
+				seedCursor++;
+			}
+			best = static_cast<uint32_t>(seedCursor);
+			bestNew = newVertexCount(best);
+		}
+
+		if (current.vertexCount + bestNew > MESHLET_MAX_VERTICES || current.triangleCount + 1 > MESHLET_MAX_TRIANGLES)
+		{
+			flushMeshlet();
+		}
+
+		// Append the triangle to the current meshlet
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t vertex = indices[3 * best + k];
+			if (localIndices[vertex] == NOT_IN_MESHLET)
+			{
+				localIndices[vertex] = static_cast<uint8_t>(current.vertexCount++);
+				mesh.meshletVertices.push_back(vertex);
+				const XMFLOAT3& p = positions[vertex];
+				centroidSum = XMFLOAT3(centroidSum.x + p.x, centroidSum.y + p.y, centroidSum.z + p.z);
+			}
+			mesh.meshletTriangles.push_back(localIndices[vertex]);
+			liveTriangleCounts[vertex]--;
+		}
+		current.triangleCount++;
+		emitted[best] = true;
+		lastTriangle = best;
+	}
+	flushMeshlet();
+
+	MeshletStats stats{};
+	stats.meshletCount = mesh.meshlets.size();
+	for (const auto& meshlet : mesh.meshlets)
+	{
+		stats.averageVertexReuse += 3.0 * meshlet.triangleCount / meshlet.vertexCount;
+		stats.averageVertexCount += meshlet.vertexCount;
+		stats.averageTriangleCount += meshlet.triangleCount;
+	}
+	if (stats.meshletCount > 0)
+	{
+		stats.averageVertexReuse /= stats.meshletCount;
+		stats.averageVertexCount /= stats.meshletCount;
+		stats.averageTriangleCount /= stats.meshletCount;
+	}
+	stats.buildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	return stats;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include "ModelLoading.h"
+
+// CPU-side processing passes that run on imported meshes. None of these touch the GPU, so
+// they can run on worker threads during loading.
+
+// Size of the FIFO post-transform cache that index optimization targets and that the
+// statistics simulate
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+// Decodes the vertex positions of a mesh of any vertex type
+std::vector<DirectX::XMFLOAT3> GetVertexPositions(const Mesh& mesh);
+
+// Bounding sphere of the points referenced by indices, using Ritter's algorithm
+DirectX::BoundingSphere ComputeBoundingSphere(const DirectX::XMFLOAT3* positions,
+	const uint32_t* indices, size_t indexCount);
+
+// Simulates a FIFO post-transform vertex cache over a triangle list
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders triangles for post-transform cache locality using Tipsify (Sander et al. 2007)
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders clusters of a cache-optimized triangle list so that outward facing clusters are drawn
+// first, reducing overdraw. Clusters are only split where the ACMR stays within threshold
+// times its value for the unsplit cluster.
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const DirectX::XMFLOAT3* positions,
+	size_t vertexCount, float threshold = 1.05f, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders the vertex buffer into first-use order of the index buffer, remapping the indices
+// (and meshlet vertices, if built) to match. Unreferenced vertices are moved to the end.
+void OptimizeVertexFetch(Mesh& mesh);
+
+// Runs the vertex cache, overdraw and vertex fetch passes on a mesh, in that order
+IndexOptimizationStats OptimizeIndices(Mesh& mesh);
+
+// Generates up to lodCount levels of detail with quadric error metric edge collapses, each
+// targeting ratio times the triangles of the previous level, replacing any existing levels.
+// Stops early once the mesh can't be simplified further. Seams and non-manifold vertices stay
+// in place and border vertices only slide along the border, so the levels never crack or
+// lose attribute discontinuities. Each level is cache-optimized.
+void BuildLods(Mesh& mesh, uint32_t lodCount, float ratio = 0.5f);
+
+// Splits the triangle list in mesh.indices into meshlets of at most MESHLET_MAX_VERTICES
+// vertices and MESHLET_MAX_TRIANGLES triangles, replacing any existing meshlets
+MeshletStats BuildMeshlets(Mesh& mesh);
@@ -0,0 +1,695 @@
+// Headless model import benchmark. Loads every model in a directory (Assets by default) a
+// number of times and reports where the time went, so import regressions can be tracked on
+// build machines without a GPU or a window.
+//
+// Usage: ModelLoadBench [options] [directory or file]...
+//   --iterations N   Loads per file, the median of which is reported (default 5)
+//   --cache          Allow the mesh cache; by default every load is a full import
+//   --assimp         Import everything with Assimp rather than the native importers
+//   --quantize, --optimize, --meshlets, --lods N, --pretransform
+//                    Processing passes, as in ModelLoadOptions
+//   --json FILE      Also write the results as JSON
+//   --check          Verify the meshlets of every model, which implies --meshlets, and exit
+//                    with an error if any model fails
+//   --interleave     Instead of loading models, time the vertex interleaving on a synthetic
+//                    10M-vertex mesh with and without SSE
+//   --compression    Instead of loading models, block-compress a synthetic image in every
+//                    format, decode it again and check the PSNR of each against a minimum
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <assimp/Importer.hpp>
+
+#include "MeshImport.h"
+#include "MeshOptimization.h"
+#include "ModelLoading.h"
+#include "TextureProcessing.h"
+
+namespace
+{
+	// Lowest acceptable PSNR of each block format on the synthetic image of --compression, in dB
+	constexpr double MIN_PSNR_BC1 = 32.0;
+	constexpr double MIN_PSNR_BC3 = 33.0;
+	constexpr double MIN_PSNR_BC5 = 46.0;
+	constexpr double MIN_PSNR_BC7 = 34.0;
+
+	struct BenchResult
+	{
+		std::string path;
+		std::string error;
+		// Median of each stage over all iterations, so a single slow run doesn't skew it
+		ModelLoadStats stats;
+		double minTotalTime = 0.0;
+		size_t meshCount = 0;
+		size_t vertexCount = 0;
+		size_t triangleCount = 0;
+		// Peak resident set size of the whole process after loading the file
+		size_t peakRss = 0;
+	};
+
+	// Peak resident set size of the process in bytes, or 0 if it can't be queried
+	size_t GetPeakRss()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return counters.PeakWorkingSetSize;
+		}
+		return 0;
+#else
+		rusage usage{};
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+		{
+			// Reported in kilobytes on Linux
+			return static_cast<size_t>(usage.ru_maxrss) * 1024;
+		}
+		return 0;
+#endif
+	}
+
+	double Median(std::vector<double> values)
+	{
+		std::sort(values.begin(), values.end());
+		const size_t mid = values.size() / 2;
+		return values.size() % 2 ? values[mid] : 0.5 * (values[mid - 1] + values[mid]);
+	}
+
+	// Every file under the paths that Assimp or the native importers can read, in a stable order
+	std::vector<std::string> FindModels(const std::vector<std::string>& paths)
+	{
+		namespace fs = std::filesystem;
+		Assimp::Importer importer;
+		std::vector<std::string> ret;
+		for (const auto& path : paths)
+		{
+			if (!fs::is_directory(path))
+			{
+				ret.push_back(path);
+				continue;
+			}
+			for (const auto& entry : fs::recursive_directory_iterator(path))
+			{
+				const std::string extension = entry.path().extension().string();
+				if (entry.is_regular_file() && !extension.empty() && importer.IsExtensionSupported(extension))
+				{
+					ret.push_back(entry.path().generic_string());
+				}
+			}
+		}
+		std::sort(ret.begin(), ret.end());
+		return ret;
+	}
+
+	// Verifies the meshlets of a mesh against what BuildMeshlets guarantees, throwing on the first
+	// violation: the vertex and triangle limits, every triangle of the index buffer in exactly
+	// one meshlet with its winding kept, and bounding spheres and normal cones that contain
+	// their triangles
+	void CheckMeshlets(const Mesh& mesh)
+	{
+		using namespace DirectX;
+
+		auto fail = [](const std::string& message) {
+			throw std::runtime_error("Meshlet check failed: " + message);
+		};
+		const std::vector<XMFLOAT3> positions = GetVertexPositions(mesh);
+		const size_t indexCount = mesh.indices.size() - mesh.indices.size() % 3;
+		if (indexCount > 0 && mesh.meshlets.empty())
+		{
+			fail("no meshlets were built");
+		}
+
+		// Triangles are compared as their smallest rotation, which keeps the winding
+		using Triangle = std::array<uint32_t, 3>;
+		auto canonical = [](uint32_t a, uint32_t b, uint32_t c) {
+			return std::min({ Triangle{ a, b, c }, Triangle{ b, c, a }, Triangle{ c, a, b } });
+		};
+		std::vector<Triangle> expected;
+		for (size_t i = 0; i < indexCount; i += 3)
+		{
+			expected.push_back(canonical(mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2]));
+		}
+
+		auto length = [](float x, float y, float z) { return std::sqrt(x * x + y * y + z * z); };
+		// Rounding in the bounds is relative to the size of the mesh
+		const XMFLOAT3& boxCenter = mesh.bounds.Center;
+		const XMFLOAT3& boxExtents = mesh.bounds.Extents;
+		const float tolerance = 1e-5f * (length(boxCenter.x, boxCenter.y, boxCenter.z)
+			+ length(boxExtents.x, boxExtents.y, boxExtents.z));
+		std::vector<Triangle> actual;
+		for (size_t m = 0; m < mesh.meshlets.size(); m++)
+		{
+			const Meshlet& meshlet = mesh.meshlets[m];
+			const std::string name = "meshlet " + std::to_string(m);
+			if (meshlet.vertexCount == 0 || meshlet.vertexCount > MESHLET_MAX_VERTICES)
+			{
+				fail(name + " has " + std::to_string(meshlet.vertexCount) + " vertices");
+			}
+			if (meshlet.triangleCount == 0 || meshlet.triangleCount > MESHLET_MAX_TRIANGLES)
+			{
+				fail(name + " has " + std::to_string(meshlet.triangleCount) + " triangles");
+			}
+			if (meshlet.vertexOffset + meshlet.vertexCount > mesh.meshletVertices.size()
+				|| 3 * (meshlet.triangleOffset + meshlet.triangleCount) > mesh.meshletTriangles.size())
+			{
+				fail(name + " is out of range of the meshlet arrays");
+			}
+
+			// Every triangle normal lies within the cone of half-angle asin(coneCutoff) around
+			// the axis, unless the cutoff of 1 disables the cone test
+			const float minDot = std::sqrt(std::max(1.0f - meshlet.coneCutoff * meshlet.coneCutoff, 0.0f));
+			for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+			{
+				uint32_t corners[3];
+				XMFLOAT3 points[3];
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					const uint32_t local = mesh.meshletTriangles[3 * (meshlet.triangleOffset + t) + k];
+					if (local >= meshlet.vertexCount)
+					{
+						fail(name + " indexes past its vertices");
+					}
+					corners[k] = mesh.meshletVertices[meshlet.vertexOffset + local];
+					if (corners[k] >= positions.size())
+					{
+						fail(name + " indexes past the vertex buffer");
+					}
+					points[k] = positions[corners[k]];
+					if (length(points[k].x - meshlet.center.x, points[k].y - meshlet.center.y,
+						points[k].z - meshlet.center.z) > meshlet.radius + tolerance)
+					{
+						fail(name + " has a vertex outside its bounding sphere");
+					}
+				}
+				actual.push_back(canonical(corners[0], corners[1], corners[2]));
+
+				// Triangles are wound clockwise, as in BuildMeshlets
+				const XMFLOAT3 u(points[2].x - points[0].x, points[2].y - points[0].y, points[2].z - points[0].z);
+				const XMFLOAT3 v(points[1].x - points[0].x, points[1].y - points[0].y, points[1].z - points[0].z);
+				const XMFLOAT3 normal(u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z, u.x * v.y - u.y * v.x);
+				const float normalLength = length(normal.x, normal.y, normal.z);
+				const XMFLOAT3& axis = meshlet.coneAxis;
+				if (meshlet.coneCutoff < 1.0f && normalLength > 0.0f
+					&& (normal.x * axis.x + normal.y * axis.y + normal.z * axis.z) / normalLength < minDot - 1e-4f)
+				{
+					fail(name + " has a triangle outside its normal cone");
+				}
+			}
+		}
+
+		std::sort(expected.begin(), expected.end());
+		std::sort(actual.begin(), actual.end());
+		if (expected != actual)
+		{
+			fail("the meshlets don't hold every triangle of the mesh exactly once");
+		}
+	}
+
+	BenchResult RunBench(const std::string& path, const ModelLoadOptions& options, uint32_t iterations,
+		bool check)
+	{
+		BenchResult ret;
+		ret.path = path;
+
+		std::vector<double> cacheReadTimes, readTimes, postProcessTimes, convertTimes, cacheWriteTimes, totalTimes;
+		std::vector<double> parseTimes, mergeTimes, optimizeTimes, meshletBuildTimes;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			ModelLoadStats stats;
+			Model model = LoadModel(path, options, &stats);
+			parseTimes.push_back(stats.parseTime);
+			mergeTimes.push_back(stats.mergeTime);
+			optimizeTimes.push_back(stats.indexStats.optimizeTime);
+			meshletBuildTimes.push_back(stats.meshletStats.buildTime);
+			// Everything but the times is the same on every iteration
+			ret.stats = stats;
+			cacheReadTimes.push_back(stats.cacheReadTime);
+			readTimes.push_back(stats.readTime);
+			postProcessTimes.push_back(stats.postProcessTime);
+			convertTimes.push_back(stats.convertTime);
+			cacheWriteTimes.push_back(stats.cacheWriteTime);
+			totalTimes.push_back(stats.totalTime);
+
+			if (i == 0)
+			{
+				ret.meshCount = model.meshes.size();
+				for (const auto& mesh : model.meshes)
+				{
+					if (check)
+					{
+						CheckMeshlets(mesh);
+					}
+					ret.vertexCount += mesh.vertices.size() / GetVertexSize(mesh.type);
+					ret.triangleCount += mesh.indices.size() / 3;
+				}
+			}
+		}
+
+		ret.stats.cacheReadTime = Median(cacheReadTimes);
+		ret.stats.readTime = Median(readTimes);
+		ret.stats.postProcessTime = Median(postProcessTimes);
+		ret.stats.convertTime = Median(convertTimes);
+		ret.stats.cacheWriteTime = Median(cacheWriteTimes);
+		ret.stats.totalTime = Median(totalTimes);
+		ret.stats.parseTime = Median(parseTimes);
+		ret.stats.mergeTime = Median(mergeTimes);
+		ret.stats.indexStats.optimizeTime = Median(optimizeTimes);
+		ret.stats.meshletStats.buildTime = Median(meshletBuildTimes);
+		ret.minTotalTime = *std::min_element(totalTimes.begin(), totalTimes.end());
+		ret.peakRss = GetPeakRss();
+		return ret;
+	}
+
+	// Interleaves a synthetic mesh laid out like Assimp's attribute arrays, which are all float3,
+	// into P3N3T3U2 vertices with the scalar and the SSE path, and prints the throughput of each
+	void RunInterleaveBench(uint32_t iterations)
+	{
+		constexpr size_t vertexCount = 10'000'000;
+		std::array<std::vector<float>, 4> attributes;
+		for (size_t a = 0; a < attributes.size(); a++)
+		{
+			attributes[a].resize(vertexCount * 3);
+			for (size_t i = 0; i < attributes[a].size(); i++)
+			{
+				attributes[a][i] = static_cast<float>(i * (a + 1));
+			}
+		}
+		auto view = [&](size_t a) { return AttributeView{ reinterpret_cast<const char*>(attributes[a].data()), 12 }; };
+		const std::array<VertexStream, 4> streams{
+			VertexStream{ view(0), offsetof(VertexP3N3T3U2, position), 12 },
+			VertexStream{ view(1), offsetof(VertexP3N3T3U2, normal), 12 },
+			VertexStream{ view(2), offsetof(VertexP3N3T3U2, tangent), 12 },
+			VertexStream{ view(3), offsetof(VertexP3N3T3U2, texcoord), 8 }
+		};
+
+		// The outputs are written once up front so that page faults aren't part of the timings
+		std::array<std::vector<char>, 2> outputs;
+		const char* names[] = { "scalar", "SSE" };
+		std::cout << "Interleaving " << vertexCount << " vertices of " << sizeof(VertexP3N3T3U2) << " bytes, median of "
+			<< iterations << " runs\n";
+		for (size_t path = 0; path < outputs.size(); path++)
+		{
+			outputs[path].resize(vertexCount * sizeof(VertexP3N3T3U2));
+			std::vector<double> times;
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				InterleaveStreams(outputs[path].data(), sizeof(VertexP3N3T3U2), vertexCount, streams, path == 1);
+				times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+			}
+			const double time = Median(times);
+			char line[256];
+			snprintf(line, sizeof(line), "%-8s %9.2f ms %9.2f Mverts/s\n", names[path], time * 1000.0, vertexCount / time / 1e6);
+			std::cout << line;
+		}
+		if (outputs[0] != outputs[1])
+		{
+			throw std::runtime_error("The scalar and SSE interleaving produced different vertices");
+		}
+	}
+
+	// Peak signal-to-noise ratio in dB over the first channelCount channels of two RGBA images
+	double ComputePsnr(const TextureData& a, const TextureData& b, int channelCount)
+	{
+		double squaredError = 0.0;
+		size_t count = 0;
+		for (size_t i = 0; i < a.pixels.size(); i++)
+		{
+			if (static_cast<int>(i % 4) < channelCount)
+			{
+				const double d = static_cast<double>(a.pixels[i]) - b.pixels[i];
+				squaredError += d * d;
+				count++;
+			}
+		}
+		return squaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 * count / squaredError) : 99.0;
+	}
+
+	// Compresses a synthetic image with smooth gradients, noise and hard edges in every block
+	// format, decodes it on the CPU and checks that the error stays within what each format
+	// should achieve. The minimums leave a few dB of margin below the current encoder.
+	void RunCompressionCheck()
+	{
+		constexpr uint32_t size = 256;
+		TextureData image;
+		image.width = size;
+		image.height = size;
+		image.pixels.resize(4ull * size * size);
+		uint32_t noise = 1;
+		for (uint32_t y = 0; y < size; y++)
+		{
+			for (uint32_t x = 0; x < size; x++)
+			{
+				noise = noise * 1664525u + 1013904223u;
+				const int grain = static_cast<int>(noise >> 28) - 8;
+				const bool edge = (x / 24 + y / 40) % 2 == 0;
+				uint8_t* pTexel = image.pixels.data() + 4 * (static_cast<size_t>(y) * size + x);
+				pTexel[0] = static_cast<uint8_t>(std::clamp(static_cast<int>(x) + grain, 0, 255));
+				pTexel[1] = static_cast<uint8_t>(std::clamp(static_cast<int>(y) + (edge ? 40 : -40) + grain, 0, 255));
+				pTexel[2] = static_cast<uint8_t>(128.0 + 100.0 * std::sin((x + y) * 0.05));
+				pTexel[3] = static_cast<uint8_t>(edge ? 255 - y / 2 : y / 2);
+			}
+		}
+		GenerateMipChain(image, true);
+
+		struct Format
+		{
+			const char* name;
+			TextureCompression compression;
+			// Channels the format stores
+			int channelCount;
+			double minPsnr;
+		};
+		const Format formats[] = {
+			{ "BC1", TextureCompression::eBC1, 3, MIN_PSNR_BC1 },
+			{ "BC3", TextureCompression::eBC3, 4, MIN_PSNR_BC3 },
+			{ "BC5", TextureCompression::eBC5, 2, MIN_PSNR_BC5 },
+			{ "BC7", TextureCompression::eBC7, 4, MIN_PSNR_BC7 }
+		};
+		std::cout << "Block compression of a " << size << "x" << size << " image with " << image.mipOffsets.size()
+			<< " mip levels, PSNR over the stored channels\n";
+		bool passed = true;
+		for (const auto& format : formats)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			const TextureData compressed = CompressTexture(image, format.compression, true);
+			const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			const double psnr = ComputePsnr(image, DecompressTexture(compressed), format.channelCount);
+			char line[256];
+			snprintf(line, sizeof(line), "%-4s %7.2f dB (minimum %.0f) %9.2f ms\n", format.name, psnr, format.minPsnr,
+				time * 1000.0);
+			std::cout << line;
+			passed = passed && psnr >= format.minPsnr;
+		}
+		if (!passed)
+		{
+			throw std::runtime_error("Block compression error is above its bound");
+		}
+	}
+
+	// What the OBJ importer and the processing passes measured, for the files that have any of it
+	void PrintDetails(const std::vector<BenchResult>& results)
+	{
+		for (const auto& result : results)
+		{
+			if (!result.error.empty())
+			{
+				continue;
+			}
+			const std::string name = std::filesystem::path(result.path).filename().string();
+			const ModelLoadStats& stats = result.stats;
+			if (stats.sourceBytes > 0)
+			{
+				const double megabytes = stats.sourceBytes / (1024.0 * 1024.0);
+				std::cout << name << ": parsed " << megabytes << " MB of OBJ in " << stats.parseTime * 1000.0 << " ms ("
+					<< (stats.parseTime > 0.0 ? megabytes / stats.parseTime : 0.0) << " MB/s) across "
+					<< stats.parseChunkCount << " chunks, merged " << stats.cornerCount << " corners into "
+					<< stats.mergedVertexCount << " vertices in " << stats.mergeTime * 1000.0 << " ms\n";
+			}
+			if (stats.indexStats.before.acmr > 0.0)
+			{
+				const IndexOptimizationStats& index = stats.indexStats;
+				std::cout << name << ": index optimization ACMR " << index.before.acmr << " -> " << index.after.acmr
+					<< ", ATVR " << index.before.atvr << " -> " << index.after.atvr
+					<< " (" << index.optimizeTime * 1000.0 << " ms across meshes)\n";
+			}
+			if (stats.meshletStats.meshletCount > 0)
+			{
+				const MeshletStats& meshlets = stats.meshletStats;
+				std::cout << name << ": " << meshlets.meshletCount << " meshlets, average vertex reuse "
+					<< meshlets.averageVertexReuse << ", " << meshlets.averageVertexCount << " vertices and "
+					<< meshlets.averageTriangleCount << " triangles each (" << meshlets.buildTime * 1000.0
+					<< " ms across meshes)\n";
+			}
+		}
+	}
+
+	std::string ToJsonString(const std::string& str)
+	{
+		std::string ret = "\"";
+		for (char c : str)
+		{
+			switch (c)
+			{
+			case '"': ret += "\\\""; break;
+			case '\\': ret += "\\\\"; break;
+			case '\n': ret += "\\n"; break;
+			case '\r': ret += "\\r"; break;
+			case '\t': ret += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					ret += escaped;
+				}
+				else
+				{
+					ret += c;
+				}
+			}
+		}
+		return ret + "\"";
+	}
+
+	void WriteJson(const std::string& path, const std::vector<BenchResult>& results,
+		const ModelLoadOptions& options, uint32_t iterations)
+	{
+		std::ofstream file(path);
+		if (!file)
+		{
+			throw std::runtime_error("Failed to open " + path + " for writing");
+		}
+
+		// Times are in milliseconds
+		file << "{\n";
+		file << "  \"iterations\": " << iterations << ",\n";
+		file << "  \"options\": { \"useCache\": " << std::boolalpha << options.useCache
+			<< ", \"useNativeImporters\": " << options.useNativeImporters
+			<< ", \"preTransformVertices\": " << options.preTransformVertices
+			<< ", \"quantizeVertices\": " << options.quantizeVertices
+			<< ", \"optimizeIndices\": " << options.optimizeIndices
+			<< ", \"buildMeshlets\": " << options.buildMeshlets
+			<< ", \"lodCount\": " << options.lodCount << " },\n";
+		file << "  \"peakRssBytes\": " << GetPeakRss() << ",\n";
+		file << "  \"models\": [";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const BenchResult& result = results[i];
+			file << (i ? ",\n" : "\n") << "    { \"path\": " << ToJsonString(result.path);
+			if (!result.error.empty())
+			{
+				file << ", \"error\": " << ToJsonString(result.error) << " }";
+				continue;
+			}
+			const double verticesPerSecond = result.stats.totalTime > 0.0 ? result.vertexCount / result.stats.totalTime : 0.0;
+			file << ", \"importer\": " << ToJsonString(result.stats.importer)
+				<< ", \"meshes\": " << result.meshCount
+				<< ", \"vertices\": " << result.vertexCount
+				<< ", \"triangles\": " << result.triangleCount
+				<< ", \"cacheReadMs\": " << result.stats.cacheReadTime * 1000.0
+				<< ", \"readMs\": " << result.stats.readTime * 1000.0
+				<< ", \"postProcessMs\": " << result.stats.postProcessTime * 1000.0
+				<< ", \"convertMs\": " << result.stats.convertTime * 1000.0
+				<< ", \"cacheWriteMs\": " << result.stats.cacheWriteTime * 1000.0
+				<< ", \"totalMs\": " << result.stats.totalTime * 1000.0
+				<< ", \"minTotalMs\": " << result.minTotalTime * 1000.0
+				<< ", \"verticesPerSecond\": " << verticesPerSecond
+				<< ", \"peakRssBytes\": " << result.peakRss;
+			if (result.stats.sourceBytes > 0)
+			{
+				file << ", \"objParseMs\": " << result.stats.parseTime * 1000.0
+					<< ", \"objMergeMs\": " << result.stats.mergeTime * 1000.0;
+			}
+			if (result.stats.indexStats.before.acmr > 0.0)
+			{
+				const IndexOptimizationStats& index = result.stats.indexStats;
+				file << ", \"acmrBefore\": " << index.before.acmr << ", \"acmrAfter\": " << index.after.acmr
+					<< ", \"atvrBefore\": " << index.before.atvr << ", \"atvrAfter\": " << index.after.atvr
+					<< ", \"optimizeMs\": " << index.optimizeTime * 1000.0;
+			}
+			if (result.stats.meshletStats.meshletCount > 0)
+			{
+				file << ", \"meshlets\": " << result.stats.meshletStats.meshletCount
+					<< ", \"meshletBuildMs\": " << result.stats.meshletStats.buildTime * 1000.0;
+			}
+			file << " }";
+		}
+		file << "\n  ]\n}\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		// The renderer loads with the hierarchy kept, so that is the default here too
+		ModelLoadOptions options;
+		options.useCache = false;
+		options.preTransformVertices = false;
+		uint32_t iterations = 5;
+		std::string jsonPath;
+		bool interleaveBench = false;
+		bool compressionCheck = false;
+		bool check = false;
+		std::vector<std::string> paths;
+
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			auto nextArg = [&]() -> std::string {
+				if (i + 1 >= argc)
+				{
+					throw std::runtime_error(arg + " needs a value");
+				}
+				return argv[++i];
+			};
+
+			if (arg == "--iterations")
+			{
+				iterations = std::max(1, std::stoi(nextArg()));
+			}
+			else if (arg == "--cache")
+			{
+				options.useCache = true;
+			}
+			else if (arg == "--assimp")
+			{
+				options.useNativeImporters = false;
+			}
+			else if (arg == "--quantize")
+			{
+				options.quantizeVertices = true;
+			}
+			else if (arg == "--optimize")
+			{
+				options.optimizeIndices = true;
+			}
+			else if (arg == "--meshlets")
+			{
+				options.buildMeshlets = true;
+			}
+			else if (arg == "--lods")
+			{
+				options.lodCount = static_cast<uint32_t>(std::max(0, std::stoi(nextArg())));
+			}
+			else if (arg == "--pretransform")
+			{
+				options.preTransformVertices = true;
+			}
+			else if (arg == "--json")
+			{
+				jsonPath = nextArg();
+			}
+			else if (arg == "--interleave")
+			{
+				interleaveBench = true;
+			}
+			else if (arg == "--compression")
+			{
+				compressionCheck = true;
+			}
+			else if (arg == "--check")
+			{
+				check = true;
+				options.buildMeshlets = true;
+			}
+			else if (arg.rfind("--", 0) == 0)
+			{
+				throw std::runtime_error("Unknown option " + arg);
+			}
+			else
+			{
+				paths.push_back(arg);
+			}
+		}
+		if (interleaveBench)
+		{
+			RunInterleaveBench(iterations);
+			return 0;
+		}
+		if (compressionCheck)
+		{
+			RunCompressionCheck();
+			return 0;
+		}
+		if (paths.empty())
+		{
+			paths.push_back(ASSET_PATH);
+		}
+
+		std::vector<BenchResult> results;
+		for (const auto& path : FindModels(paths))
+		{
+			try
+			{
+				results.push_back(RunBench(path, options, iterations, check));
+			}
+			catch (std::exception& e)
+			{
+				// Keep going so one broken file doesn't hide regressions in the others
+				BenchResult result;
+				result.path = path;
+				result.error = e.what();
+				results.push_back(result);
+			}
+		}
+
+		// Summary table, with the median time of each stage in milliseconds
+		std::cout << "\nmodel                             importer  read      post      convert   total     Mverts/s\n";
+		for (const auto& result : results)
+		{
+			const std::string name = std::filesystem::path(result.path).filename().string();
+			if (!result.error.empty())
+			{
+				std::cout << name << ": " << result.error << "\n";
+				continue;
+			}
+			char line[256];
+			snprintf(line, sizeof(line), "%-33s %-9s %-9.2f %-9.2f %-9.2f %-9.2f %.2f\n",
+				name.c_str(), result.stats.importer, result.stats.readTime * 1000.0,
+				result.stats.postProcessTime * 1000.0, result.stats.convertTime * 1000.0,
+				result.stats.totalTime * 1000.0,
+				result.stats.totalTime > 0.0 ? result.vertexCount / result.stats.totalTime / 1e6 : 0.0);
+			std::cout << line;
+		}
+		std::cout << "Peak RSS: " << GetPeakRss() / (1024.0 * 1024.0) << " MB\n";
+		PrintDetails(results);
+
+		if (!jsonPath.empty())
+		{
+			WriteJson(jsonPath, results, options, iterations);
+		}
+		if (check && std::any_of(results.begin(), results.end(), [](const BenchResult& result) {
+			return !result.error.empty();
+		}))
+		{
+			return 1;
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << e.what();
+		return 1;
+	}
+	return 0;
+}
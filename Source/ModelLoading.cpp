@@ -1,101 +1,267 @@
 #include "ModelLoading.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cstring>
 #include <stdexcept>
 
 #include <assimp/postprocess.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 
+#include "AssimpIO.h"
+#include "GltfLoading.h"
+#include "Hash.h"
+#include "MeshCache.h"
+#include "MeshImport.h"
+#include "ObjLoading.h"
+
 using namespace std::string_literals;
 
 namespace
 {
-	Mesh ProcessMesh(const aiMesh* mesh)
+	// Describes an Assimp mesh for the shared conversion. Attributes are referenced in place.
+	SourceMesh ToSourceMesh(const aiMesh* mesh)
 	{
-		using namespace DirectX;
+		assert(mesh->HasPositions());
+		assert(mesh->HasNormals());
 
-		Mesh ret;
+		SourceMesh ret;
+		ret.vertexCount = mesh->mNumVertices;
+		ret.positions = { reinterpret_cast<const char*>(mesh->mVertices), sizeof(aiVector3D) };
+		ret.normals = { reinterpret_cast<const char*>(mesh->mNormals), sizeof(aiVector3D) };
+		if (mesh->HasTextureCoords(0))
+		{
+			assert(mesh->HasTangentsAndBitangents());
+			ret.tangents = { reinterpret_cast<const char*>(mesh->mTangents), sizeof(aiVector3D) };
+			ret.texcoords = { reinterpret_cast<const char*>(mesh->mTextureCoords[0]), sizeof(aiVector3D) };
+		}
 
-		// Index buffer
+		// Index buffer, sized once up front and filled in place
+		size_t indexCount = 0;
 		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 		{
-			for (unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++)
-			{
-				ret.indices.push_back(mesh->mFaces[i].mIndices[j]);
-			}
+			indexCount += mesh->mFaces[i].mNumIndices;
 		}
-
-		// Vertex buffer
-		assert(mesh->HasPositions());
-		assert(mesh->HasNormals());
-		if (mesh->HasTextureCoords(0))
+		ret.indices.resize(indexCount);
+		uint32_t* pIndex = ret.indices.data();
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 		{
-			assert(mesh->HasTangentsAndBitangents());
-			std::vector<VertexP3N3T3U2> vertices;
-			for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			{
-				VertexP3N3T3U2 v{
-					XMFLOAT3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z),
-					XMFLOAT3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z),
-					XMFLOAT3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z),
-					XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y)
-				};
-				vertices.push_back(v);
-			}
-			ret.type = VertexType::eP3N3T3U2;
-			ret.vertices.resize(vertices.size() * sizeof(vertices[0]));
-			memcpy(ret.vertices.data(), vertices.data(), vertices.size() * sizeof(vertices[0]));
+			const aiFace& face = mesh->mFaces[i];
+			memcpy(pIndex, face.mIndices, face.mNumIndices * sizeof(uint32_t));
+			pIndex += face.mNumIndices;
 		}
-		else
+		return ret;
+	}
+
+	// Hashes everything that changes the output of LoadModel for a given source file
+	uint64_t HashImportSettings(unsigned int flags, const ModelLoadOptions& options)
+	{
+		// Fields are hashed individually so that struct padding never reaches the hash
+		const uint32_t settings[] = {
+			flags,
+			options.quantizeVertices,
+			options.optimizeIndices,
+			options.buildMeshlets,
+			options.lodCount,
+			options.useNativeImporters
+		};
+		return Hash64(settings, sizeof(settings));
+	}
+
+	double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Lowercase file extension including the dot, or an empty string if there is none
+	std::string GetExtension(const std::string& path)
+	{
+		const size_t dot = path.find_last_of('.');
+		if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos)
 		{
-			std::vector<VertexP3N3> vertices;
-			for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			{
-				VertexP3N3 v{
-					XMFLOAT3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z),
-					XMFLOAT3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z),
-				};
-				vertices.push_back(v);
-			}
-			ret.type = VertexType::eP3N3;
-			ret.vertices.resize(vertices.size() * sizeof(vertices[0]));
-			memcpy(ret.vertices.data(), vertices.data(), vertices.size() * sizeof(vertices[0]));
+			return {};
 		}
+		std::string ret = path.substr(dot);
+		std::transform(ret.begin(), ret.end(), ret.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
 		return ret;
 	}
 
-	void ProcessNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& meshes)
+	// Records an instance for every mesh reference of the node and its descendants, in a fixed
+	// order so the output doesn't depend on scheduling. Assimp matrices act on column vectors,
+	// so they are transposed for DirectXMath.
+	void ProcessNode(const aiNode* node, const aiMatrix4x4& parentTransform, std::vector<MeshInstance>& instances)
 	{
+		static_assert(sizeof(aiMatrix4x4) == sizeof(DirectX::XMFLOAT4X4), "Assimp must use single precision");
+
+		const aiMatrix4x4 transform = parentTransform * node->mTransformation;
+		aiMatrix4x4 transposed = transform;
+		transposed.Transpose();
+
+		MeshInstance instance{};
+		memcpy(&instance.transform, &transposed, sizeof(instance.transform));
+		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		{
+			instance.meshIndex = node->mMeshes[i];
+			instances.push_back(instance);
+		}
+
 		for (unsigned int i = 0; i < node->mNumChildren; i++)
 		{
-			const aiNode* child = node->mChildren[i];
-			ProcessNode(scene, child, meshes);
+			ProcessNode(node->mChildren[i], transform, instances);
 		}
+	}
 
-		if (node->mNumMeshes > 0)
+	// Pre-transforming gives every node reference its own copy of the mesh, with the node
+	// transform baked in
+	unsigned int GetImportFlags(const ModelLoadOptions& options)
+	{
+		unsigned int flags = aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_TransformUVCoords
+			| aiProcess_FixInfacingNormals | aiProcess_FlipUVs | aiProcess_FlipWindingOrder;
+		if (options.preTransformVertices)
 		{
-			unsigned int meshIdx = node->mMeshes[0];
-			const aiMesh* mesh = scene->mMeshes[meshIdx];
-			meshes.push_back(ProcessMesh(mesh));
+			flags |= aiProcess_PreTransformVertices;
 		}
+		return flags;
+	}
+
+	// Files are read through a MappedIOSystem, serving them from the archive if there is one.
+	// The importer takes ownership of the IO system. If pDependencies is given, it receives the
+	// other files read from disk, such as an OBJ's material library.
+	Model ImportWithAssimp(const std::string& path, const ModelLoadOptions& options, const AssetArchive* pArchive,
+		ModelLoadStats& stats, std::vector<std::string>* pDependencies = nullptr)
+	{
+		// Post-processing is applied as a separate step so that it can be timed on its own.
+		// This is what ReadFile does internally when given the flags.
+		stats.importer = "Assimp";
+		auto stageStart = std::chrono::steady_clock::now();
+		Assimp::Importer importer;
+		MappedIOSystem* pIOSystem = new MappedIOSystem(pArchive);
+		importer.SetIOHandler(pIOSystem);
+		const aiScene* scene = importer.ReadFile(path, 0);
+		stats.readTime = SecondsSince(stageStart);
+		stageStart = std::chrono::steady_clock::now();
+		if (scene)
+		{
+			scene = importer.ApplyPostProcessing(GetImportFlags(options));
+		}
+		if (!scene)
+		{
+			throw std::runtime_error("Import failed with error: "s + importer.GetErrorString());
+		}
+		stats.postProcessTime = SecondsSince(stageStart);
+
+		// Meshes keep their Assimp indices, which the instances refer to. The Assimp arrays are
+		// converted in place, so the importer has to outlive BuildModel.
+		stageStart = std::chrono::steady_clock::now();
+		SourceModel source;
+		ProcessNode(scene->mRootNode, aiMatrix4x4(), source.instances);
+		source.meshes.reserve(scene->mNumMeshes);
+		for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+		{
+			source.meshes.push_back(ToSourceMesh(scene->mMeshes[i]));
+		}
+		Model ret = BuildModel(std::move(source), options, &stats);
+		stats.convertTime = SecondsSince(stageStart);
+
+		if (pDependencies)
+		{
+			for (const std::string& file : pIOSystem->GetOpenedFiles())
+			{
+				if (file != path)
+				{
+					pDependencies->push_back(file);
+				}
+			}
+		}
+		return ret;
 	}
 }
 
-std::vector<Mesh> LoadModel(const std::string& path)
+Model LoadModel(const std::string& path, const ModelLoadOptions& options, ModelLoadStats* pStats)
 {
-	std::vector<Mesh> ret;
-
-	// Load model
-	Assimp::Importer importer;
-	constexpr auto flags = aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_TransformUVCoords
-		| aiProcess_FixInfacingNormals | aiProcess_FlipUVs | aiProcess_FlipWindingOrder | aiProcess_PreTransformVertices;
-	const aiScene* scene = importer.ReadFile(path, flags);
-	if (!scene)
+	Model ret;
+	ModelLoadStats stats;
+	const auto startTime = std::chrono::steady_clock::now();
+
+	// The cache is keyed on the source file contents and on everything that affects the import.
+	// Files the source refers to are recorded in the cache as they're found by the import.
+	const std::string cachePath = path + ".meshcache";
+	uint64_t cacheKey = 0;
+	if (options.useCache)
 	{
-		throw std::runtime_error("Import failed with error: "s + importer.GetErrorString());
+		const uint64_t settingsHash = HashImportSettings(GetImportFlags(options), options);
+		cacheKey = ComputeMeshCacheKey(path, settingsHash);
+		const bool cacheHit = ReadMeshCache(cachePath, cacheKey, ret);
+		stats.cacheReadTime = SecondsSince(startTime);
+		if (cacheHit)
+		{
+			if (pStats)
+			{
+				stats.importer = "cache";
+				stats.totalTime = stats.cacheReadTime;
+				*pStats = stats;
+			}
+			return ret;
+		}
 	}
 
-	const aiNode* root = scene->mRootNode;
-	ProcessNode(scene, root, ret);
+	auto stageStart = std::chrono::steady_clock::now();
+	const std::string extension = GetExtension(path);
+	std::vector<std::string> dependencies;
+	if (options.useNativeImporters && (extension == ".gltf" || extension == ".glb"))
+	{
+		stats.importer = "glTF";
+		SourceModel source = ImportGltf(path, options);
+		dependencies = std::move(source.dependencies);
+		stats.readTime = SecondsSince(stageStart);
+		stageStart = std::chrono::steady_clock::now();
+		ret = BuildModel(std::move(source), options, &stats);
+		stats.convertTime = SecondsSince(stageStart);
+	}
+	else if (options.useNativeImporters && extension == ".obj")
+	{
+		stats.importer = "OBJ";
+		SourceModel source = ImportObj(path, &stats);
+		dependencies = std::move(source.dependencies);
+		stats.readTime = SecondsSince(stageStart);
+		stageStart = std::chrono::steady_clock::now();
+		ret = BuildModel(std::move(source), options, &stats);
+		stats.convertTime = SecondsSince(stageStart);
+	}
+	else
+	{
+		ret = ImportWithAssimp(path, options, nullptr, stats, &dependencies);
+	}
+
+	// A failed cache write only costs us the next warm start, so it isn't an error
+	if (options.useCache)
+	{
+		stageStart = std::chrono::steady_clock::now();
+		WriteMeshCache(cachePath, cacheKey, ret, dependencies);
+		stats.cacheWriteTime = SecondsSince(stageStart);
+	}
+
+	if (pStats)
+	{
+		stats.totalTime = SecondsSince(startTime);
+		*pStats = stats;
+	}
+	return ret;
+}
+
+Model LoadModel(const AssetArchive& archive, const std::string& name, const ModelLoadOptions& options,
+	ModelLoadStats* pStats)
+{
+	ModelLoadStats stats;
+	const auto startTime = std::chrono::steady_clock::now();
+	Model ret = ImportWithAssimp(name, options, &archive, stats);
+	if (pStats)
+	{
+		stats.totalTime = SecondsSince(startTime);
+		*pStats = stats;
+	}
 	return ret;
 }
@@ -4,6 +4,8 @@
 #include <string>
 
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <DirectXPackedVector.h>
 
 struct VertexP3
 {
@@ -44,6 +46,23 @@ struct VertexP3N3T3U2
 	DirectX::XMFLOAT2 texcoord;
 };
 
+// Compact vertex formats. Positions are unorm16 relative to the mesh bounds (w is padding),
+// normals and tangents are octahedral-encoded snorm16 and texcoords are unorm16 relative to
+// the mesh's texcoord range. See VertexQuantization for the decode parameters.
+struct VertexP3N3Packed
+{
+	DirectX::PackedVector::XMUSHORTN4 position;
+	DirectX::PackedVector::XMSHORTN2 normal;
+};
+
+struct VertexP3N3T3U2Packed
+{
+	DirectX::PackedVector::XMUSHORTN4 position;
+	DirectX::PackedVector::XMSHORTN2 normal;
+	DirectX::PackedVector::XMSHORTN2 tangent;
+	DirectX::PackedVector::XMUSHORTN2 texcoord;
+};
+
 enum class VertexType
 {
 	eP3,
@@ -51,7 +70,88 @@ enum class VertexType
 	eP3N3,
 	eP3N3U2,
 	eP3N3T3,
-	eP3N3T3U2
+	eP3N3T3U2,
+	eP3N3Packed,
+	eP3N3T3U2Packed
+};
+
+// Size in bytes of a single vertex of the given type, or 0 if the type is unknown
+constexpr size_t GetVertexSize(VertexType type)
+{
+	switch (type)
+	{
+	case VertexType::eP3: return sizeof(VertexP3);
+	case VertexType::eP3U2: return sizeof(VertexP3U2);
+	case VertexType::eP3N3: return sizeof(VertexP3N3);
+	case VertexType::eP3N3U2: return sizeof(VertexP3N3U2);
+	case VertexType::eP3N3T3: return sizeof(VertexP3N3T3);
+	case VertexType::eP3N3T3U2: return sizeof(VertexP3N3T3U2);
+	case VertexType::eP3N3Packed: return sizeof(VertexP3N3Packed);
+	case VertexType::eP3N3T3U2Packed: return sizeof(VertexP3N3T3U2Packed);
+	default: return 0;
+	}
+}
+
+// Width of the indices a mesh is drawn with. Indices are always 32-bit on the CPU so that the
+// processing passes don't have to care; they are narrowed when uploaded.
+enum class IndexType
+{
+	eUint16,
+	eUint32
+};
+
+constexpr size_t GetIndexSize(IndexType type)
+{
+	return type == IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// The narrowest index type that can address every vertex. Primitive restart is never enabled,
+// so all 65536 values of a 16-bit index are usable.
+constexpr IndexType SelectIndexType(size_t vertexCount)
+{
+	return vertexCount <= 65536 ? IndexType::eUint16 : IndexType::eUint32;
+}
+
+// Maps the normalized values of the packed vertex formats back to their original range:
+// value = offset + scale * normalized. Identity for the full-float formats.
+struct VertexQuantization
+{
+	DirectX::XMFLOAT3 positionOffset = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 positionScale = { 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT2 texcoordOffset = { 0.0f, 0.0f };
+	DirectX::XMFLOAT2 texcoordScale = { 1.0f, 1.0f };
+};
+
+// Meshlet limits, chosen to fit mesh shader output limits on all vendors
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A small cluster of triangles with its own culling bounds
+struct Meshlet
+{
+	// Offsets into Mesh::meshletVertices and Mesh::meshletTriangles (in triangles)
+	uint32_t vertexOffset;
+	uint32_t triangleOffset;
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+	// Bounding sphere
+	DirectX::XMFLOAT3 center;
+	float radius;
+	// Normal cone. Every triangle in the meshlet is backfacing when
+	// dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius
+	DirectX::XMFLOAT3 coneAxis;
+	float coneCutoff;
+};
+
+// A simplified version of a mesh, drawn with the same vertices
+struct MeshLod
+{
+	// Range of Mesh::lodIndices
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	// Largest distance, in model units, between the simplified and the original surface, as
+	// estimated by the quadric error metric
+	float error;
 };
 
 struct Mesh
@@ -59,6 +159,127 @@ struct Mesh
 	VertexType type;
 	std::vector<char> vertices;
 	std::vector<uint32_t> indices;
+	IndexType indexType;
+	// Bounds of all the vertices, which also bound every level of detail and meshlet
+	DirectX::BoundingBox bounds;
+	DirectX::BoundingSphere boundingSphere;
+	VertexQuantization quantization;
+
+	// Optional meshlet representation of the same triangles as indices. meshletVertices maps
+	// meshlet-local vertices to the vertex buffer, and meshletTriangles holds three local
+	// vertex indices per triangle.
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint8_t> meshletTriangles;
+
+	// Optional simplified levels of detail, from finest to coarsest. They index the same
+	// vertices as indices, so only their index ranges differ.
+	std::vector<MeshLod> lods;
+	std::vector<uint32_t> lodIndices;
+};
+
+// A placement of one of a model's meshes
+struct MeshInstance
+{
+	uint32_t meshIndex;
+	// Model space transform of the mesh, in DirectXMath convention (row vectors)
+	DirectX::XMFLOAT4X4 transform;
+};
+
+struct Model
+{
+	// Every mesh is stored once, however many nodes reference it
+	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
 };
 
-std::vector<Mesh> LoadModel(const std::string& filename);
\ No newline at end of file
+class AssetArchive;
+
+struct ModelLoadOptions
+{
+	// Read from and write to a cooked binary cache next to the source file, skipping the import
+	// entirely when the cache is up to date
+	bool useCache = true;
+	// Import glTF, GLB and OBJ files with our own importers rather than Assimp. The import time is
+	// reported either way, so turning this off (along with the cache) compares the two.
+	bool useNativeImporters = true;
+	// Bake node transforms into the vertices, giving one mesh per node reference and identity
+	// instances. Otherwise the hierarchy is kept and repeated meshes are instanced.
+	bool preTransformVertices = true;
+	// Store vertices in the packed formats instead of full floats
+	bool quantizeVertices = false;
+	// Reorder triangles for the post-transform cache and for overdraw, then reorder vertices
+	// to match. The cache statistics before and after are reported in ModelLoadStats.
+	bool optimizeIndices = false;
+	// Split every mesh into meshlets for cluster culling
+	bool buildMeshlets = false;
+	// Number of simplified levels of detail to generate per mesh, each with half the triangles
+	// of the previous one. Fewer are generated for meshes that can't be simplified that far.
+	uint32_t lodCount = 0;
+};
+
+// Average cache miss ratio (transformed vertices per triangle, 0.5 at best) and average
+// transform to vertex ratio (transformed vertices per referenced vertex, 1.0 at best)
+struct VertexCacheStats
+{
+	double acmr;
+	double atvr;
+};
+
+struct IndexOptimizationStats
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+	// Wall-clock time taken by all passes, in seconds
+	double optimizeTime;
+};
+
+struct MeshletStats
+{
+	// Wall-clock time taken to build the meshlets, in seconds
+	double buildTime;
+	size_t meshletCount;
+	// Average over all meshlets of how many triangle corners share each vertex (3 * T / V)
+	double averageVertexReuse;
+	double averageVertexCount;
+	double averageTriangleCount;
+};
+
+// Where the time of a LoadModel call went, in seconds, along with what the import and the
+// processing passes measured along the way
+struct ModelLoadStats
+{
+	// Name of the importer that read the file, or "cache" when the mesh cache was up to date
+	const char* importer = "";
+	// Reading the mesh cache, whether or not it turned out to be up to date
+	double cacheReadTime = 0.0;
+	// Parsing the source file. Assimp's post-processing steps are timed separately; the native
+	// importers don't have any.
+	double readTime = 0.0;
+	double postProcessTime = 0.0;
+	// Converting the imported meshes to Mesh, including the optional processing passes
+	double convertTime = 0.0;
+	double cacheWriteTime = 0.0;
+	double totalTime = 0.0;
+
+	// Native OBJ importer only: the file size, and the parse and corner merge that make up
+	// readTime
+	uint64_t sourceBytes = 0;
+	double parseTime = 0.0;
+	double mergeTime = 0.0;
+	size_t parseChunkCount = 0;
+	size_t cornerCount = 0;
+	size_t mergedVertexCount = 0;
+	// Whole-model statistics of the processing passes that are enabled. The cache statistics
+	// weight each mesh by its triangle count for the ACMR and its vertex count for the ATVR,
+	// and the meshlet averages weight each mesh by its meshlet count.
+	IndexOptimizationStats indexStats{};
+	MeshletStats meshletStats{};
+};
+
+Model LoadModel(const std::string& filename, const ModelLoadOptions& options = {}, ModelLoadStats* pStats = nullptr);
+
+// Loads a model, and any files it references, out of a packed archive. Everything is imported
+// with Assimp and the mesh cache isn't used, whatever the options say.
+Model LoadModel(const AssetArchive& archive, const std::string& name, const ModelLoadOptions& options = {},
+	ModelLoadStats* pStats = nullptr);
\ No newline at end of file
@@ -0,0 +1,450 @@
+#include "ObjLoading.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "MemoryMappedFile.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Chunks are at least this big, so that small files aren't split for nothing
+	constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+	// Marks a missing attribute index
+	constexpr int64_t NO_INDEX = INT64_MIN;
+	constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+	// Attribute arrays, in the order corner indices are stored
+	enum ObjAttribute
+	{
+		eObjPosition,
+		eObjTexcoord,
+		eObjNormal,
+		eObjAttributeCount
+	};
+
+	// Attribute indices of one triangle corner. Indices are zero-based and absolute, except for
+	// those flagged in relativeMask, which came from negative OBJ indices. Those count from the
+	// first element of their kind in the chunk and are resolved once the chunks are merged.
+	struct ObjCorner
+	{
+		int64_t indices[eObjAttributeCount];
+		uint32_t relativeMask;
+	};
+
+	// Everything parsed from one chunk of the file
+	struct ObjChunk
+	{
+		std::vector<DirectX::XMFLOAT3> positions;
+		std::vector<DirectX::XMFLOAT2> texcoords;
+		std::vector<DirectX::XMFLOAT3> normals;
+		// Triangulated faces, already wound clockwise
+		std::vector<ObjCorner> corners;
+	};
+
+	bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	const char* SkipSpaces(const char* p, const char* pEnd)
+	{
+		while (p < pEnd && IsSpace(*p))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	// Parses a chunk of whole lines. Errors are reported as a byte offset into the file, since
+	// line numbers aren't known until the earlier chunks are done.
+	class ObjChunkParser
+	{
+	public:
+		ObjChunkParser(const char* pFile, ObjChunk& chunk) : m_pFile(pFile), m_chunk(chunk)
+		{
+		}
+
+		void Parse(const char* p, const char* pEnd)
+		{
+			while (p < pEnd)
+			{
+				const char* pLineEnd = static_cast<const char*>(memchr(p, '\n', pEnd - p));
+				if (!pLineEnd)
+				{
+					pLineEnd = pEnd;
+				}
+				ParseLine(SkipSpaces(p, pLineEnd), pLineEnd);
+				p = pLineEnd + 1;
+			}
+		}
+
+	private:
+		[[noreturn]] void Fail(const char* p) const
+		{
+			throw std::runtime_error("Malformed OBJ at byte " + std::to_string(p - m_pFile));
+		}
+
+		// from_chars is locale-independent and needs no terminator, unlike strtod
+		const char* ParseFloat(const char* p, const char* pEnd, float& value) const
+		{
+			p = SkipSpaces(p, pEnd);
+			if (p < pEnd && *p == '+')
+			{
+				p++;
+			}
+			auto result = std::from_chars(p, pEnd, value);
+			if (result.ec == std::errc::result_out_of_range)
+			{
+				// Denormals and the like, which are as good as zero for our purposes
+				value = 0.0f;
+			}
+			else if (result.ec != std::errc())
+			{
+				Fail(p);
+			}
+			return result.ptr;
+		}
+
+		// Converts a one-based OBJ index, which counts back from the last element when negative
+		int64_t ParseIndex(const char*& p, const char* pEnd, ObjAttribute attribute, size_t count, uint32_t& relativeMask) const
+		{
+			int64_t index = 0;
+			auto result = std::from_chars(p, pEnd, index);
+			if (result.ec != std::errc() || index == 0)
+			{
+				Fail(p);
+			}
+			p = result.ptr;
+			if (index > 0)
+			{
+				return index - 1;
+			}
+			relativeMask |= 1u << attribute;
+			return static_cast<int64_t>(count) + index;
+		}
+
+		void ParseLine(const char* p, const char* pEnd)
+		{
+			using namespace DirectX;
+
+			// Every keyword we care about is followed by a space
+			auto isKeyword = [&](const char* keyword, size_t length) {
+				return static_cast<size_t>(pEnd - p) > length && memcmp(p, keyword, length) == 0 && IsSpace(p[length]);
+			};
+
+			if (isKeyword("v", 1))
+			{
+				XMFLOAT3& position = m_chunk.positions.emplace_back();
+				p = ParseFloat(p + 2, pEnd, position.x);
+				p = ParseFloat(p, pEnd, position.y);
+				ParseFloat(p, pEnd, position.z);
+			}
+			else if (isKeyword("vt", 2))
+			{
+				// The OBJ texture origin is the bottom left, so v is flipped. The v coordinate
+				// is optional.
+				XMFLOAT2& texcoord = m_chunk.texcoords.emplace_back(0.0f, 0.0f);
+				p = ParseFloat(p + 3, pEnd, texcoord.x);
+				p = SkipSpaces(p, pEnd);
+				if (p < pEnd)
+				{
+					ParseFloat(p, pEnd, texcoord.y);
+				}
+				texcoord.y = 1.0f - texcoord.y;
+			}
+			else if (isKeyword("vn", 2))
+			{
+				XMFLOAT3& normal = m_chunk.normals.emplace_back();
+				p = ParseFloat(p + 3, pEnd, normal.x);
+				p = ParseFloat(p, pEnd, normal.y);
+				ParseFloat(p, pEnd, normal.z);
+			}
+			else if (isKeyword("f", 1))
+			{
+				ParseFace(p + 2, pEnd);
+			}
+			// Everything else (comments, groups, materials, smoothing groups, lines) is ignored
+		}
+
+		// Corners are given as v, v/vt, v//vn or v/vt/vn
+		void ParseFace(const char* p, const char* pEnd)
+		{
+			m_face.clear();
+			for (p = SkipSpaces(p, pEnd); p < pEnd && *p != '#'; p = SkipSpaces(p, pEnd))
+			{
+				ObjCorner corner{ { NO_INDEX, NO_INDEX, NO_INDEX }, 0 };
+				corner.indices[eObjPosition] = ParseIndex(p, pEnd, eObjPosition, m_chunk.positions.size(), corner.relativeMask);
+				if (p < pEnd && *p == '/')
+				{
+					p++;
+					if (p < pEnd && *p != '/')
+					{
+						corner.indices[eObjTexcoord] = ParseIndex(p, pEnd, eObjTexcoord, m_chunk.texcoords.size(), corner.relativeMask);
+					}
+					if (p < pEnd && *p == '/')
+					{
+						p++;
+						corner.indices[eObjNormal] = ParseIndex(p, pEnd, eObjNormal, m_chunk.normals.size(), corner.relativeMask);
+					}
+				}
+				m_face.push_back(corner);
+			}
+
+			// Fan triangulation. OBJ front faces are counterclockwise, so each triangle is
+			// emitted with its last two corners swapped.
+			for (size_t i = 1; i + 1 < m_face.size(); i++)
+			{
+				m_chunk.corners.push_back(m_face[0]);
+				m_chunk.corners.push_back(m_face[i + 1]);
+				m_chunk.corners.push_back(m_face[i]);
+			}
+		}
+
+		const char* m_pFile;
+		ObjChunk& m_chunk;
+		std::vector<ObjCorner> m_face;
+	};
+
+	// Splits the file into chunks that end on line boundaries, a few per worker thread so that
+	// uneven chunks still balance out
+	std::vector<std::pair<const char*, const char*>> SplitChunks(const char* pData, size_t size)
+	{
+		const size_t targetCount = ThreadPool::GetDefault().GetThreadCount() * 4 + 1;
+		const size_t chunkSize = std::max(MIN_CHUNK_SIZE, size / targetCount + 1);
+
+		std::vector<std::pair<const char*, const char*>> ret;
+		const char* pEnd = pData + size;
+		for (const char* p = pData; p < pEnd;)
+		{
+			const char* pChunkEnd = pEnd;
+			if (static_cast<size_t>(pEnd - p) > chunkSize)
+			{
+				const char* pNewline = static_cast<const char*>(memchr(p + chunkSize, '\n', pEnd - p - chunkSize));
+				pChunkEnd = pNewline ? pNewline + 1 : pEnd;
+			}
+			ret.emplace_back(p, pChunkEnd);
+			p = pChunkEnd;
+		}
+		return ret;
+	}
+
+	// Open addressing hash table from attribute index triples to output vertices
+	class VertexDeduplicator
+	{
+	public:
+		explicit VertexDeduplicator(size_t expectedCount)
+		{
+			size_t capacity = 64;
+			while (capacity < expectedCount * 2)
+			{
+				capacity *= 2;
+			}
+			m_table.assign(capacity, NO_VERTEX);
+		}
+
+		uint32_t Insert(const std::array<uint32_t, eObjAttributeCount>& key)
+		{
+			if ((m_keys.size() + 1) * 2 > m_table.size())
+			{
+				Grow();
+			}
+			size_t slot = Find(key);
+			if (m_table[slot] == NO_VERTEX)
+			{
+				if (m_keys.size() >= NO_VERTEX)
+				{
+					throw std::runtime_error("OBJ has too many unique vertices");
+				}
+				m_table[slot] = static_cast<uint32_t>(m_keys.size());
+				m_keys.push_back(key);
+			}
+			return m_table[slot];
+		}
+
+		const std::vector<std::array<uint32_t, eObjAttributeCount>>& GetKeys() const
+		{
+			return m_keys;
+		}
+
+	private:
+		static size_t Hash(const std::array<uint32_t, eObjAttributeCount>& key)
+		{
+			uint64_t h = key[0] * 0x9E3779B97F4A7C15ull;
+			h ^= (h >> 29) ^ key[1] * 0xC2B2AE3D27D4EB4Full;
+			h ^= (h >> 32) ^ key[2] * 0x165667B19E3779F9ull;
+			return static_cast<size_t>(h ^ (h >> 31));
+		}
+
+		size_t Find(const std::array<uint32_t, eObjAttributeCount>& key) const
+		{
+			const size_t mask = m_table.size() - 1;
+			size_t slot = Hash(key) & mask;
+			while (m_table[slot] != NO_VERTEX && m_keys[m_table[slot]] != key)
+			{
+				slot = (slot + 1) & mask;
+			}
+			return slot;
+		}
+
+		void Grow()
+		{
+			m_table.assign(m_table.size() * 2, NO_VERTEX);
+			for (uint32_t i = 0; i < m_keys.size(); i++)
+			{
+				m_table[Find(m_keys[i])] = i;
+			}
+		}
+
+		std::vector<uint32_t> m_table;
+		std::vector<std::array<uint32_t, eObjAttributeCount>> m_keys;
+	};
+
+	// Concatenates one attribute array of every chunk, in parallel
+	template<typename T>
+	std::vector<T> ConcatenateChunks(const std::vector<ObjChunk>& chunks, std::vector<T> ObjChunk::* member,
+		const std::vector<size_t>& offsets)
+	{
+		std::vector<T> ret(offsets.back());
+		ThreadPool::GetDefault().ParallelFor(chunks.size(), [&](size_t i) {
+			const std::vector<T>& src = chunks[i].*member;
+			std::copy(src.begin(), src.end(), ret.begin() + offsets[i]);
+		});
+		return ret;
+	}
+}
+
+SourceModel ImportObj(const std::string& path, ModelLoadStats* pStats)
+{
+	using namespace DirectX;
+
+	const auto startTime = std::chrono::steady_clock::now();
+	auto pFile = std::make_shared<const MemoryMappedFile>(path);
+	const auto chunkRanges = SplitChunks(pFile->GetData(), pFile->GetSize());
+	std::vector<ObjChunk> chunks(chunkRanges.size());
+	ThreadPool::GetDefault().ParallelFor(chunks.size(), [&](size_t i) {
+		ObjChunkParser(pFile->GetData(), chunks[i]).Parse(chunkRanges[i].first, chunkRanges[i].second);
+	});
+	const auto parseEndTime = std::chrono::steady_clock::now();
+
+	// Each chunk's elements start after those of all earlier chunks
+	std::vector<size_t> offsets[eObjAttributeCount];
+	for (auto& attributeOffsets : offsets)
+	{
+		attributeOffsets.assign(chunks.size() + 1, 0);
+	}
+	bool hasTexcoords = true;
+	bool hasNormals = true;
+	size_t cornerCount = 0;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		offsets[eObjPosition][i + 1] = offsets[eObjPosition][i] + chunks[i].positions.size();
+		offsets[eObjTexcoord][i + 1] = offsets[eObjTexcoord][i] + chunks[i].texcoords.size();
+		offsets[eObjNormal][i + 1] = offsets[eObjNormal][i] + chunks[i].normals.size();
+		for (const ObjCorner& corner : chunks[i].corners)
+		{
+			hasTexcoords = hasTexcoords && corner.indices[eObjTexcoord] != NO_INDEX;
+			hasNormals = hasNormals && corner.indices[eObjNormal] != NO_INDEX;
+		}
+		cornerCount += chunks[i].corners.size();
+	}
+	for (const auto& attributeOffsets : offsets)
+	{
+		if (attributeOffsets.back() >= NO_VERTEX)
+		{
+			throw std::runtime_error("OBJ " + path + " has too many vertices");
+		}
+	}
+	// Attributes that only some faces have are dropped altogether
+	const bool useAttribute[eObjAttributeCount] = { true, hasTexcoords && cornerCount > 0, hasNormals && cornerCount > 0 };
+
+	const std::vector<XMFLOAT3> positions = ConcatenateChunks(chunks, &ObjChunk::positions, offsets[eObjPosition]);
+	const std::vector<XMFLOAT2> texcoords = ConcatenateChunks(chunks, &ObjChunk::texcoords, offsets[eObjTexcoord]);
+	const std::vector<XMFLOAT3> normals = ConcatenateChunks(chunks, &ObjChunk::normals, offsets[eObjNormal]);
+
+	// Resolve the corners to global indices and share identical vertices
+	SourceMesh mesh;
+	mesh.indices.reserve(cornerCount);
+	VertexDeduplicator vertices(positions.size());
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		for (const ObjCorner& corner : chunks[i].corners)
+		{
+			std::array<uint32_t, eObjAttributeCount> key;
+			for (uint32_t attribute = 0; attribute < eObjAttributeCount; attribute++)
+			{
+				int64_t index = corner.indices[attribute];
+				if (!useAttribute[attribute])
+				{
+					key[attribute] = NO_VERTEX;
+					continue;
+				}
+				if (corner.relativeMask & (1u << attribute))
+				{
+					index += static_cast<int64_t>(offsets[attribute][i]);
+				}
+				if (index < 0 || index >= static_cast<int64_t>(offsets[attribute].back()))
+				{
+					throw std::runtime_error("OBJ " + path + " has an index out of range");
+				}
+				key[attribute] = static_cast<uint32_t>(index);
+			}
+			mesh.indices.push_back(vertices.Insert(key));
+		}
+	}
+
+	const auto& keys = vertices.GetKeys();
+	mesh.vertexCount = static_cast<uint32_t>(keys.size());
+	std::vector<XMFLOAT3> meshPositions(keys.size());
+	std::vector<XMFLOAT2> meshTexcoords(useAttribute[eObjTexcoord] ? keys.size() : 0);
+	std::vector<XMFLOAT3> meshNormals(useAttribute[eObjNormal] ? keys.size() : 0);
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		meshPositions[i] = positions[keys[i][eObjPosition]];
+		if (useAttribute[eObjTexcoord])
+		{
+			meshTexcoords[i] = texcoords[keys[i][eObjTexcoord]];
+		}
+		if (useAttribute[eObjNormal])
+		{
+			meshNormals[i] = normals[keys[i][eObjNormal]];
+		}
+	}
+	mesh.positions = mesh.Store(std::move(meshPositions));
+	if (useAttribute[eObjNormal])
+	{
+		mesh.normals = mesh.Store(std::move(meshNormals));
+	}
+	else
+	{
+		GenerateNormals(mesh);
+	}
+	if (useAttribute[eObjTexcoord])
+	{
+		mesh.texcoords = mesh.Store(std::move(meshTexcoords));
+		GenerateTangents(mesh);
+	}
+
+	if (pStats)
+	{
+		const auto endTime = std::chrono::steady_clock::now();
+		pStats->sourceBytes = pFile->GetSize();
+		pStats->parseTime = std::chrono::duration<double>(parseEndTime - startTime).count();
+		pStats->mergeTime = std::chrono::duration<double>(endTime - parseEndTime).count();
+		pStats->parseChunkCount = chunks.size();
+		pStats->cornerCount = cornerCount;
+		pStats->mergedVertexCount = mesh.vertexCount;
+	}
+
+	SourceModel ret;
+	ret.meshes.push_back(std::move(mesh));
+	MeshInstance instance{};
+	XMStoreFloat4x4(&instance.transform, XMMatrixIdentity());
+	ret.instances.push_back(instance);
+	return ret;
+}
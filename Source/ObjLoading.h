@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+#include "MeshImport.h"
+
+// Native Wavefront OBJ importer. The file is memory-mapped and split into line-aligned chunks
+// that are parsed in parallel, then the face corners are merged into a single mesh with
+// identical vertices shared. Groups, objects and materials are ignored, and missing normals
+// are generated. If pStats is given, the parse and merge fields of it are filled in.
+SourceModel ImportObj(const std::string& path, ModelLoadStats* pStats = nullptr);
@@ -1,10 +1,42 @@
 #include "Resources.h"
 
-#include <stb_image.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <mutex>
+
+#include "Hash.h"
+#include "TextureProcessing.h"
+#include "ThreadPool.h"
 
 namespace
 {
 	constexpr float ANISOTROPY = 8.0f;
+	// Size of the bindless texture table
+	constexpr uint32_t MAX_TEXTURE_COUNT = 128;
+	// Size of the bounds buffer, 1 MB being enough for tens of thousands of meshes
+	constexpr uint32_t BOUNDS_BUFFER_SIZE = 1048576;
+	// Streamed textures always keep the levels of at most this size resident
+	constexpr uint32_t STREAMING_TAIL_SIZE = 64;
+	// Uploads of newly needed levels are spread over frames beyond this much data per frame
+	constexpr uint64_t STREAMING_UPLOAD_BYTES_PER_FRAME = 16 * 1024 * 1024;
+	// Textures shrink once the device-local heaps are within a tenth of their budget
+	constexpr uint64_t DEVICE_BUDGET_HEADROOM_DIVISOR = 10;
+	// Size of the persistently mapped buffer that uploads are staged in
+	constexpr vk::DeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024;
+	// Staged data is aligned for the texel blocks of any format, which copies to images require
+	constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+
+	// Key of a texture file in the texture cache. The same file can be reached by different
+	// spellings of its path.
+	std::string GetTextureKey(const std::string& filename, bool linear, bool generateMips)
+	{
+		return std::filesystem::path(filename).lexically_normal().generic_string()
+			+ (linear ? "|linear" : "|srgb") + (generateMips ? "|mips" : "");
+	}
 
 	// Immutable Samplers
 	constexpr std::array<vk::SamplerCreateInfo, 24> g_samplers = {
@@ -343,21 +375,109 @@ UniqueAllocatedImage::~UniqueAllocatedImage()
 	}
 }
 
+StagingRing::StagingRing(VmaAllocator allocator, vk::DeviceSize size, vk::Semaphore timeline) :
+	m_allocator(allocator), m_timeline(timeline), m_pData(nullptr), m_size(size), m_head(0), m_tail(0)
+{
+	// Wrapping around keeps allocations aligned only if the size is too
+	assert(size % STAGING_ALIGNMENT == 0);
+
+	vk::BufferCreateInfo bufferInfo({}, size, vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive);
+	AllocationCreateInfo allocationInfo(VMA_ALLOCATION_CREATE_MAPPED_BIT
+		| VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, VMA_MEMORY_USAGE_AUTO);
+	VmaAllocationInfo resultInfo{};
+	m_buffer = UniqueAllocatedBuffer(allocator, bufferInfo, allocationInfo, &resultInfo);
+	m_pData = static_cast<char*>(resultInfo.pMappedData);
+	assert(m_pData);
+}
+
+StagingAllocation StagingRing::Allocate(const vk::Device& device, const void* pSrcData, vk::DeviceSize size,
+	uint64_t timelineValue)
+{
+	// Allocations start aligned and never wrap around the end of the buffer
+	auto getStart = [&]() {
+		uint64_t start = (m_head + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+		if (start % m_size + size > m_size)
+		{
+			start += m_size - start % m_size;
+		}
+		return start;
+	};
+
+	if (size <= m_size)
+	{
+		Reclaim(device);
+		uint64_t start = getStart();
+		// Only submissions before this one can be waited for, since this one hasn't been submitted
+		while (start + size - m_tail > m_size && m_regions.front().timelineValue < timelineValue)
+		{
+			vk::SemaphoreWaitInfo waitInfo({}, m_timeline, m_regions.front().timelineValue);
+			ThrowIfFailed(device.waitSemaphores(waitInfo, UINT64_MAX));
+			Reclaim(device);
+			start = getStart();
+		}
+
+		if (start + size - m_tail <= m_size)
+		{
+			const vk::DeviceSize offset = start % m_size;
+			memcpy(m_pData + offset, pSrcData, size);
+			ThrowIfFailed(vmaFlushAllocation(m_allocator, m_buffer.GetAllocation(), offset, size));
+			m_head = start + size;
+			if (!m_regions.empty() && m_regions.back().timelineValue == timelineValue
+				&& !m_regions.back().dedicatedBuffer)
+			{
+				m_regions.back().end = m_head;
+			}
+			else
+			{
+				m_regions.push_back({ m_head, timelineValue, UniqueAllocatedBuffer() });
+			}
+			return { m_buffer.GetBuffer(), offset };
+		}
+	}
+
+	vk::BufferCreateInfo bufferInfo({}, size, vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive);
+	AllocationCreateInfo allocationInfo(VMA_ALLOCATION_CREATE_MAPPED_BIT
+		| VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, VMA_MEMORY_USAGE_AUTO);
+	VmaAllocationInfo resultInfo{};
+	UniqueAllocatedBuffer buffer(m_allocator, bufferInfo, allocationInfo, &resultInfo);
+	memcpy(resultInfo.pMappedData, pSrcData, size);
+	ThrowIfFailed(vmaFlushAllocation(m_allocator, buffer.GetAllocation(), 0, size));
+	const vk::Buffer ret = buffer.GetBuffer();
+	m_regions.push_back({ m_head, timelineValue, std::move(buffer) });
+	return { ret, 0 };
+}
+
+void StagingRing::Reclaim(const vk::Device& device)
+{
+	const uint64_t completedValue = device.getSemaphoreCounterValue(m_timeline);
+	while (!m_regions.empty() && m_regions.front().timelineValue <= completedValue)
+	{
+		m_tail = m_regions.front().end;
+		m_regions.pop_front();
+	}
+
+	// Once nothing is in use, start again from the beginning of the buffer
+	if (m_regions.empty())
+	{
+		m_head = 0;
+		m_tail = 0;
+	}
+}
+
 ResourceManager::ResourceManager(const vk::Device& device, VmaAllocator allocator, 
 	const vk::Queue queue, uint32_t queueIdx) :
-	m_queue(queue), m_lastVertexOffset(0), m_lastIndexOffset(0), m_allocator(allocator)
+	m_queue(queue), m_lastVertexOffset(0), m_lastIndexOffset(0), m_lastBoundsOffset(0), m_uploadTimelineValue(0),
+	m_allocator(allocator), m_frameCount(0)
 {
-	// Create the fence
-	vk::FenceCreateInfo fenceInfo;
-	m_transferFence = device.createFenceUnique(fenceInfo);
-
-	// Create the command pool
+	// Create the command pool. Upload command buffers are allocated from it as needed.
 	vk::CommandPoolCreateInfo poolInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, queueIdx);
 	m_commandPool = device.createCommandPoolUnique(poolInfo);
 
-	// Create the command buffer
-	vk::CommandBufferAllocateInfo commandInfo(*m_commandPool, vk::CommandBufferLevel::ePrimary, 1);
-	m_commandBuffer = std::move(device.allocateCommandBuffersUnique(commandInfo)[0]);
+	// Create the staging ring and the timeline its space is reclaimed by
+	vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> semaphoreInfo(
+		vk::SemaphoreCreateInfo(), vk::SemaphoreTypeCreateInfo(vk::SemaphoreType::eTimeline, 0));
+	m_uploadTimeline = device.createSemaphoreUnique(semaphoreInfo.get<vk::SemaphoreCreateInfo>());
+	m_stagingRing = StagingRing(m_allocator, STAGING_RING_SIZE, *m_uploadTimeline);
 
 	// 32 MB buffer
 	constexpr size_t bufferSize = 33554432;
@@ -373,6 +493,11 @@ ResourceManager::ResourceManager(const vk::Device& device, VmaAllocator allocato
 	bufferInfo.usage = vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst;
 	m_indexBuffer = UniqueAllocatedBuffer(m_allocator, bufferInfo, allocationInfo);
 
+	// Create a small bounds buffer
+	bufferInfo.size = BOUNDS_BUFFER_SIZE;
+	bufferInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+	m_boundsBuffer = UniqueAllocatedBuffer(m_allocator, bufferInfo, allocationInfo);
+
 	// Create per-frame double-buffered resources
 	for (auto& frame : m_frameResources)
 	{
@@ -391,9 +516,9 @@ ResourceManager::ResourceManager(const vk::Device& device, VmaAllocator allocato
 
 void ResourceManager::SetUpDescriptors(const vk::Device& device)
 {
-	constexpr uint32_t MAX_BINDING = 128;
+	constexpr uint32_t MAX_BINDING = MAX_TEXTURE_COUNT;
 	constexpr uint32_t N_UNIFORM_BUFFERS = 1;
-	constexpr uint32_t N_STORAGE_BUFFERS = 3;
+	constexpr uint32_t N_STORAGE_BUFFERS = 4;
 
 	// Convert vk::UniqueSampler vector to vk::Sampler vector
 	std::vector<vk::Sampler> samplers;
@@ -402,7 +527,7 @@ void ResourceManager::SetUpDescriptors(const vk::Device& device)
 		samplers.push_back(*uniqueSampler);
 	}
 
-	std::array<vk::DescriptorSetLayoutBinding, 6> layoutBindings = {
+	std::array<vk::DescriptorSetLayoutBinding, 7> layoutBindings = {
 		// Global Constants
 		vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAll),
 		// Vertex Data
@@ -411,12 +536,15 @@ void ResourceManager::SetUpDescriptors(const vk::Device& device)
 		vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eAll),
 		// Transform Data
 		vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eAll),
+		// Mesh Bounds
+		vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eAll),
 		// Immutable Samplers
-		vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eSampler, vk::ShaderStageFlagBits::eAll, samplers),
+		vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eSampler, vk::ShaderStageFlagBits::eAll, samplers),
 		// Bindless Textures
-		vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eSampledImage, MAX_BINDING, vk::ShaderStageFlagBits::eAll),
+		vk::DescriptorSetLayoutBinding(6, vk::DescriptorType::eSampledImage, MAX_BINDING, vk::ShaderStageFlagBits::eAll),
 	};
-	std::array<vk::DescriptorBindingFlags, 6> layoutBindingFlags = {
+	std::array<vk::DescriptorBindingFlags, 7> layoutBindingFlags = {
+		vk::DescriptorBindingFlags(),
 		vk::DescriptorBindingFlags(),
 		vk::DescriptorBindingFlags(),
 		vk::DescriptorBindingFlags(),
@@ -464,10 +592,12 @@ void ResourceManager::SetUpDescriptors(const vk::Device& device)
 		vk::DescriptorBufferInfo vertexBufferInfo(m_vertexBuffer.GetBuffer(), 0, VK_WHOLE_SIZE);
 		vk::DescriptorBufferInfo materialBufferInfo(frame.materialBuffer.GetBuffer(), 0, VK_WHOLE_SIZE);
 		vk::DescriptorBufferInfo transformBufferInfo(frame.transformBuffer.GetBuffer(), 0, VK_WHOLE_SIZE);
-		std::array<vk::WriteDescriptorSet, 3> storageBufferWrites = {
+		vk::DescriptorBufferInfo boundsBufferInfo(m_boundsBuffer.GetBuffer(), 0, VK_WHOLE_SIZE);
+		std::array<vk::WriteDescriptorSet, 4> storageBufferWrites = {
 			vk::WriteDescriptorSet(set, 1, 0, vk::DescriptorType::eStorageBuffer, {}, vertexBufferInfo),
 			vk::WriteDescriptorSet(set, 2, 0, vk::DescriptorType::eStorageBuffer, {}, materialBufferInfo),
-			vk::WriteDescriptorSet(set, 3, 0, vk::DescriptorType::eStorageBuffer, {}, transformBufferInfo)
+			vk::WriteDescriptorSet(set, 3, 0, vk::DescriptorType::eStorageBuffer, {}, transformBufferInfo),
+			vk::WriteDescriptorSet(set, 4, 0, vk::DescriptorType::eStorageBuffer, {}, boundsBufferInfo)
 		};
 		device.updateDescriptorSets(storageBufferWrites, {});
 	}
@@ -508,183 +638,926 @@ ResourceManager::FrameResources::FrameResources(VmaAllocator allocator) :
 uint32_t ResourceManager::CreateVertices(const vk::Device& device, 
 	const void* pSrcData, uint32_t size) const
 {
-	auto stagingBuffer = UploadStaging(device, pSrcData, size);
-	UploadBuffer(device, stagingBuffer.GetBuffer(), m_vertexBuffer.GetBuffer(), m_lastVertexOffset, size);
-	uint32_t ret = m_lastVertexOffset;
+	const uint64_t hash = Hash64(pSrcData, size);
+	uint32_t ret;
+	if (FindGeometry(m_vertexBlocks, hash, size, ret))
+	{
+		return ret;
+	}
+
+	StagingAllocation staging = UploadStaging(device, pSrcData, size);
+	UploadBuffer(device, staging, m_vertexBuffer.GetBuffer(), m_lastVertexOffset, size);
+	ret = m_lastVertexOffset;
 	m_lastVertexOffset += size;
+	AddGeometry(m_vertexBlocks, hash, size, ret);
 	return ret;
 }
 
 uint32_t ResourceManager::CreateIndices(const vk::Device& device, 
-	const void* pSrcData, uint32_t size) const
+	const uint32_t* pIndices, uint32_t indexCount, vk::IndexType type) const
+{
+	std::vector<uint16_t> narrowIndices;
+	const void* pSrcData = pIndices;
+	uint32_t size = indexCount * sizeof(uint32_t);
+	if (type == vk::IndexType::eUint16)
+	{
+		narrowIndices.resize(indexCount);
+		for (uint32_t i = 0; i < indexCount; i++)
+		{
+			assert(pIndices[i] <= UINT16_MAX);
+			narrowIndices[i] = static_cast<uint16_t>(pIndices[i]);
+		}
+		pSrcData = narrowIndices.data();
+		size = indexCount * sizeof(uint16_t);
+	}
+
+	// The narrowed bytes are what get hashed. Every range is aligned for either index type, so
+	// a match can be bound whichever type it was first uploaded as.
+	const uint64_t hash = Hash64(pSrcData, size);
+	uint32_t ret;
+	if (FindGeometry(m_indexBlocks, hash, size, ret))
+	{
+		return ret;
+	}
+
+	StagingAllocation staging = UploadStaging(device, pSrcData, size);
+	UploadBuffer(device, staging, m_indexBuffer.GetBuffer(), m_lastIndexOffset, size);
+	ret = m_lastIndexOffset;
+	// Keep every range 4-byte aligned, so that either index type can be bound at its offset
+	m_lastIndexOffset += (size + 3) & ~3u;
+	AddGeometry(m_indexBlocks, hash, size, ret);
+	return ret;
+}
+
+bool ResourceManager::FindGeometry(const GeometryTable& table, uint64_t hash, uint32_t size, uint32_t& offset) const
+{
+	// Contents aren't compared byte for byte, which would need a CPU copy of both heaps. A
+	// 64-bit hash makes a collision between different contents vanishingly unlikely, and the
+	// size check catches the most common way one could still happen.
+	auto it = table.find(hash);
+	if (it == table.end() || it->second.size != size)
+	{
+		return false;
+	}
+	m_geometryStats.savedBytes += size;
+	m_geometryStats.dedupCount++;
+	offset = it->second.offset;
+	return true;
+}
+
+void ResourceManager::AddGeometry(GeometryTable& table, uint64_t hash, uint32_t size, uint32_t offset) const
+{
+	// On a hash collision the new block simply isn't shareable
+	table.emplace(hash, GeometryBlock{ offset, size });
+	m_geometryStats.uploadedBytes += size;
+	m_geometryStats.uploadCount++;
+}
+
+uint32_t ResourceManager::CreateBounds(const vk::Device& device, const MeshBounds& bounds) const
+{
+	if (m_lastBoundsOffset + sizeof(bounds) > BOUNDS_BUFFER_SIZE)
+	{
+		throw std::runtime_error("Out of space in the bounds buffer");
+	}
+
+	StagingAllocation staging = UploadStaging(device, &bounds, sizeof(bounds));
+	UploadBuffer(device, staging, m_boundsBuffer.GetBuffer(), m_lastBoundsOffset, sizeof(bounds));
+	uint32_t ret = m_lastBoundsOffset;
+	m_lastBoundsOffset += sizeof(bounds);
+	return ret;
+}
+
+uint32_t ResourceManager::CreateTransform(const void* pSrcData, uint32_t size) const
 {
-	auto stagingBuffer = UploadStaging(device, pSrcData, size);
-	UploadBuffer(device, stagingBuffer.GetBuffer(), m_indexBuffer.GetBuffer(), m_lastIndexOffset, size);
-	uint32_t ret = m_lastIndexOffset;
-	m_lastIndexOffset += size;
+	// Transforms are written by the CPU every frame, so every frame's buffer has a copy
+	uint32_t ret = m_frameResources[0].lastTransformOffset;
+	for (auto& frame : m_frameResources)
+	{
+		assert(frame.lastTransformOffset == ret);
+		memcpy(static_cast<char*>(frame.pTransformBufferData) + ret, pSrcData, size);
+		frame.lastTransformOffset += size;
+	}
 	return ret;
 }
 
 uint32_t ResourceManager::CreateTexture(const vk::Device& device, const std::string& filename, 
 	bool linear, bool generateMips)
 {
-	uint32_t textureIdx = m_textures.size();
+	const std::string key = GetTextureKey(filename, linear, generateMips);
+	auto it = m_texturesByKey.find(key);
+	if (it != m_texturesByKey.end())
+	{
+		m_textureRefCounts[it->second]++;
+		return it->second;
+	}
 
-	// Load image from file
-	int width, height, channels;
-	auto* pixels = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-	if (!pixels)
+	uint32_t textureIdx = CreateTexture(device, LoadTextureData(filename), linear, generateMips);
+	m_texturesByKey.emplace(key, textureIdx);
+	m_textureKeys[textureIdx] = key;
+	return textureIdx;
+}
+
+void ResourceManager::ReleaseTexture(uint32_t textureIdx)
+{
+	assert(textureIdx < m_textureRefCounts.size() && m_textureRefCounts[textureIdx] > 0);
+	if (--m_textureRefCounts[textureIdx] > 0)
+	{
+		return;
+	}
+
+	if (!m_textureKeys[textureIdx].empty())
+	{
+		m_texturesByKey.erase(m_textureKeys[textureIdx]);
+		m_textureKeys[textureIdx].clear();
+	}
+	// An upload still in flight is left to finish, and then dropped instead of swapped in
+	m_streamedTextures.erase(textureIdx);
+	for (auto& upload : m_textureUploads)
+	{
+		if (upload.textureIdx == textureIdx)
+		{
+			upload.textureIdx = INVALID_TEXTURE;
+		}
+	}
+
+	// Frames already recorded may still sample the image, so it is freed with the other
+	// replaced images, and the slot with it. The descriptor is left as it is until then.
+	m_retiredTextures.push_back({ std::move(m_textures[textureIdx]), std::move(m_textureViews[textureIdx]),
+		m_frameCount, textureIdx });
+}
+
+uint32_t ResourceManager::CreateTexture(const vk::Device& device, const TextureData& data,
+	bool linear, bool generateMips)
+{
+	StagedTexture staged = StageTexture(device, data, linear, generateMips);
+	try
+	{
+		UploadImage(device, staged.stagingBuffer, m_textures[staged.textureIdx].GetImage(), staged.copyRegions);
+	}
+	catch (...)
+	{
+		ReleaseTexture(staged.textureIdx);
+		throw;
+	}
+	QueueTextureDescriptorWrites(staged.textureIdx);
+	return staged.textureIdx;
+}
+
+std::vector<uint32_t> ResourceManager::CreateTextures(const vk::Device& device,
+	const std::vector<std::string>& filenames, bool linear, bool generateMips)
+{
+	std::vector<uint32_t> ret(filenames.size(), INVALID_TEXTURE);
+
+	// Files that are already cached, or repeated within the batch, aren't loaded again
+	std::vector<std::string> keys;
+	std::vector<size_t> loads;
+	std::unordered_map<std::string, size_t> firstLoads;
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		keys.push_back(GetTextureKey(filenames[i], linear, generateMips));
+		auto it = m_texturesByKey.find(keys[i]);
+		if (it != m_texturesByKey.end())
+		{
+			m_textureRefCounts[it->second]++;
+			ret[i] = it->second;
+		}
+		else if (firstLoads.emplace(keys[i], i).second)
+		{
+			loads.push_back(i);
+		}
+	}
+
+	// Decode and build mips on the worker pool. Each load reports itself done, successfully or
+	// not, so the images can be staged in the order they finish.
+	struct Completions
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::vector<size_t> done;
+	} completions;
+	std::vector<std::future<TextureData>> results;
+	for (size_t i = 0; i < loads.size(); i++)
 	{
-		throw std::runtime_error("Error loading image: " + filename);
+		results.push_back(ThreadPool::GetDefault().Submit([&, i]() {
+			struct Notify
+			{
+				~Notify()
+				{
+					std::lock_guard lock(pCompletions->mutex);
+					pCompletions->done.push_back(index);
+					pCompletions->condition.notify_one();
+				}
+				Completions* pCompletions;
+				size_t index;
+			} notify{ &completions, i };
+
+			TextureData data = LoadTextureData(filenames[loads[i]]);
+			if (generateMips && data.format == VK_FORMAT_UNDEFINED && data.mipOffsets.size() == 1)
+			{
+				GenerateMipChain(data, linear);
+			}
+			return data;
+		}));
 	}
-	size_t size = 4ull * width * height;
 
-	// Mip-map generation logic
+	// Every image goes into one upload batch, unless the caller already has one open
+	const bool ownBatch = !m_uploadBatch.open;
+	if (ownBatch)
+	{
+		BeginUploadBatch();
+	}
+	std::vector<StagedTexture> staged;
+	std::exception_ptr error;
+	for (size_t finished = 0; finished < loads.size(); finished++)
+	{
+		size_t i;
+		{
+			std::unique_lock lock(completions.mutex);
+			completions.condition.wait(lock, [&]() { return !completions.done.empty(); });
+			i = completions.done.back();
+			completions.done.pop_back();
+		}
+
+		try
+		{
+			staged.push_back(StageTexture(device, results[i].get(), linear, generateMips));
+			// Recorded before the upload, so that the slot is released if it fails
+			ret[loads[i]] = staged.back().textureIdx;
+			UploadImage(device, staged.back().stagingBuffer,
+				m_textures[staged.back().textureIdx].GetImage(), staged.back().copyRegions);
+		}
+		catch (...)
+		{
+			// Keep going, so that no load is still running when this returns
+			if (!error)
+			{
+				error = std::current_exception();
+			}
+		}
+	}
+
+	if (ownBatch)
+	{
+		EndUploadBatch(device, false);
+	}
+
+	for (const auto& texture : staged)
+	{
+		QueueTextureDescriptorWrites(texture.textureIdx);
+	}
+
+	// The batch succeeds or fails as a whole
+	if (error)
+	{
+		for (uint32_t textureIdx : ret)
+		{
+			if (textureIdx != INVALID_TEXTURE)
+			{
+				ReleaseTexture(textureIdx);
+			}
+		}
+		std::rethrow_exception(error);
+	}
+
+	for (size_t i : loads)
+	{
+		m_texturesByKey.emplace(keys[i], ret[i]);
+		m_textureKeys[ret[i]] = keys[i];
+	}
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		if (ret[i] == INVALID_TEXTURE)
+		{
+			ret[i] = ret[firstLoads.at(keys[i])];
+			m_textureRefCounts[ret[i]]++;
+		}
+	}
+	return ret;
+}
+
+ResourceManager::StagedTexture ResourceManager::StageTexture(const vk::Device& device, const TextureData& data,
+	bool linear, bool generateMips)
+{
+	assert(!data.mipOffsets.empty());
+
+	// Decoded RGBA images get their mip chain built on the CPU, filtered in the right color space
+	// and uploaded in the same copy as the base level. Textures with a format of their own
+	// (KTX2 or pre-compressed) are uploaded as stored, with whatever mip levels they have.
+	const bool storedFormat = data.format != VK_FORMAT_UNDEFINED;
+	TextureData mipChain;
+	if (generateMips && !storedFormat && data.mipOffsets.size() == 1)
+	{
+		mipChain = data;
+		GenerateMipChain(mipChain, linear);
+	}
+	const TextureData& image = mipChain.pixels.empty() ? data : mipChain;
+
+	const uint32_t width = image.width;
+	const uint32_t height = image.height;
+	size_t size = image.pixels.size();
+	vk::Format format = storedFormat ? static_cast<vk::Format>(image.format)
+		: (linear ? vk::Format::eR8G8B8A8Unorm : vk::Format::eR8G8B8A8Srgb);
+	const uint32_t mipLevels = static_cast<uint32_t>(image.mipOffsets.size());
 	vk::ImageUsageFlags imageUsage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
-	uint32_t mipLevels = 1;
-	if (generateMips)
+
+	UniqueAllocatedImage textureImage;
+	vk::UniqueImageView textureView;
+	CreateTextureImage(device, format, width, height, mipLevels, imageUsage, textureImage, textureView);
+
+	StagedTexture ret;
+	StagingAllocation staging = UploadStaging(device, image.pixels.data(), size);
+	ret.stagingBuffer = staging.buffer;
+
+	// The slot is only taken once nothing else can fail, so that it can't leak
+	ret.textureIdx = AllocateTextureSlot();
+	m_textures[ret.textureIdx] = std::move(textureImage);
+	m_textureViews[ret.textureIdx] = std::move(textureView);
+
+	// One copy region per mip level
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, level, 0, 1);
+		vk::Extent3D extent(std::max(width >> level, 1u), std::max(height >> level, 1u), 1);
+		ret.copyRegions.push_back(vk::BufferImageCopy(staging.offset + image.mipOffsets[level], 0, 0,
+			subresource, vk::Offset3D(), extent));
+	}
+	return ret;
+}
+
+uint32_t ResourceManager::CreateStreamedTexture(const vk::Device& device, std::shared_ptr<const TextureData> data,
+	bool linear)
+{
+	assert(data && !data->mipOffsets.empty());
+	if (data->format == VK_FORMAT_UNDEFINED && data->mipOffsets.size() == 1)
+	{
+		auto mipChain = std::make_shared<TextureData>(*data);
+		GenerateMipChain(*mipChain, linear);
+		data = std::move(mipChain);
+	}
+
+	StreamedTexture texture;
+	texture.source = std::move(data);
+	texture.format = texture.source->format != VK_FORMAT_UNDEFINED ? static_cast<vk::Format>(texture.source->format)
+		: (linear ? vk::Format::eR8G8B8A8Unorm : vk::Format::eR8G8B8A8Srgb);
+	texture.levelCount = static_cast<uint32_t>(texture.source->mipOffsets.size());
+	texture.tailLevel = 0;
+	while (texture.tailLevel + 1 < texture.levelCount
+		&& std::max(texture.source->width, texture.source->height) >> texture.tailLevel > STREAMING_TAIL_SIZE)
+	{
+		texture.tailLevel++;
+	}
+	// Nothing is resident yet
+	texture.residentLevel = texture.levelCount;
+	texture.targetLevel = texture.levelCount;
+	texture.requestedLevel = texture.tailLevel;
+	texture.lastRequestFrame = m_frameCount;
+
+	uint32_t textureIdx = AllocateTextureSlot();
+	m_streamedTextures.emplace(textureIdx, std::move(texture));
+
+	// The mip tail is small, so wait for it here rather than leave the slot unbound
+	BeginTextureUpload(device, textureIdx, m_streamedTextures.at(textureIdx).tailLevel);
+	TextureUpload& upload = m_textureUploads.back();
+	ThrowIfFailed(device.waitForFences(*upload.fence, true, UINT64_MAX));
+	FinishTextureUpload(device, upload);
+	m_textureUploads.pop_back();
+	return textureIdx;
+}
+
+void ResourceManager::RequestTextureResolution(uint32_t textureIdx, float screenSize)
+{
+	auto it = m_streamedTextures.find(textureIdx);
+	if (it == m_streamedTextures.end())
+	{
+		return;
+	}
+
+	// Each level down halves the resolution, so the level that maps about one texel to each
+	// pixel is the log of the ratio
+	StreamedTexture& texture = it->second;
+	const float size = static_cast<float>(std::max(texture.source->width, texture.source->height));
+	uint32_t level = 0;
+	if (screenSize < size)
+	{
+		level = std::min(static_cast<uint32_t>(std::log2(size / std::max(screenSize, 1.0f))), texture.tailLevel);
+	}
+	texture.requestedLevel = std::min(texture.requestedLevel, level);
+	texture.lastRequestFrame = m_frameCount;
+}
+
+void ResourceManager::UpdateTextureStreaming(const vk::Device& device)
+{
+	// Lets VMA refresh the heap budgets it reports once per frame
+	vmaSetCurrentFrameIndex(m_allocator, static_cast<uint32_t>(m_frameCount));
+
+	// Dedicated staging buffers would otherwise only be freed by the next upload
+	m_stagingRing.Reclaim(device);
+
+	// Swap in the replacement images whose uploads have finished, unless their texture has
+	// been released in the meantime
+	for (size_t i = 0; i < m_textureUploads.size();)
+	{
+		if (device.getFenceStatus(*m_textureUploads[i].fence) == vk::Result::eSuccess)
+		{
+			if (m_textureUploads[i].textureIdx != INVALID_TEXTURE)
+			{
+				FinishTextureUpload(device, m_textureUploads[i]);
+			}
+			m_textureUploads.erase(m_textureUploads.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	// Frames are only recorded once the one BACK_BUFFER_COUNT frames earlier has finished, so
+	// by then nothing can sample an image replaced before it, or a slot released before it
+	while (!m_retiredTextures.empty() && m_retiredTextures.front().frame + BACK_BUFFER_COUNT <= m_frameCount)
+	{
+		if (m_retiredTextures.front().releasedSlot != INVALID_TEXTURE)
+		{
+			m_freeTextureSlots.push_back(m_retiredTextures.front().releasedSlot);
+		}
+		m_retiredTextures.pop_front();
+	}
+
+	// Consume this frame's requests, and total the memory committed to streamed textures
+	struct Request
+	{
+		uint32_t textureIdx;
+		uint32_t level;
+	};
+	std::vector<Request> streamIn;
+	std::vector<Request> excess;
+	uint64_t committedBytes = 0;
+	for (auto& [textureIdx, texture] : m_streamedTextures)
+	{
+		const uint32_t wantedLevel = texture.requestedLevel;
+		texture.requestedLevel = texture.tailLevel;
+		committedBytes += GetStreamedBytes(texture, texture.targetLevel);
+		if (texture.targetLevel != texture.residentLevel)
+		{
+			continue;
+		}
+		if (wantedLevel < texture.residentLevel)
+		{
+			streamIn.push_back({ textureIdx, wantedLevel });
+		}
+		else if (wantedLevel > texture.residentLevel)
+		{
+			excess.push_back({ textureIdx, wantedLevel });
+		}
+	}
+	m_textureStreamingStats.residentBytes = committedBytes;
+
+	// When the device runs short of memory, shrink the least recently used textures: ones that
+	// weren't drawn this frame go down to their mip tail, the rest a level at a time
+	const uint64_t budgetBytes = GetTextureStreamingBudget(committedBytes);
+	if (committedBytes > budgetBytes)
+	{
+		std::vector<uint32_t> demotions;
+		for (const auto& [textureIdx, texture] : m_streamedTextures)
+		{
+			if (texture.targetLevel == texture.residentLevel && texture.residentLevel < texture.tailLevel)
+			{
+				demotions.push_back(textureIdx);
+			}
+		}
+		std::sort(demotions.begin(), demotions.end(), [this](uint32_t a, uint32_t b) {
+			return m_streamedTextures.at(a).lastRequestFrame < m_streamedTextures.at(b).lastRequestFrame;
+		});
+		for (uint32_t textureIdx : demotions)
+		{
+			if (committedBytes <= budgetBytes)
+			{
+				break;
+			}
+			StreamedTexture& texture = m_streamedTextures.at(textureIdx);
+			const uint32_t level = texture.lastRequestFrame == m_frameCount ? texture.residentLevel + 1 : texture.tailLevel;
+			committedBytes -= GetStreamedBytes(texture, texture.residentLevel) - GetStreamedBytes(texture, level);
+			BeginTextureUpload(device, textureIdx, level);
+			m_textureStreamingStats.evictionCount++;
+		}
+	}
+
+	// Textures furthest from the resolution they need go first
+	std::sort(streamIn.begin(), streamIn.end(), [this](const Request& a, const Request& b) {
+		return m_streamedTextures.at(a.textureIdx).residentLevel - a.level
+			> m_streamedTextures.at(b.textureIdx).residentLevel - b.level;
+	});
+	// The least recently needed textures are evicted first
+	std::sort(excess.begin(), excess.end(), [this](const Request& a, const Request& b) {
+		return m_streamedTextures.at(a.textureIdx).lastRequestFrame < m_streamedTextures.at(b.textureIdx).lastRequestFrame;
+	});
+
+	uint64_t uploadBytes = 0;
+	size_t nextEviction = 0;
+	for (const auto& request : streamIn)
+	{
+		StreamedTexture& texture = m_streamedTextures.at(request.textureIdx);
+		if (texture.targetLevel != texture.residentLevel)
+		{
+			continue;
+		}
+		const uint64_t addedBytes = GetStreamedBytes(texture, request.level) - GetStreamedBytes(texture, texture.residentLevel);
+
+		// Spread large uploads over several frames, but always let one through
+		if (uploadBytes > 0 && uploadBytes + addedBytes > STREAMING_UPLOAD_BYTES_PER_FRAME)
+		{
+			break;
+		}
+
+		// Make room by dropping detail that nothing needs anymore. Unless that is enough, this
+		// texture and the less urgent ones after it wait.
+		while (committedBytes + addedBytes > budgetBytes && nextEviction < excess.size())
+		{
+			const Request& eviction = excess[nextEviction++];
+			StreamedTexture& evicted = m_streamedTextures.at(eviction.textureIdx);
+			if (evicted.targetLevel != evicted.residentLevel)
+			{
+				continue;
+			}
+			committedBytes -= GetStreamedBytes(evicted, evicted.residentLevel) - GetStreamedBytes(evicted, eviction.level);
+			BeginTextureUpload(device, eviction.textureIdx, eviction.level);
+			m_textureStreamingStats.evictionCount++;
+		}
+		if (committedBytes + addedBytes > budgetBytes)
+		{
+			break;
+		}
+
+		BeginTextureUpload(device, request.textureIdx, request.level);
+		committedBytes += addedBytes;
+		uploadBytes += addedBytes;
+		m_textureStreamingStats.streamInCount++;
+	}
+}
+
+uint64_t ResourceManager::GetTextureStreamingBudget(uint64_t committedBytes)
+{
+	// VMA's budget reflects what the driver will let this process keep in each heap without
+	// paging, accounting for other processes too. Usage covers every allocation, not just
+	// streamed textures, so it limits how much streaming may grow or forces it to shrink.
+	const VkPhysicalDeviceMemoryProperties* pMemoryProperties;
+	vmaGetMemoryProperties(m_allocator, &pMemoryProperties);
+	std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> heapBudgets{};
+	vmaGetHeapBudgets(m_allocator, heapBudgets.data());
+
+	uint64_t deviceUsage = 0;
+	uint64_t deviceBudget = 0;
+	for (uint32_t i = 0; i < pMemoryProperties->memoryHeapCount; i++)
+	{
+		if (pMemoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+		{
+			deviceUsage += heapBudgets[i].usage;
+			deviceBudget += heapBudgets[i].budget;
+		}
+	}
+	m_textureStreamingStats.deviceUsageBytes = deviceUsage;
+	m_textureStreamingStats.deviceBudgetBytes = deviceBudget;
+
+	// Images that are replaced or released still count towards the usage until they are freed,
+	// and so does the image an upload in flight replaces. Neither is part of committedBytes, and
+	// both go away on their own, so they mustn't cause further demotions in the meantime.
+	auto getAllocationSize = [this](const UniqueAllocatedImage& image) -> uint64_t {
+		if (!image.GetAllocation())
+		{
+			return 0;
+		}
+		VmaAllocationInfo info;
+		vmaGetAllocationInfo(m_allocator, image.GetAllocation(), &info);
+		return info.size;
+	};
+	uint64_t outgoingBytes = 0;
+	for (const auto& retired : m_retiredTextures)
+	{
+		outgoingBytes += getAllocationSize(retired.image);
+	}
+	for (const auto& upload : m_textureUploads)
+	{
+		// The image of an upload whose texture was released is dropped once it finishes
+		outgoingBytes += getAllocationSize(upload.textureIdx != INVALID_TEXTURE
+			? m_textures[upload.textureIdx] : upload.image);
+	}
+	deviceUsage -= std::min(deviceUsage, outgoingBytes);
+
+	// Keep some headroom for allocations that can't wait for textures to shrink, such as
+	// recreating the render targets on resize
+	const uint64_t deviceLimit = deviceBudget - deviceBudget / DEVICE_BUDGET_HEADROOM_DIVISOR;
+	uint64_t ret = m_textureStreamingStats.budgetBytes;
+	if (deviceUsage > deviceLimit)
+	{
+		const uint64_t excessBytes = deviceUsage - deviceLimit;
+		ret = std::min(ret, committedBytes > excessBytes ? committedBytes - excessBytes : 0);
+	}
+	else
+	{
+		ret = std::min(ret, committedBytes + (deviceLimit - deviceUsage));
+	}
+	return ret;
+}
+
+void ResourceManager::BeginTextureUpload(const vk::Device& device, uint32_t textureIdx, uint32_t level)
+{
+	// This is submitted separately from any open batch. The batch's copies go first, so that
+	// the staged data of each submission is tagged with its own timeline value.
+	FlushUploadBatch(device);
+
+	StreamedTexture& texture = m_streamedTextures.at(textureIdx);
+	const TextureData& source = *texture.source;
+	const vk::Image oldImage = m_textures[textureIdx].GetImage();
+	const uint32_t copiedLevel = std::max(level, texture.residentLevel);
+
+	TextureUpload upload;
+	upload.textureIdx = textureIdx;
+	CreateTextureImage(device, texture.format, std::max(source.width >> level, 1u), std::max(source.height >> level, 1u),
+		texture.levelCount - level, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst
+		| vk::ImageUsageFlagBits::eSampled, upload.image, upload.view);
+	const vk::Image newImage = upload.image.GetImage();
+
+	// Levels finer than the resident ones come from the CPU copy, which stores them contiguously
+	StagingAllocation staging{};
+	if (level < copiedLevel)
+	{
+		staging = UploadStaging(device, source.pixels.data() + source.mipOffsets[level],
+			GetStreamedBytes(texture, level) - GetStreamedBytes(texture, copiedLevel));
+	}
+	std::vector<vk::BufferImageCopy> uploadRegions;
+	for (uint32_t i = level; i < copiedLevel; i++)
+	{
+		vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, i - level, 0, 1);
+		vk::Extent3D extent(std::max(source.width >> i, 1u), std::max(source.height >> i, 1u), 1);
+		uploadRegions.push_back(vk::BufferImageCopy(staging.offset + source.mipOffsets[i] - source.mipOffsets[level],
+			0, 0, subresource, vk::Offset3D(), extent));
+	}
+
+	// The rest are copied from the current image on the GPU
+	std::vector<vk::ImageCopy> copyRegions;
+	for (uint32_t i = copiedLevel; i < texture.levelCount; i++)
 	{
-		imageUsage |= vk::ImageUsageFlagBits::eTransferSrc;
-		mipLevels = static_cast<uint32_t>(floor(log2(float(std::min(width, height)))) + 1);
+		vk::Extent3D extent(std::max(source.width >> i, 1u), std::max(source.height >> i, 1u), 1);
+		copyRegions.push_back(vk::ImageCopy(
+			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - texture.residentLevel, 0, 1), vk::Offset3D(),
+			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - level, 0, 1), vk::Offset3D(), extent));
 	}
 
+	vk::CommandBufferAllocateInfo commandInfo(*m_commandPool, vk::CommandBufferLevel::ePrimary, 1);
+	upload.commandBuffer = std::move(device.allocateCommandBuffersUnique(commandInfo)[0]);
+	upload.fence = device.createFenceUnique(vk::FenceCreateInfo());
+	vk::CommandBuffer commandBuffer = *upload.commandBuffer;
+	commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+	const vk::ImageSubresourceRange allLevels(vk::ImageAspectFlagBits::eColor,
+		0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS);
+	std::vector<vk::ImageMemoryBarrier2> barriers;
+	barriers.push_back(CreateImageMemoryBarrier(AccessType::eNone, AccessType::eWriteTransfer,
+		ImageLayout::eOptimal, ImageLayout::eOptimal, true, newImage, allLevels));
+	if (!copyRegions.empty())
+	{
+		barriers.push_back(CreateImageMemoryBarrier(AccessType::eReadAnyShader, AccessType::eReadTransfer,
+			ImageLayout::eOptimal, ImageLayout::eOptimal, false, oldImage, allLevels));
+	}
+	commandBuffer.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, barriers));
+
+	if (!uploadRegions.empty())
+	{
+		commandBuffer.copyBufferToImage(staging.buffer, newImage,
+			vk::ImageLayout::eTransferDstOptimal, uploadRegions);
+	}
+	if (!copyRegions.empty())
+	{
+		commandBuffer.copyImage(oldImage, vk::ImageLayout::eTransferSrcOptimal, newImage,
+			vk::ImageLayout::eTransferDstOptimal, copyRegions);
+	}
+
+	// Frames recorded before the swap still sample the current image, so it goes back too
+	barriers.clear();
+	barriers.push_back(CreateImageMemoryBarrier(AccessType::eWriteTransfer, AccessType::eReadAnyShader,
+		ImageLayout::eOptimal, ImageLayout::eOptimal, false, newImage, allLevels));
+	if (!copyRegions.empty())
+	{
+		barriers.push_back(CreateImageMemoryBarrier(AccessType::eReadTransfer, AccessType::eReadAnyShader,
+			ImageLayout::eOptimal, ImageLayout::eOptimal, false, oldImage, allLevels));
+	}
+	commandBuffer.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, barriers));
+	commandBuffer.end();
+	SubmitUpload(commandBuffer, *upload.fence);
+
+	texture.targetLevel = level;
+	m_textureUploads.push_back(std::move(upload));
+}
+
+void ResourceManager::FinishTextureUpload(const vk::Device& device, TextureUpload& upload)
+{
+	m_retiredTextures.push_back({ std::move(m_textures[upload.textureIdx]),
+		std::move(m_textureViews[upload.textureIdx]), m_frameCount, INVALID_TEXTURE });
+	m_textures[upload.textureIdx] = std::move(upload.image);
+	m_textureViews[upload.textureIdx] = std::move(upload.view);
+	QueueTextureDescriptorWrites(upload.textureIdx);
+
+	StreamedTexture& texture = m_streamedTextures.at(upload.textureIdx);
+	texture.residentLevel = texture.targetLevel;
+}
+
+uint32_t ResourceManager::AllocateTextureSlot()
+{
+	uint32_t textureIdx;
+	if (!m_freeTextureSlots.empty())
+	{
+		textureIdx = m_freeTextureSlots.back();
+		m_freeTextureSlots.pop_back();
+	}
+	else
+	{
+		if (m_textures.size() >= MAX_TEXTURE_COUNT)
+		{
+			throw std::runtime_error("Out of bindless texture slots");
+		}
+		textureIdx = static_cast<uint32_t>(m_textures.size());
+		m_textures.emplace_back();
+		m_textureViews.emplace_back();
+		m_textureRefCounts.push_back(0);
+		m_textureKeys.emplace_back();
+	}
+	m_textureRefCounts[textureIdx] = 1;
+	return textureIdx;
+}
+
+void ResourceManager::CreateTextureImage(const vk::Device& device, vk::Format format, uint32_t width,
+	uint32_t height, uint32_t mipLevels, vk::ImageUsageFlags usage, UniqueAllocatedImage& image,
+	vk::UniqueImageView& view) const
+{
 	// Set image and allocation properties, then create the image
 	AllocationCreateInfo allocationInfo({}, VMA_MEMORY_USAGE_AUTO);
-	vk::Format format = linear ? vk::Format::eR8G8B8A8Unorm : vk::Format::eR8G8B8A8Srgb;
 	vk::ImageCreateInfo imageInfo({}, vk::ImageType::e2D, format,
 		vk::Extent3D(width, height, 1), mipLevels, 1, vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal,
-		imageUsage, vk::SharingMode::eExclusive, {}, vk::ImageLayout::eUndefined);
-	m_textures.push_back(UniqueAllocatedImage(m_allocator, imageInfo, allocationInfo));
+		usage, vk::SharingMode::eExclusive, {}, vk::ImageLayout::eUndefined);
+	image = UniqueAllocatedImage(m_allocator, imageInfo, allocationInfo);
 
-	vk::ImageViewCreateInfo viewInfo({}, m_textures.back().GetImage(), vk::ImageViewType::e2D, format, {}, 
+	vk::ImageViewCreateInfo viewInfo({}, image.GetImage(), vk::ImageViewType::e2D, format, {}, 
 		vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 
 			0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS));
-	m_textureViews.push_back(device.createImageViewUnique(viewInfo));
-	
-	// Upload the image
-	auto stagingBuffer = UploadStaging(device, pixels, size);
-	UploadImage(device, stagingBuffer.GetBuffer(), m_textures.back().GetImage(),
-		vk::Offset3D(), vk::Extent3D(width, height, 1), mipLevels);
-
-	// Bind the image
-	for (int i = 0; i < m_descriptorSets.size(); i++)
+	view = device.createImageViewUnique(viewInfo);
+}
+
+void ResourceManager::QueueTextureDescriptorWrites(uint32_t textureIdx)
+{
+	for (auto& pendingWrites : m_pendingTextureWrites)
 	{
-		auto& set = m_descriptorSets[i];
-		vk::DescriptorImageInfo descriptorInfo(nullptr, *m_textureViews.back(), vk::ImageLayout::eShaderReadOnlyOptimal);
-		vk::WriteDescriptorSet write(set, 5, textureIdx, vk::DescriptorType::eSampledImage, descriptorInfo);
-		device.updateDescriptorSets(write, {});
+		pendingWrites.push_back(textureIdx);
 	}
-
-	return textureIdx;
 }
 
-UniqueAllocatedBuffer ResourceManager::UploadStaging(const vk::Device& device, const void* pSrcData, size_t size) const
+void ResourceManager::UpdateFrameDescriptors(const vk::Device& device)
 {
-	// Create staging buffer
-	vk::BufferCreateInfo bufferInfo({}, size, vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive);
-	AllocationCreateInfo allocationInfo(VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, VMA_MEMORY_USAGE_AUTO);
-	UniqueAllocatedBuffer stagingBuffer(m_allocator, bufferInfo, allocationInfo);
+	auto& pendingWrites = m_pendingTextureWrites[m_frameCount % BACK_BUFFER_COUNT];
+	std::vector<vk::DescriptorImageInfo> imageInfos;
+	imageInfos.reserve(pendingWrites.size());
+	std::vector<vk::WriteDescriptorSet> writes;
+	for (uint32_t textureIdx : pendingWrites)
+	{
+		// The slot always gets its current view, which is skipped if it was released since
+		if (!m_textureViews[textureIdx])
+		{
+			continue;
+		}
+		imageInfos.push_back(vk::DescriptorImageInfo(nullptr, *m_textureViews[textureIdx],
+			vk::ImageLayout::eShaderReadOnlyOptimal));
+		writes.push_back(vk::WriteDescriptorSet(GetDescriptorSet(), 6, textureIdx,
+			vk::DescriptorType::eSampledImage, imageInfos.back()));
+	}
+	device.updateDescriptorSets(writes, {});
+	pendingWrites.clear();
+}
 
-	// Transfer
-	void* ptr;
-	ThrowIfFailed(vmaMapMemory(m_allocator, stagingBuffer.GetAllocation(), &ptr));
-	memcpy(ptr, pSrcData, size);
-	vmaUnmapMemory(m_allocator, stagingBuffer.GetAllocation());
+StagingAllocation ResourceManager::UploadStaging(const vk::Device& device, const void* pSrcData, size_t size) const
+{
+	return m_stagingRing.Allocate(device, pSrcData, size, m_uploadTimelineValue + 1);
+}
 
-	return stagingBuffer;
+void ResourceManager::SubmitUpload(const vk::CommandBuffer& commandBuffer, const vk::Fence& fence) const
+{
+	m_uploadTimelineValue++;
+	vk::CommandBufferSubmitInfo commandSubmitInfo(commandBuffer);
+	vk::SemaphoreSubmitInfo signalInfo(*m_uploadTimeline, m_uploadTimelineValue, vk::PipelineStageFlagBits2::eAllCommands);
+	vk::SubmitInfo2 submitInfo({}, {}, commandSubmitInfo, signalInfo);
+	m_queue.submit2(submitInfo, fence);
 }
 
-void ResourceManager::UploadBuffer(const vk::Device& device, const vk::Buffer& src, 
+void ResourceManager::UploadBuffer(const vk::Device& device, const StagingAllocation& src, 
 	const vk::Buffer& dst, uint32_t dstOffset, size_t size) const
 {
-	// Upload to GPU
-	m_commandBuffer->reset();
-	vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-	m_commandBuffer->begin(beginInfo);
+	m_uploadBatch.buffers.push_back({ src.buffer, dst, vk::BufferCopy(src.offset, dstOffset, size) });
+	if (!m_uploadBatch.open)
+	{
+		FlushUploadBatch(device);
+	}
+}
 
-	vk::BufferCopy copyRegion(0, dstOffset, size);
-	m_commandBuffer->copyBuffer(src, dst, copyRegion);
+void ResourceManager::UploadImage(const vk::Device& device, const vk::Buffer& src, const vk::Image& dst,
+	const std::vector<vk::BufferImageCopy>& copyRegions) const
+{
+	m_uploadBatch.images.push_back({ src, dst, copyRegions });
+	if (!m_uploadBatch.open)
+	{
+		FlushUploadBatch(device);
+	}
+}
 
-	m_commandBuffer->end();
+void ResourceManager::BeginUploadBatch()
+{
+	assert(!m_uploadBatch.open);
+	m_uploadBatch.open = true;
+}
 
-	vk::CommandBufferSubmitInfo commandSubmitInfo(*m_commandBuffer);
-	vk::SubmitInfo2 submitInfo({}, {}, commandSubmitInfo);
-	m_queue.submit2(submitInfo, *m_transferFence);
+uint64_t ResourceManager::EndUploadBatch(const vk::Device& device, bool wait)
+{
+	assert(m_uploadBatch.open);
+	FlushUploadBatch(device);
+	m_uploadBatch.open = false;
 
-	ThrowIfFailed(device.waitForFences(*m_transferFence, true, UINT64_MAX));
-	device.resetFences(*m_transferFence);
+	// The timeline only moves forward, so the last value covers everything submitted before
+	if (wait)
+	{
+		vk::SemaphoreWaitInfo waitInfo({}, *m_uploadTimeline, m_uploadTimelineValue);
+		ThrowIfFailed(device.waitSemaphores(waitInfo, UINT64_MAX));
+	}
+	return m_uploadTimelineValue;
 }
 
-void ResourceManager::UploadImage(const vk::Device& device, const vk::Buffer& src, const vk::Image& dst,
-	const vk::Offset3D& imageOffset, const vk::Extent3D& imageExtent, uint32_t mipLevels) const
+void ResourceManager::FlushUploadBatch(const vk::Device& device) const
 {
-	// Temporary object
-	vk::ImageMemoryBarrier2 barrier;
-	const uint32_t width = imageExtent.width;
-	const uint32_t height = imageExtent.height;	
+	if (m_uploadBatch.buffers.empty() && m_uploadBatch.images.empty())
+	{
+		return;
+	}
 
-	m_commandBuffer->reset();
-	vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-	m_commandBuffer->begin(beginInfo);
+	// Reuse the oldest command buffer if its batch has finished
+	vk::UniqueCommandBuffer commandBuffer;
+	if (!m_uploadCommandBuffers.empty()
+		&& m_uploadCommandBuffers.front().timelineValue <= device.getSemaphoreCounterValue(*m_uploadTimeline))
+	{
+		commandBuffer = std::move(m_uploadCommandBuffers.front().commandBuffer);
+		m_uploadCommandBuffers.pop_front();
+		commandBuffer->reset();
+	}
+	else
+	{
+		vk::CommandBufferAllocateInfo commandInfo(*m_commandPool, vk::CommandBufferLevel::ePrimary, 1);
+		commandBuffer = std::move(device.allocateCommandBuffersUnique(commandInfo)[0]);
+	}
+	commandBuffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
-	// Transition image layout from Undefined to TransferDst
-	barrier = CreateImageMemoryBarrier(AccessType::eWriteHost, AccessType::eWriteTransfer,
-		ImageLayout::eOptimal, ImageLayout::eOptimal, true, dst,
-		vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 
-			0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS));
-	m_commandBuffer->pipelineBarrier2(vk::DependencyInfo({}, {}, {}, barrier));
-
-	// Copy mip level 0 from the staging buffer
-	vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
-	vk::BufferImageCopy copyRegion(0, 0, 0, subresource, imageOffset, imageExtent);
-	m_commandBuffer->copyBufferToImage(src, dst, vk::ImageLayout::eTransferDstOptimal, copyRegion);
-
-	// Transition layout of mip level 0 to TransferSrc, if mipmap generation is required
-	if (mipLevels > 1)
-	{
-		barrier = CreateImageMemoryBarrier(AccessType::eWriteTransfer, AccessType::eReadTransfer,
-			ImageLayout::eOptimal, ImageLayout::eOptimal, false, dst,
-			vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS));
-		m_commandBuffer->pipelineBarrier2(vk::DependencyInfo({}, {}, {}, barrier));
-	}
-
-	// Generate subsequent mip levels on the GPU -- no CPU access is required anymore
-	for (uint32_t i = 1; i < mipLevels; i++)
-	{
-		// Copy the previous mip level into the current one using BlitImage
-		vk::ImageBlit blitRegion;
-		blitRegion.srcSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - 1, 0, 1);
-		blitRegion.srcOffsets[1].x = std::max(width >> (i - 1), 1u);
-		blitRegion.srcOffsets[1].y = std::max(height >> (i - 1), 1u);
-		blitRegion.srcOffsets[1].z = 1;
-		blitRegion.dstSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, 1);
-		blitRegion.dstOffsets[1].x = std::max(width >> i, 1u);
-		blitRegion.dstOffsets[1].y = std::max(height >> i, 1u);
-		blitRegion.dstOffsets[1].z = 1;
-		m_commandBuffer->blitImage(dst, vk::ImageLayout::eTransferSrcOptimal, dst,
-			vk::ImageLayout::eTransferDstOptimal, blitRegion, vk::Filter::eLinear);
-
-		// Transition new mip level to TransferSrc memory layout
-		barrier = CreateImageMemoryBarrier(AccessType::eWriteTransfer, AccessType::eReadTransfer,
-			ImageLayout::eOptimal, ImageLayout::eOptimal, false, dst,
-			vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i, 1, 0, VK_REMAINING_ARRAY_LAYERS));
-		m_commandBuffer->pipelineBarrier2(vk::DependencyInfo({}, {}, {}, barrier));
-	}
-
-	// Transition image layout from TransferDst to ShaderReadOnly for all mip levels at once
-	barrier = CreateImageMemoryBarrier(AccessType::eWriteTransfer, AccessType::eReadAnyShader,
-		ImageLayout::eOptimal, ImageLayout::eOptimal,
-		true, dst,
-		vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 
-			0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS));
-	m_commandBuffer->pipelineBarrier2(vk::DependencyInfo({}, {}, {}, barrier));
+	// Transition every image from Undefined to TransferDst at once
+	const vk::ImageSubresourceRange allLevels(vk::ImageAspectFlagBits::eColor,
+		0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS);
+	std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+	for (const auto& image : m_uploadBatch.images)
+	{
+		imageBarriers.push_back(CreateImageMemoryBarrier(AccessType::eNone, AccessType::eWriteTransfer,
+			ImageLayout::eOptimal, ImageLayout::eOptimal, true, image.dst, allLevels));
+	}
+	if (!imageBarriers.empty())
+	{
+		commandBuffer->pipelineBarrier2(vk::DependencyInfo({}, {}, {}, imageBarriers));
+	}
 
-	m_commandBuffer->end();
+	// Consecutive copies between the same buffers are merged into one command
+	std::vector<vk::BufferCopy> regions;
+	for (size_t i = 0; i < m_uploadBatch.buffers.size(); i++)
+	{
+		const BufferUpload& upload = m_uploadBatch.buffers[i];
+		regions.push_back(upload.region);
+		if (i + 1 == m_uploadBatch.buffers.size() || m_uploadBatch.buffers[i + 1].src != upload.src
+			|| m_uploadBatch.buffers[i + 1].dst != upload.dst)
+		{
+			commandBuffer->copyBuffer(upload.src, upload.dst, regions);
+			regions.clear();
+		}
+	}
+	for (const auto& image : m_uploadBatch.images)
+	{
+		commandBuffer->copyBufferToImage(image.src, image.dst, vk::ImageLayout::eTransferDstOptimal, image.regions);
+	}
 
-	vk::CommandBufferSubmitInfo commandSubmitInfo(*m_commandBuffer);
-	vk::SubmitInfo2 submitInfo({}, {}, commandSubmitInfo);
-	m_queue.submit2(submitInfo, *m_transferFence);
+	// Then make everything readable by the draws that use it, images going to ShaderReadOnly
+	for (auto& barrier : imageBarriers)
+	{
+		barrier = CreateImageMemoryBarrier(AccessType::eWriteTransfer, AccessType::eReadAnyShader,
+			ImageLayout::eOptimal, ImageLayout::eOptimal, false, barrier.image, allLevels);
+	}
+	std::vector<vk::MemoryBarrier2> bufferBarriers;
+	if (!m_uploadBatch.buffers.empty())
+	{
+		bufferBarriers.push_back(CreateMemoryBarrier(AccessType::eWriteTransfer,
+			{ AccessType::eReadIndexBuffer, AccessType::eReadAnyShader }));
+	}
+	commandBuffer->pipelineBarrier2(vk::DependencyInfo({}, bufferBarriers, {}, imageBarriers));
+	commandBuffer->end();
 
-	ThrowIfFailed(device.waitForFences(*m_transferFence, true, UINT64_MAX));
-	device.resetFences(*m_transferFence);
+	SubmitUpload(*commandBuffer, vk::Fence());
+	m_uploadCommandBuffers.push_back({ std::move(commandBuffer), m_uploadTimelineValue });
+	m_uploadBatch.buffers.clear();
+	m_uploadBatch.images.clear();
 }
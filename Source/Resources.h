@@ -1,7 +1,12 @@
 #pragma once
 
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
 #include <DirectXMath.h>
 
+#include "TextureLoading.h"
 #include "VulkanUtil.h"
 
 class UniqueAllocatedBuffer
@@ -98,6 +103,54 @@ private:
 	VmaAllocation m_allocation;
 };
 
+// Where data was written for an upload, to use as the source of its copy commands
+struct StagingAllocation
+{
+	vk::Buffer buffer;
+	vk::DeviceSize offset;
+};
+
+// A persistently mapped staging buffer that uploads are sub-allocated from in a ring. Each
+// allocation is tagged with the value that the submission reading it signals on a timeline
+// semaphore, and its space is reused once the semaphore has reached that value.
+class StagingRing
+{
+public:
+	StagingRing() : m_allocator(nullptr), m_timeline(nullptr), m_pData(nullptr), m_size(0), m_head(0), m_tail(0)
+	{
+	}
+	StagingRing(VmaAllocator allocator, vk::DeviceSize size, vk::Semaphore timeline);
+
+	// Copies the data for the submission that will signal timelineValue. When the ring is full,
+	// this waits for earlier submissions to finish. Data that doesn't fit even then, because it
+	// is larger than the ring or the ring is full of the same submission's data, gets a buffer of
+	// its own that is kept until the submission has finished.
+	StagingAllocation Allocate(const vk::Device& device, const void* pSrcData, vk::DeviceSize size,
+		uint64_t timelineValue);
+	// Frees the space of the submissions that have finished
+	void Reclaim(const vk::Device& device);
+
+private:
+	// The data of one submission, up to position end
+	struct Region
+	{
+		uint64_t end;
+		uint64_t timelineValue;
+		UniqueAllocatedBuffer dedicatedBuffer;
+	};
+
+	VmaAllocator m_allocator;
+	vk::Semaphore m_timeline;
+	UniqueAllocatedBuffer m_buffer;
+	char* m_pData;
+	vk::DeviceSize m_size;
+	// Positions count every byte ever allocated, so the offset in the buffer is a position
+	// modulo its size. Everything from tail to head is in use.
+	uint64_t m_head;
+	uint64_t m_tail;
+	std::deque<Region> m_regions;
+};
+
 // Global constants for all shaders
 struct GlobalConstants
 {
@@ -105,11 +158,46 @@ struct GlobalConstants
 	DirectX::XMFLOAT4X4 viewProj;
 };
 
+// Culling bounds of a mesh in model space, as read by the shaders from g_bounds
+struct MeshBounds
+{
+	DirectX::XMFLOAT3 boxCenter;
+	DirectX::XMFLOAT3 boxExtents;
+	DirectX::XMFLOAT3 sphereCenter;
+	float sphereRadius;
+};
+
+// Counters for the deduplication of the vertex and index heaps
+struct GeometryHeapStats
+{
+	// Bytes actually written to the heaps
+	uint64_t uploadedBytes = 0;
+	// Bytes that identical earlier uploads made it unnecessary to write
+	uint64_t savedBytes = 0;
+	uint32_t uploadCount = 0;
+	uint32_t dedupCount = 0;
+};
+
+// Counters for the mip streaming of textures created with CreateStreamedTexture
+struct TextureStreamingStats
+{
+	// Bytes of the levels that are resident or being uploaded
+	uint64_t residentBytes = 0;
+	uint64_t budgetBytes = 0;
+	// Usage and budget of the device-local heaps as a whole, according to VMA
+	uint64_t deviceUsageBytes = 0;
+	uint64_t deviceBudgetBytes = 0;
+	// Fine levels streamed in and dropped again, counted per texture update
+	uint32_t streamInCount = 0;
+	uint32_t evictionCount = 0;
+};
+
 // Manager for bindless resources
 class ResourceManager
 {
 public:
-	ResourceManager() : m_lastVertexOffset(0), m_lastIndexOffset(0), m_allocator(nullptr), m_frameCount(0)
+	ResourceManager() : m_lastVertexOffset(0), m_lastIndexOffset(0), m_lastBoundsOffset(0),
+		m_uploadTimelineValue(0), m_allocator(nullptr), m_frameCount(0)
 	{
 	}
 
@@ -118,13 +206,74 @@ public:
 
 	// Uses 32-bit handles because it is more efficient in a shader and we won't ever allocate
 	// close to 4 GB of GPU memory for vertex data anyway
+	// Vertex and index uploads are content-addressed: uploading the same bytes again returns
+	// the existing offset instead of growing the heap. Contents are matched on their 64-bit
+	// hash and size, not compared byte for byte, so the match is probabilistic. The heaps are
+	// only ever appended to, and shared ranges stay in place for the lifetime of the manager.
 	// TODO: Make these type safe
 	uint32_t CreateVertices(const vk::Device& device, const void* pSrcData, uint32_t size) const;
-	uint32_t CreateIndices(const vk::Device& device, const void* pSrcData, uint32_t size) const;
+	// Indices are narrowed to 16 bits on upload if type is eUint16. Returns the byte offset to
+	// bind the index buffer at.
+	uint32_t CreateIndices(const vk::Device& device, const uint32_t* pIndices, uint32_t indexCount,
+		vk::IndexType type) const;
 	uint32_t CreateMaterial(const void* pSrcData, uint32_t size) const;
+	// Bounds never change after upload, so unlike transforms there is a single copy on the GPU.
+	// Returns the byte offset in the bounds buffer.
+	uint32_t CreateBounds(const vk::Device& device, const MeshBounds& bounds) const;
+	// Allocates the same byte offset in every frame's transform buffer, initialized to the data
 	uint32_t CreateTransform(const void* pSrcData, uint32_t size) const;
+	// Textures created from files are cached on the path and flags: creating the same one again
+	// returns the existing index and adds a reference to it, without decoding or uploading
 	uint32_t CreateTexture(const vk::Device& device, const std::string& filename, 
 		bool linear, bool generateMips);
+	// Uploads an image that was already loaded, for example on a worker thread. Mips are generated
+	// on the CPU, which blocks the calling thread; use GenerateMipChain on a worker beforehand to
+	// avoid that. Textures that carry their own format, such as KTX2, ignore linear and
+	// generateMips and are uploaded with the mip levels they come with.
+	uint32_t CreateTexture(const vk::Device& device, const TextureData& data,
+		bool linear, bool generateMips);
+	// Creates textures from many files at once, returning their indices in the same order.
+	// Files are decoded, and get their mips built, concurrently on the worker pool, and each
+	// is staged as soon as it is ready so that all of them are uploaded in a single submission.
+	// Cached as by CreateTexture. If any file fails to load, none of the textures are created
+	// and the first error is rethrown.
+	std::vector<uint32_t> CreateTextures(const vk::Device& device, const std::vector<std::string>& filenames,
+		bool linear, bool generateMips);
+	// Creates a texture that starts with only its low-resolution mip tail resident. Finer levels
+	// are streamed in from the CPU copy in data as RequestTextureResolution asks for them, and
+	// dropped again when textures need more memory than the budget. Decoded RGBA images without
+	// mips get them generated first.
+	uint32_t CreateStreamedTexture(const vk::Device& device, std::shared_ptr<const TextureData> data, bool linear);
+	// Asks for enough of a streamed texture to cover screenSize pixels with its longer side.
+	// Textures that aren't asked for in a frame fall back to their mip tail. Ignored for
+	// textures that aren't streamed.
+	void RequestTextureResolution(uint32_t textureIdx, float screenSize);
+	// Called once per frame: swaps in the textures whose uploads have finished, frees replaced
+	// and released images, and the slots of released ones, once no frame in flight uses them,
+	// and starts new uploads and evictions. Streamed textures are kept within both the budget
+	// set here and what VMA reports the device-local heaps have room for; when the device runs
+	// short, the least recently used ones are shrunk back towards their mip tails.
+	void UpdateTextureStreaming(const vk::Device& device);
+	// Drops a reference taken by any of the texture creation functions. The last one frees the
+	// image once no frame in flight can sample it, and only then is the bindless slot handed out
+	// again, so that its descriptors aren't rewritten while those frames still use them.
+	void ReleaseTexture(uint32_t textureIdx);
+	void SetTextureStreamingBudget(uint64_t bytes)
+	{
+		m_textureStreamingStats.budgetBytes = bytes;
+	}
+
+	// Buffer and texture uploads made between these calls are recorded into one command buffer,
+	// with one barrier before all of the copies and one after, and submitted together. Outside
+	// of a batch every upload is submitted on its own. Neither waits for the GPU unless asked
+	// to: uploads are ordered before any rendering submitted after them, and their staging space
+	// is only reused once they are done. Returns a value to check for completion with.
+	void BeginUploadBatch();
+	uint64_t EndUploadBatch(const vk::Device& device, bool wait);
+	bool IsUploadComplete(const vk::Device& device, uint64_t uploadValue) const
+	{
+		return device.getSemaphoreCounterValue(*m_uploadTimeline) >= uploadValue;
+	}
 	
 	// Note: for performance reasons data should only be written to these addresses through a 
 	// straight memcpy rather than assignment operators etc, to avoid accidental reads.
@@ -135,13 +284,17 @@ public:
 	}
 	void* GetTransform(uint32_t idx) const
 	{
-		return m_frameResources[m_frameCount % BACK_BUFFER_COUNT].pTransformBufferData;
+		return static_cast<char*>(m_frameResources[m_frameCount % BACK_BUFFER_COUNT].pTransformBufferData) + idx;
 	}
 	void* GetGlobalConstants() const
 	{
 		return m_frameResources[m_frameCount % BACK_BUFFER_COUNT].pGlobalConstantBufferData;
 	}
 
+	// Writes the texture descriptors queued for the descriptor set of the frame being recorded.
+	// Call it once the fence of the last frame to use that set has been waited on.
+	void UpdateFrameDescriptors(const vk::Device& device);
+
 	void IncrementFrameCount()
 	{
 		m_frameCount++;
@@ -162,12 +315,139 @@ public:
 		return m_indexBuffer.GetBuffer();
 	}
 
+	const GeometryHeapStats& GetGeometryStats() const
+	{
+		return m_geometryStats;
+	}
+	const TextureStreamingStats& GetTextureStreamingStats() const
+	{
+		return m_textureStreamingStats;
+	}
+
 private:
-	UniqueAllocatedBuffer UploadStaging(const vk::Device& device, const void* pSrcData, size_t size) const;
-	void UploadBuffer(const vk::Device& device, const vk::Buffer& src, 
+	// A range of one of the geometry heaps, shared by every upload of the same contents
+	struct GeometryBlock
+	{
+		uint32_t offset;
+		uint32_t size;
+	};
+	// Keyed on the 64-bit hash of the contents
+	using GeometryTable = std::unordered_map<uint64_t, GeometryBlock>;
+
+	// Looks for an earlier upload of the same contents
+	bool FindGeometry(const GeometryTable& table, uint64_t hash, uint32_t size, uint32_t& offset) const;
+	void AddGeometry(GeometryTable& table, uint64_t hash, uint32_t size, uint32_t offset) const;
+
+	// Copies the data into the staging ring for the next upload submission
+	StagingAllocation UploadStaging(const vk::Device& device, const void* pSrcData, size_t size) const;
+	// Submits upload commands, signaling the fence if there is one and the next value of the
+	// upload timeline
+	void SubmitUpload(const vk::CommandBuffer& commandBuffer, const vk::Fence& fence) const;
+	// Add a copy to the open upload batch, or submit it right away if there is none
+	void UploadBuffer(const vk::Device& device, const StagingAllocation& src, 
 		const vk::Buffer& dst, uint32_t dstOffset, size_t size) const;
+	// Copies every mip level of the image, one region each, and makes them shader-readable
 	void UploadImage(const vk::Device& device, const vk::Buffer& src, const vk::Image& dst,
-		const vk::Offset3D& imageOffset, const vk::Extent3D& imageExtent, uint32_t mipLevels) const;
+		const std::vector<vk::BufferImageCopy>& copyRegions) const;
+	// Records and submits the copies added to the batch so far. The batch stays open.
+	void FlushUploadBatch(const vk::Device& device) const;
+
+	// Copies waiting for the upload batch to be flushed
+	struct BufferUpload
+	{
+		vk::Buffer src;
+		vk::Buffer dst;
+		vk::BufferCopy region;
+	};
+	struct ImageUpload
+	{
+		vk::Buffer src;
+		vk::Image dst;
+		std::vector<vk::BufferImageCopy> regions;
+	};
+	struct UploadBatch
+	{
+		bool open = false;
+		std::vector<BufferUpload> buffers;
+		std::vector<ImageUpload> images;
+	};
+	// A command buffer of a submitted batch, reused once the timeline passes its value
+	struct UploadCommandBuffer
+	{
+		vk::UniqueCommandBuffer commandBuffer;
+		uint64_t timelineValue;
+	};
+
+	// A texture whose image has been created in a new slot, waiting for its upload. The copy
+	// regions already point at where the data was placed in the staging buffer.
+	struct StagedTexture
+	{
+		uint32_t textureIdx;
+		vk::Buffer stagingBuffer;
+		std::vector<vk::BufferImageCopy> copyRegions;
+	};
+	StagedTexture StageTexture(const vk::Device& device, const TextureData& data, bool linear, bool generateMips);
+
+	// Reuses a released bindless slot if there is one, with a reference count of 1
+	uint32_t AllocateTextureSlot();
+	// Creates a 2D image with a view of all its mip levels
+	void CreateTextureImage(const vk::Device& device, vk::Format format, uint32_t width, uint32_t height,
+		uint32_t mipLevels, vk::ImageUsageFlags usage, UniqueAllocatedImage& image, vk::UniqueImageView& view) const;
+	// Frames in flight may still sample the slot, so the write to each frame's descriptor set
+	// waits for UpdateFrameDescriptors to be called for that frame
+	void QueueTextureDescriptorWrites(uint32_t textureIdx);
+
+	// A texture of which only the levels from residentLevel down are on the GPU. Changing that
+	// means replacing the image with one of a different size, since the levels of an image
+	// can't be allocated separately without sparse residency.
+	struct StreamedTexture
+	{
+		std::shared_ptr<const TextureData> source;
+		vk::Format format;
+		uint32_t levelCount;
+		// Finest level that is always resident
+		uint32_t tailLevel;
+		uint32_t residentLevel;
+		// Equal to residentLevel unless a replacement image is being uploaded
+		uint32_t targetLevel;
+		// Finest level asked for this frame
+		uint32_t requestedLevel;
+		// Last frame the texture was asked for, which orders evictions
+		uint64_t lastRequestFrame;
+	};
+	// A replacement image whose upload was submitted and hasn't been swapped in yet
+	static constexpr uint32_t INVALID_TEXTURE = UINT32_MAX;
+	struct TextureUpload
+	{
+		// INVALID_TEXTURE if the texture was released while uploading
+		uint32_t textureIdx;
+		UniqueAllocatedImage image;
+		vk::UniqueImageView view;
+		vk::UniqueCommandBuffer commandBuffer;
+		vk::UniqueFence fence;
+	};
+	// An image that was replaced, kept until the frames that might sample it have finished
+	struct RetiredTexture
+	{
+		UniqueAllocatedImage image;
+		vk::UniqueImageView view;
+		uint64_t frame;
+		// The slot of a released texture, handed out again along with freeing the image.
+		// INVALID_TEXTURE if the image was only replaced.
+		uint32_t releasedSlot;
+	};
+
+	// Size of the levels from level down, which is 0 past the last level
+	uint64_t GetStreamedBytes(const StreamedTexture& texture, uint32_t level) const
+	{
+		return level < texture.levelCount ? texture.source->pixels.size() - texture.source->mipOffsets[level] : 0;
+	}
+	// The budget for streamed textures this frame, lowered to what the device has room for
+	uint64_t GetTextureStreamingBudget(uint64_t committedBytes);
+	// Submits the upload of a replacement image holding the levels from level down. Levels that
+	// are already resident are copied over on the GPU; finer ones come from the CPU copy.
+	void BeginTextureUpload(const vk::Device& device, uint32_t textureIdx, uint32_t level);
+	void FinishTextureUpload(const vk::Device& device, TextureUpload& upload);
 
 	void SetUpDescriptors(const vk::Device& device);
 
@@ -202,20 +482,44 @@ private:
 	UniqueAllocatedBuffer m_indexBuffer;
 	mutable uint32_t m_lastIndexOffset;
 
+	UniqueAllocatedBuffer m_boundsBuffer;
+	mutable uint32_t m_lastBoundsOffset;
+
+	mutable GeometryTable m_vertexBlocks;
+	mutable GeometryTable m_indexBlocks;
+	mutable GeometryHeapStats m_geometryStats;
+
 	std::vector<UniqueAllocatedImage> m_textures;
 	std::vector<vk::UniqueImageView> m_textureViews;
 	std::vector<vk::UniqueSampler> m_samplers;
+	// Per bindless slot, along with the cache key of textures created from files
+	std::vector<uint32_t> m_textureRefCounts;
+	std::vector<std::string> m_textureKeys;
+	std::vector<uint32_t> m_freeTextureSlots;
+	std::unordered_map<std::string, uint32_t> m_texturesByKey;
 
 	// Vulkan resources for uploading
 	vk::Queue m_queue;
-	vk::UniqueFence m_transferFence;
 	vk::UniqueCommandPool m_commandPool;
-	vk::UniqueCommandBuffer m_commandBuffer;
+	mutable UploadBatch m_uploadBatch;
+	mutable std::deque<UploadCommandBuffer> m_uploadCommandBuffers;
+	// Every upload submission signals the next value, which tells the ring what it can reuse
+	vk::UniqueSemaphore m_uploadTimeline;
+	mutable uint64_t m_uploadTimelineValue;
+	mutable StagingRing m_stagingRing;
+
+	// Mip streaming state. The uploads hold command buffers, so they come after the pool.
+	std::unordered_map<uint32_t, StreamedTexture> m_streamedTextures;
+	std::vector<TextureUpload> m_textureUploads;
+	std::deque<RetiredTexture> m_retiredTextures;
+	TextureStreamingStats m_textureStreamingStats;
 
 	// Descriptors for the bindless tables
 	vk::UniqueDescriptorSetLayout m_descriptorSetLayout;
 	vk::UniqueDescriptorPool m_descriptorPool;
 	std::vector<vk::DescriptorSet> m_descriptorSets;
+	// Texture slots whose descriptors are yet to be written, per set
+	std::array<std::vector<uint32_t>, BACK_BUFFER_COUNT> m_pendingTextureWrites;
 
 	// Cache the allocator
 	VmaAllocator m_allocator;
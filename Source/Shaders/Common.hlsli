@@ -4,15 +4,92 @@ struct GlobalConstants
 	float4x4 viewProj;
 };
 
+// Decode parameters for the packed vertex formats
+struct VertexQuantization
+{
+	float3 positionOffset;
+	float3 positionScale;
+	float2 texcoordOffset;
+	float2 texcoordScale;
+};
+
+// Culling bounds of a mesh in model space
+struct MeshBounds
+{
+	float3 boxCenter;
+	float3 boxExtents;
+	float3 sphereCenter;
+	float sphereRadius;
+};
+
+// Parameters pushed per draw
+struct DrawConstants
+{
+	VertexQuantization quantization;
+	// Byte offset of the instance's model transform in g_transforms
+	uint transformOffset;
+	// Index into the bindless texture table
+	uint textureIndex;
+	// Byte offset of the mesh's bounds in g_bounds
+	uint boundsOffset;
+};
+
 [[vk::binding(0, 0)]] ConstantBuffer<GlobalConstants> g_constants;
 
 [[vk::binding(1, 0)]] ByteAddressBuffer g_vertices;
 [[vk::binding(2, 0)]] ByteAddressBuffer g_materials;
 [[vk::binding(3, 0)]] ByteAddressBuffer g_transforms;
+[[vk::binding(4, 0)]] ByteAddressBuffer g_bounds;
+
+[[vk::binding(5, 0)]] SamplerState g_samplers[24];
 
-[[vk::binding(4, 0)]] SamplerState g_samplers[24];
+[[vk::binding(6, 0)]] Texture2D<float4> g_texturesFloat4[];
+[[vk::binding(6, 0)]] Texture2D<float3> g_texturesFloat3[];
+[[vk::binding(6, 0)]] Texture2D<float2> g_texturesFloat2[];
+[[vk::binding(6, 0)]] Texture2D<float> g_texturesFloat[];
 
-[[vk::binding(5, 0)]] Texture2D<float4> g_texturesFloat4[];
-[[vk::binding(5, 0)]] Texture2D<float3> g_texturesFloat3[];
-[[vk::binding(5, 0)]] Texture2D<float2> g_texturesFloat2[];
-[[vk::binding(5, 0)]] Texture2D<float> g_texturesFloat[];
\ No newline at end of file
+[[vk::push_constant]] DrawConstants g_draw;
+
+// Transforms are stored as four rows, in the row vector convention used with mul(v, M)
+float4x4 LoadTransform(uint offset)
+{
+	return float4x4(
+		asfloat(g_transforms.Load4(offset)),
+		asfloat(g_transforms.Load4(offset + 16)),
+		asfloat(g_transforms.Load4(offset + 32)),
+		asfloat(g_transforms.Load4(offset + 48)));
+}
+
+MeshBounds LoadMeshBounds(uint offset)
+{
+	float4 a = asfloat(g_bounds.Load4(offset));
+	float4 b = asfloat(g_bounds.Load4(offset + 16));
+	float2 c = asfloat(g_bounds.Load2(offset + 32));
+	MeshBounds ret;
+	ret.boxCenter = a.xyz;
+	ret.boxExtents = float3(a.w, b.xy);
+	ret.sphereCenter = float3(b.zw, c.x);
+	ret.sphereRadius = c.y;
+	return ret;
+}
+
+float2 UnpackUnorm16x2(uint packed)
+{
+	return float2(packed & 0xFFFF, packed >> 16) / 65535.0;
+}
+
+float2 UnpackSnorm16x2(uint packed)
+{
+	int2 value = int2(int(packed << 16) >> 16, int(packed) >> 16);
+	return max(float2(value) / 32767.0, -1.0);
+}
+
+// Inverse of the octahedral encoding used for packed normals and tangents
+float3 OctahedralDecode(float2 e)
+{
+	float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#include "Common.hlsli"
+
+// Layout of VertexP3N3Packed: position xy, position z + padding, normal
+static const uint PACKED_VERTEX_SIZE = 12;
+
+struct VSOutput
+{
+    float4 position : SV_Position;
+    float2 texcoord : Texcoord;
+};
+
+VSOutput main(uint id : SV_VertexID)
+{
+    VSOutput output;
+    uint3 data = g_vertices.Load3(id * PACKED_VERTEX_SIZE);
+
+    float3 position = float3(UnpackUnorm16x2(data.x), UnpackUnorm16x2(data.y).x);
+    position = g_draw.quantization.positionOffset + position * g_draw.quantization.positionScale;
+
+    float4 worldPosition = mul(float4(position, 1.0), LoadTransform(g_draw.transformOffset));
+    output.position = mul(worldPosition, g_constants.viewProj);
+    // The format has no texcoords
+    output.texcoord = float2(0.0, 0.0);
+    return output;
+}
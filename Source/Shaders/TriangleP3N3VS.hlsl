@@ -0,0 +1,24 @@
+#include "Common.hlsli"
+
+struct Vertex
+{
+    float3 position;
+    float3 normal;
+};
+
+struct VSOutput
+{
+    float4 position : SV_Position;
+    float2 texcoord : Texcoord;
+};
+
+VSOutput main(uint id : SV_VertexID)
+{
+    VSOutput output;
+    Vertex vertex = g_vertices.Load<Vertex>(id * sizeof(Vertex));
+    float4 worldPosition = mul(float4(vertex.position, 1.0), LoadTransform(g_draw.transformOffset));
+    output.position = mul(worldPosition, g_constants.viewProj);
+    // The format has no texcoords
+    output.texcoord = float2(0.0, 0.0);
+    return output;
+}
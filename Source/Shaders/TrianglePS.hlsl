@@ -8,6 +8,6 @@ struct PSInput
 
 float4 main(PSInput input) : SV_Target
 {
-    float3 color = g_texturesFloat3[0].Sample(g_samplers[0], input.texcoord);
+    float3 color = g_texturesFloat3[g_draw.textureIndex].Sample(g_samplers[0], input.texcoord);
 	return float4(color, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+#include "Common.hlsli"
+
+// Layout of VertexP3N3T3U2Packed: position xy, position z + padding, normal, tangent, texcoord
+static const uint PACKED_VERTEX_SIZE = 20;
+
+struct VSOutput
+{
+    float4 position : SV_Position;
+    float2 texcoord : Texcoord;
+};
+
+VSOutput main(uint id : SV_VertexID)
+{
+    VSOutput output;
+    uint4 data = g_vertices.Load4(id * PACKED_VERTEX_SIZE);
+    uint texcoordData = g_vertices.Load(id * PACKED_VERTEX_SIZE + 16);
+
+    float3 position = float3(UnpackUnorm16x2(data.x), UnpackUnorm16x2(data.y).x);
+    position = g_draw.quantization.positionOffset + position * g_draw.quantization.positionScale;
+    float2 texcoord = g_draw.quantization.texcoordOffset
+        + UnpackUnorm16x2(texcoordData) * g_draw.quantization.texcoordScale;
+
+    float4 worldPosition = mul(float4(position, 1.0), LoadTransform(g_draw.transformOffset));
+    output.position = mul(worldPosition, g_constants.viewProj);
+    output.texcoord = texcoord;
+    return output;
+}
\ No newline at end of file
@@ -18,7 +18,8 @@ VSOutput main(uint id : SV_VertexID)
 {
     VSOutput output;
     Vertex vertex = g_vertices.Load<Vertex>(id * sizeof(Vertex));
-    output.position = mul(float4(vertex.position, 1.0), g_constants.viewProj);
+    float4 worldPosition = mul(float4(vertex.position, 1.0), LoadTransform(g_draw.transformOffset));
+    output.position = mul(worldPosition, g_constants.viewProj);
     output.texcoord = vertex.texcoord;
     return output;
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "TextureLoading.h"
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <stdexcept>
+
+#include <ktx/ktx.h>
+#include <stb_image.h>
+
+namespace
+{
+	bool HasExtension(const std::string& path, const std::string& extension)
+	{
+		return path.size() >= extension.size() && std::equal(extension.rbegin(), extension.rend(), path.rbegin(),
+			[](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+	}
+
+	// Zstd and zlib supercompression is undone while the file is loaded. Basis Universal
+	// textures are transcoded to BC7, which every desktop GPU can sample.
+	TextureData LoadKtx2(const std::string& path)
+	{
+		ktxTexture2* pTexture = nullptr;
+		KTX_error_code result = ktxTexture2_CreateFromNamedFile(path.c_str(),
+			KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &pTexture);
+		if (result != KTX_SUCCESS)
+		{
+			throw std::runtime_error("Error loading KTX2 texture " + path + ": " + ktxErrorString(result));
+		}
+		std::unique_ptr<ktxTexture2, void(*)(ktxTexture2*)> texture(pTexture, [](ktxTexture2* p) {
+			ktxTexture_Destroy(ktxTexture(p));
+		});
+
+		if (ktxTexture2_NeedsTranscoding(pTexture))
+		{
+			result = ktxTexture2_TranscodeBasis(pTexture, KTX_TTF_BC7_RGBA, 0);
+			if (result != KTX_SUCCESS)
+			{
+				throw std::runtime_error("Error transcoding KTX2 texture " + path + ": " + ktxErrorString(result));
+			}
+		}
+		if (pTexture->numDimensions != 2 || pTexture->numLayers != 1 || pTexture->numFaces != 1)
+		{
+			throw std::runtime_error("Only 2D KTX2 textures are supported: " + path);
+		}
+
+		TextureData ret;
+		ret.width = pTexture->baseWidth;
+		ret.height = pTexture->baseHeight;
+		ret.format = pTexture->vkFormat;
+		ret.mipOffsets.resize(pTexture->numLevels);
+		for (uint32_t level = 0; level < pTexture->numLevels; level++)
+		{
+			ktx_size_t offset = 0;
+			ktxTexture_GetImageOffset(ktxTexture(pTexture), level, 0, 0, &offset);
+			ret.mipOffsets[level] = offset;
+		}
+		ret.pixels.assign(pTexture->pData, pTexture->pData + pTexture->dataSize);
+		return ret;
+	}
+}
+
+TextureData LoadTextureData(const std::string& path)
+{
+	if (HasExtension(path, ".ktx2"))
+	{
+		return LoadKtx2(path);
+	}
+
+	int width, height, channels;
+	std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels(
+		stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha), &stbi_image_free);
+	if (!pixels)
+	{
+		throw std::runtime_error("Error loading image: " + path);
+	}
+
+	TextureData ret;
+	ret.width = static_cast<uint32_t>(width);
+	ret.height = static_cast<uint32_t>(height);
+	ret.pixels.assign(pixels.get(), pixels.get() + 4ull * width * height);
+	return ret;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Image data ready to upload. Decoded images are tightly packed 8-bit RGBA with a single mip
+// level and no format of their own, so the caller picks sRGB or linear. KTX2 textures keep the
+// format they were stored in, which may be block-compressed, along with all their mip levels.
+struct TextureData
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// VkFormat of the pixels, or 0 (VK_FORMAT_UNDEFINED) for decoded RGBA
+	uint32_t format = 0;
+	// Byte offset of each stored mip level in pixels, starting with the full-size image
+	std::vector<size_t> mipOffsets = { 0 };
+	std::vector<uint8_t> pixels;
+};
+
+// Loads a .ktx2 file as stored, or decodes an image file of any format stb_image supports,
+// expanding it to RGBA. Safe to call from worker threads.
+TextureData LoadTextureData(const std::string& path);
@@ -0,0 +1,1130 @@
+#include "TextureProcessing.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "ThreadPool.h"
+
+// MSVC allows AVX2 intrinsics in any function, GCC and Clang only in ones targeting AVX2
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace
+{
+	// VkFormat values from vulkan_core.h, so that texture cooking doesn't depend on Vulkan
+	constexpr uint32_t FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+	constexpr uint32_t FORMAT_BC1_RGB_SRGB_BLOCK = 132;
+	constexpr uint32_t FORMAT_BC3_UNORM_BLOCK = 137;
+	constexpr uint32_t FORMAT_BC3_SRGB_BLOCK = 138;
+	constexpr uint32_t FORMAT_BC5_UNORM_BLOCK = 141;
+	constexpr uint32_t FORMAT_BC7_UNORM_BLOCK = 145;
+	constexpr uint32_t FORMAT_BC7_SRGB_BLOCK = 146;
+
+	uint32_t GetMipLevelCount(uint32_t width, uint32_t height)
+	{
+		return static_cast<uint32_t>(std::floor(std::log2(static_cast<float>(std::max(width, height))))) + 1;
+	}
+
+	const std::array<float, 256>& GetSrgbToLinearTable()
+	{
+		static const std::array<float, 256> table = []() {
+			std::array<float, 256> ret;
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				ret[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			return ret;
+		}();
+		return table;
+	}
+
+	// Linear to sRGB, sampled finely enough to round the same way as the exact curve
+	// everywhere except right next to the rounding boundaries
+	constexpr int LINEAR_TO_SRGB_TABLE_SIZE = 16384;
+
+	const std::vector<uint8_t>& GetLinearToSrgbTable()
+	{
+		static const std::vector<uint8_t> table = []() {
+			std::vector<uint8_t> ret(LINEAR_TO_SRGB_TABLE_SIZE);
+			for (int i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; i++)
+			{
+				float c = i / static_cast<float>(LINEAR_TO_SRGB_TABLE_SIZE - 1);
+				c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				ret[i] = static_cast<uint8_t>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+			}
+			return ret;
+		}();
+		return table;
+	}
+
+	// Expands 8-bit RGBA texels to floats in linear space. Alpha is always stored linearly.
+	void DecodeTexels(const uint8_t* pSrc, float* pDst, size_t texelCount, bool linear)
+	{
+		const auto& toLinear = GetSrgbToLinearTable();
+		for (size_t i = 0; i < texelCount * 4; i++)
+		{
+			pDst[i] = linear || i % 4 == 3 ? pSrc[i] * (1.0f / 255.0f) : toLinear[pSrc[i]];
+		}
+	}
+
+	void EncodeTexels(const float* pSrc, uint8_t* pDst, size_t texelCount, bool linear)
+	{
+		const auto& toSrgb = GetLinearToSrgbTable();
+		for (size_t i = 0; i < texelCount * 4; i++)
+		{
+			const float value = std::clamp(pSrc[i], 0.0f, 1.0f);
+			pDst[i] = linear || i % 4 == 3 ? static_cast<uint8_t>(value * 255.0f + 0.5f)
+				: toSrgb[static_cast<int>(value * (LINEAR_TO_SRGB_TABLE_SIZE - 1) + 0.5f)];
+		}
+	}
+
+	// The AVX2 paths are compiled regardless of the target architecture and picked at runtime,
+	// with SSE2 as the fallback
+	bool HasAvx2()
+	{
+		static const bool hasAvx2 = []() {
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+			{
+				return false;
+			}
+			__cpuid(info, 1);
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			__cpuidex(info, 7, 0);
+			const bool avx2 = (info[1] & (1 << 5)) != 0;
+			// The OS must also save the YMM registers on context switches
+			return fma && avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+		}();
+		return hasAvx2;
+	}
+
+	// 2x2 box filter of RGBA float texels, for levels whose width and height are both even.
+	// Two destination texels per iteration: each 256-bit load holds two source texels.
+	TARGET_AVX2 void DownsampleBoxRowAvx2(const float* pRow0, const float* pRow1, float* pDst, uint32_t dstWidth)
+	{
+		const __m256 quarter = _mm256_set1_ps(0.25f);
+		uint32_t x = 0;
+		for (; x + 2 <= dstWidth; x += 2)
+		{
+			const __m256 a = _mm256_add_ps(_mm256_loadu_ps(pRow0 + 8 * x), _mm256_loadu_ps(pRow1 + 8 * x));
+			const __m256 b = _mm256_add_ps(_mm256_loadu_ps(pRow0 + 8 * x + 8), _mm256_loadu_ps(pRow1 + 8 * x + 8));
+			// Pair up the left and right texel of each destination texel's footprint
+			const __m256 left = _mm256_permute2f128_ps(a, b, 0x20);
+			const __m256 right = _mm256_permute2f128_ps(a, b, 0x31);
+			_mm256_storeu_ps(pDst + 4 * x, _mm256_mul_ps(_mm256_add_ps(left, right), quarter));
+		}
+		for (; x < dstWidth; x++)
+		{
+			const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(pRow0 + 8 * x), _mm_loadu_ps(pRow0 + 8 * x + 4)),
+				_mm_add_ps(_mm_loadu_ps(pRow1 + 8 * x), _mm_loadu_ps(pRow1 + 8 * x + 4)));
+			_mm_storeu_ps(pDst + 4 * x, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+		}
+	}
+
+	void DownsampleBoxRowSse(const float* pRow0, const float* pRow1, float* pDst, uint32_t dstWidth)
+	{
+		for (uint32_t x = 0; x < dstWidth; x++)
+		{
+			const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(pRow0 + 8 * x), _mm_loadu_ps(pRow0 + 8 * x + 4)),
+				_mm_add_ps(_mm_loadu_ps(pRow1 + 8 * x), _mm_loadu_ps(pRow1 + 8 * x + 4)));
+			_mm_storeu_ps(pDst + 4 * x, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+		}
+	}
+
+	// pDst += pSrc * weight, over count floats
+	TARGET_AVX2 void AccumulateRowAvx2(float* pDst, const float* pSrc, float weight, size_t count)
+	{
+		const __m256 w = _mm256_set1_ps(weight);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			_mm256_storeu_ps(pDst + i, _mm256_fmadd_ps(_mm256_loadu_ps(pSrc + i), w, _mm256_loadu_ps(pDst + i)));
+		}
+		for (; i < count; i++)
+		{
+			pDst[i] += pSrc[i] * weight;
+		}
+	}
+
+	void AccumulateRowSse(float* pDst, const float* pSrc, float weight, size_t count)
+	{
+		// Rows are whole RGBA texels, so count is a multiple of 4
+		const __m128 w = _mm_set1_ps(weight);
+		for (size_t i = 0; i < count; i += 4)
+		{
+			_mm_storeu_ps(pDst + i, _mm_add_ps(_mm_loadu_ps(pDst + i), _mm_mul_ps(_mm_loadu_ps(pSrc + i), w)));
+		}
+	}
+
+	// Source texels contributing to each texel of a downsampled row or column, with a fixed
+	// number of taps per destination texel and source indices clamped to the edge
+	struct FilterTaps
+	{
+		uint32_t tapCount = 0;
+		std::vector<uint32_t> indices;
+		std::vector<float> weights;
+	};
+
+	// Modified Bessel function of the first kind, by its power series
+	float BesselI0(float x)
+	{
+		float sum = 1.0f;
+		float term = 1.0f;
+		for (int k = 1; k < 20; k++)
+		{
+			const float factor = x / (2.0f * k);
+			term *= factor * factor;
+			sum += term;
+		}
+		return sum;
+	}
+
+	// Kaiser-windowed sinc, three destination texels wide on either side
+	constexpr float KAISER_RADIUS = 3.0f;
+	constexpr float KAISER_ALPHA = 4.0f;
+
+	float KaiserWeight(float x)
+	{
+		if (std::abs(x) >= KAISER_RADIUS)
+		{
+			return 0.0f;
+		}
+		const float pi = 3.14159265358979f;
+		const float sinc = std::abs(x) < 1e-5f ? 1.0f : std::sin(pi * x) / (pi * x);
+		const float t = x / KAISER_RADIUS;
+		return sinc * BesselI0(KAISER_ALPHA * std::sqrt(1.0f - t * t)) / BesselI0(KAISER_ALPHA);
+	}
+
+	FilterTaps ComputeFilterTaps(uint32_t srcSize, uint32_t dstSize, MipFilter filter)
+	{
+		FilterTaps ret;
+		if (srcSize == dstSize)
+		{
+			ret.tapCount = 1;
+			for (uint32_t i = 0; i < dstSize; i++)
+			{
+				ret.indices.push_back(i);
+				ret.weights.push_back(1.0f);
+			}
+			return ret;
+		}
+
+		// Texel i of the source covers [i, i + 1), so a destination texel covers scale source
+		// texels, which needn't be a whole number for odd sizes
+		const float scale = static_cast<float>(srcSize) / dstSize;
+		const float radius = filter == MipFilter::eBox ? 0.5f * scale : KAISER_RADIUS * scale;
+		ret.tapCount = static_cast<uint32_t>(std::ceil(2.0f * radius)) + 1;
+		for (uint32_t x = 0; x < dstSize; x++)
+		{
+			const float center = (x + 0.5f) * scale;
+			const int first = static_cast<int>(std::floor(center - radius));
+			const size_t base = ret.weights.size();
+			float total = 0.0f;
+			for (uint32_t k = 0; k < ret.tapCount; k++)
+			{
+				const int i = first + static_cast<int>(k);
+				// The box filter weighs each source texel by how much of it the footprint covers
+				const float weight = filter == MipFilter::eBox
+					? std::max(0.0f, std::min(i + 1.0f, center + radius) - std::max(static_cast<float>(i), center - radius))
+					: KaiserWeight((i + 0.5f - center) / scale);
+				ret.indices.push_back(static_cast<uint32_t>(std::clamp(i, 0, static_cast<int>(srcSize) - 1)));
+				ret.weights.push_back(weight);
+				total += weight;
+			}
+			for (uint32_t k = 0; k < ret.tapCount; k++)
+			{
+				ret.weights[base + k] /= total;
+			}
+		}
+		return ret;
+	}
+
+	// Mip levels are built from rows of this many texels at a time, one band per worker task
+	constexpr uint32_t MIP_ROWS_PER_TASK = 16;
+
+	// Builds the next level down from a level of linear RGBA floats. Even-sized levels with the
+	// box filter take the 2x2 fast path; everything else is filtered separably, horizontally
+	// into a temporary image and then vertically.
+	void DownsampleLevel(const std::vector<float>& src, uint32_t srcWidth, uint32_t srcHeight,
+		std::vector<float>& dst, uint32_t dstWidth, uint32_t dstHeight, MipFilter filter)
+	{
+		ThreadPool& threadPool = ThreadPool::GetDefault();
+		const bool avx2 = HasAvx2();
+		const size_t bandCount = (dstHeight + MIP_ROWS_PER_TASK - 1) / MIP_ROWS_PER_TASK;
+		dst.assign(4ull * dstWidth * dstHeight, 0.0f);
+
+		if (filter == MipFilter::eBox && srcWidth % 2 == 0 && srcHeight % 2 == 0)
+		{
+			threadPool.ParallelFor(bandCount, [&](size_t band) {
+				const uint32_t endRow = std::min(static_cast<uint32_t>(band + 1) * MIP_ROWS_PER_TASK, dstHeight);
+				for (uint32_t y = static_cast<uint32_t>(band) * MIP_ROWS_PER_TASK; y < endRow; y++)
+				{
+					const float* pRow0 = src.data() + 8ull * y * srcWidth;
+					const float* pRow1 = pRow0 + 4ull * srcWidth;
+					float* pDst = dst.data() + 4ull * y * dstWidth;
+					avx2 ? DownsampleBoxRowAvx2(pRow0, pRow1, pDst, dstWidth) : DownsampleBoxRowSse(pRow0, pRow1, pDst, dstWidth);
+				}
+			});
+			return;
+		}
+
+		const FilterTaps horizontal = ComputeFilterTaps(srcWidth, dstWidth, filter);
+		const FilterTaps vertical = ComputeFilterTaps(srcHeight, dstHeight, filter);
+		std::vector<float> temp(4ull * dstWidth * srcHeight);
+		const size_t srcBandCount = (srcHeight + MIP_ROWS_PER_TASK - 1) / MIP_ROWS_PER_TASK;
+		threadPool.ParallelFor(srcBandCount, [&](size_t band) {
+			const uint32_t endRow = std::min(static_cast<uint32_t>(band + 1) * MIP_ROWS_PER_TASK, srcHeight);
+			for (uint32_t y = static_cast<uint32_t>(band) * MIP_ROWS_PER_TASK; y < endRow; y++)
+			{
+				const float* pSrc = src.data() + 4ull * y * srcWidth;
+				float* pDst = temp.data() + 4ull * y * dstWidth;
+				for (uint32_t x = 0; x < dstWidth; x++)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (uint32_t k = 0; k < horizontal.tapCount; k++)
+					{
+						const size_t tap = static_cast<size_t>(x) * horizontal.tapCount + k;
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pSrc + 4 * horizontal.indices[tap]),
+							_mm_set1_ps(horizontal.weights[tap])));
+					}
+					_mm_storeu_ps(pDst + 4 * x, sum);
+				}
+			}
+		});
+
+		threadPool.ParallelFor(bandCount, [&](size_t band) {
+			const uint32_t endRow = std::min(static_cast<uint32_t>(band + 1) * MIP_ROWS_PER_TASK, dstHeight);
+			const size_t rowSize = 4ull * dstWidth;
+			for (uint32_t y = static_cast<uint32_t>(band) * MIP_ROWS_PER_TASK; y < endRow; y++)
+			{
+				float* pDst = dst.data() + y * rowSize;
+				for (uint32_t k = 0; k < vertical.tapCount; k++)
+				{
+					const size_t tap = static_cast<size_t>(y) * vertical.tapCount + k;
+					const float* pSrc = temp.data() + vertical.indices[tap] * rowSize;
+					avx2 ? AccumulateRowAvx2(pDst, pSrc, vertical.weights[tap], rowSize)
+						: AccumulateRowSse(pDst, pSrc, vertical.weights[tap], rowSize);
+				}
+				// The Kaiser filter's negative lobes overshoot at sharp edges, which would otherwise
+				// carry on into the next level
+				for (size_t i = 0; i < rowSize; i++)
+				{
+					pDst[i] = std::clamp(pDst[i], 0.0f, 1.0f);
+				}
+			}
+		});
+	}
+
+	// A 4x4 block of texels as floats in [0, 255], in row-major order
+	using Block = std::array<std::array<float, 4>, 16>;
+
+	float SquaredError(const std::array<float, 4>& a, const int* b, int channels)
+	{
+		float ret = 0.0f;
+		for (int c = 0; c < channels; c++)
+		{
+			float d = a[c] - b[c];
+			ret += d * d;
+		}
+		return ret;
+	}
+
+	// Principal axis of the block's colors, by power iteration on their covariance. Returns
+	// the mean and the axis, which is zero if all the colors are the same.
+	void ComputePrincipalAxis(const Block& block, int channels, float mean[4], float axis[4])
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			mean[c] = 0.0f;
+			for (const auto& texel : block)
+			{
+				mean[c] += texel[c];
+			}
+			mean[c] /= 16.0f;
+		}
+
+		float covariance[4][4] = {};
+		for (const auto& texel : block)
+		{
+			for (int i = 0; i < channels; i++)
+			{
+				for (int j = 0; j < channels; j++)
+				{
+					covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+				}
+			}
+		}
+
+		for (int c = 0; c < 4; c++)
+		{
+			axis[c] = c < channels ? 1.0f : 0.0f;
+		}
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+			for (int i = 0; i < channels; i++)
+			{
+				for (int j = 0; j < channels; j++)
+				{
+					next[i] += covariance[i][j] * axis[j];
+				}
+				length += next[i] * next[i];
+			}
+			if (length < FLT_EPSILON)
+			{
+				std::fill(axis, axis + 4, 0.0f);
+				return;
+			}
+			length = std::sqrt(length);
+			for (int i = 0; i < channels; i++)
+			{
+				axis[i] = next[i] / length;
+			}
+		}
+	}
+
+	// Endpoints at the extremes of the block's projection onto its principal axis
+	void ComputeAxisEndpoints(const Block& block, int channels, float e0[4], float e1[4])
+	{
+		float mean[4], axis[4];
+		ComputePrincipalAxis(block, channels, mean, axis);
+		float minT = 0.0f;
+		float maxT = 0.0f;
+		for (const auto& texel : block)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++)
+			{
+				t += (texel[c] - mean[c]) * axis[c];
+			}
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			e0[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+			e1[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+		}
+	}
+
+	// Least-squares endpoints for texels reconstructed as e0 + weight * (e1 - e0). Returns
+	// false if the weights don't determine the endpoints, such as when they are all equal.
+	bool SolveEndpoints(const Block& block, const float weights[16], int channels, float e0[4], float e1[4])
+	{
+		float a = 0.0f, b = 0.0f, c = 0.0f;
+		float rhs0[4] = {}, rhs1[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			const float w = weights[i];
+			a += (1.0f - w) * (1.0f - w);
+			b += (1.0f - w) * w;
+			c += w * w;
+			for (int ch = 0; ch < channels; ch++)
+			{
+				rhs0[ch] += (1.0f - w) * block[i][ch];
+				rhs1[ch] += w * block[i][ch];
+			}
+		}
+		const float det = a * c - b * b;
+		if (std::abs(det) < 1e-6f)
+		{
+			return false;
+		}
+		for (int ch = 0; ch < channels; ch++)
+		{
+			e0[ch] = std::clamp((c * rhs0[ch] - b * rhs1[ch]) / det, 0.0f, 255.0f);
+			e1[ch] = std::clamp((a * rhs1[ch] - b * rhs0[ch]) / det, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	// BC4: two 8-bit endpoints and a 3-bit index per texel. Using the extremes as endpoints,
+	// with the first one larger, selects the mode with six interpolated values in between.
+	void EncodeBC4(const Block& block, int channel, uint8_t* pDst)
+	{
+		int lo = 255;
+		int hi = 0;
+		for (const auto& texel : block)
+		{
+			lo = std::min(lo, static_cast<int>(texel[channel]));
+			hi = std::max(hi, static_cast<int>(texel[channel]));
+		}
+
+		uint64_t indices = 0;
+		if (hi > lo)
+		{
+			int palette[8] = { hi, lo };
+			for (int i = 1; i < 7; i++)
+			{
+				palette[i + 1] = ((7 - i) * hi + i * lo + 3) / 7;
+			}
+			for (int t = 0; t < 16; t++)
+			{
+				uint64_t best = 0;
+				float bestError = FLT_MAX;
+				for (int i = 0; i < 8; i++)
+				{
+					float error = std::abs(block[t][channel] - palette[i]);
+					if (error < bestError)
+					{
+						bestError = error;
+						best = i;
+					}
+				}
+				indices |= best << (3 * t);
+			}
+		}
+
+		pDst[0] = static_cast<uint8_t>(hi);
+		pDst[1] = static_cast<uint8_t>(lo);
+		for (int i = 0; i < 6; i++)
+		{
+			pDst[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+		}
+	}
+
+	uint16_t PackRgb565(const float color[4])
+	{
+		auto quantize = [](float value, int maximum) {
+			return static_cast<uint16_t>(std::clamp(static_cast<int>(value * maximum / 255.0f + 0.5f), 0, maximum));
+		};
+		return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+	}
+
+	void UnpackRgb565(uint16_t packed, int color[3])
+	{
+		int r = packed >> 11;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	struct BC1Result
+	{
+		float error;
+		uint16_t color0;
+		uint16_t color1;
+		uint8_t indices[16];
+	};
+
+	// Finds the best index of every texel for a pair of endpoints, in the four color mode,
+	// which needs color0 > color1
+	BC1Result EvaluateBC1(const Block& block, uint16_t a, uint16_t b)
+	{
+		BC1Result ret{ 0.0f, std::max(a, b), std::min(a, b), {} };
+		int palette[4][3];
+		UnpackRgb565(ret.color0, palette[0]);
+		UnpackRgb565(ret.color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		// With equal endpoints the block is a single color, and index 0 selects it
+		const int paletteSize = ret.color0 == ret.color1 ? 1 : 4;
+		for (int t = 0; t < 16; t++)
+		{
+			float bestError = FLT_MAX;
+			for (int i = 0; i < paletteSize; i++)
+			{
+				float error = SquaredError(block[t], palette[i], 3);
+				if (error < bestError)
+				{
+					bestError = error;
+					ret.indices[t] = static_cast<uint8_t>(i);
+				}
+			}
+			ret.error += bestError;
+		}
+		return ret;
+	}
+
+	// BC1 color block: two RGB565 endpoints and a 2-bit index per texel. The endpoints start at
+	// the extremes along the principal axis and are then refit to the chosen indices.
+	void EncodeBC1(const Block& block, uint8_t* pDst)
+	{
+		float e0[4], e1[4];
+		ComputeAxisEndpoints(block, 3, e0, e1);
+		BC1Result best = EvaluateBC1(block, PackRgb565(e1), PackRgb565(e0));
+
+		// Fraction of color1 in each palette entry
+		constexpr float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		for (int iteration = 0; iteration < 2 && best.error > 0.0f && best.color0 != best.color1; iteration++)
+		{
+			float texelWeights[16];
+			for (int t = 0; t < 16; t++)
+			{
+				texelWeights[t] = weights[best.indices[t]];
+			}
+			if (!SolveEndpoints(block, texelWeights, 3, e0, e1))
+			{
+				break;
+			}
+			BC1Result refined = EvaluateBC1(block, PackRgb565(e0), PackRgb565(e1));
+			if (refined.error >= best.error)
+			{
+				break;
+			}
+			best = refined;
+		}
+
+		uint32_t indices = 0;
+		for (int t = 0; t < 16; t++)
+		{
+			indices |= static_cast<uint32_t>(best.indices[t]) << (2 * t);
+		}
+		memcpy(pDst, &best.color0, 2);
+		memcpy(pDst + 2, &best.color1, 2);
+		memcpy(pDst + 4, &indices, 4);
+	}
+
+	// Interpolation weights of 4-bit BC7 indices, out of 64
+	constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// A BC7 mode 6 endpoint: seven bits per channel plus a shared low bit
+	struct BC7Endpoint
+	{
+		int value[4];
+		int pbit;
+	};
+
+	// Picks the shared low bit that best represents the endpoint
+	BC7Endpoint QuantizeBC7Endpoint(const float color[4])
+	{
+		BC7Endpoint ret{};
+		float bestError = FLT_MAX;
+		for (int p = 0; p < 2; p++)
+		{
+			BC7Endpoint candidate{ {}, p };
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++)
+			{
+				candidate.value[c] = std::clamp(static_cast<int>((color[c] - p) * 0.5f + 0.5f), 0, 127);
+				float d = color[c] - ((candidate.value[c] << 1) | p);
+				error += d * d;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				ret = candidate;
+			}
+		}
+		return ret;
+	}
+
+	struct BC7Result
+	{
+		float error;
+		BC7Endpoint endpoints[2];
+		uint8_t indices[16];
+	};
+
+	BC7Result EvaluateBC7(const Block& block, const BC7Endpoint& a, const BC7Endpoint& b)
+	{
+		BC7Result ret{ 0.0f, { a, b }, {} };
+		int palette[16][4];
+		for (int c = 0; c < 4; c++)
+		{
+			int e0 = (a.value[c] << 1) | a.pbit;
+			int e1 = (b.value[c] << 1) | b.pbit;
+			for (int i = 0; i < 16; i++)
+			{
+				palette[i][c] = ((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6;
+			}
+		}
+		for (int t = 0; t < 16; t++)
+		{
+			float bestError = FLT_MAX;
+			for (int i = 0; i < 16; i++)
+			{
+				float error = SquaredError(block[t], palette[i], 4);
+				if (error < bestError)
+				{
+					bestError = error;
+					ret.indices[t] = static_cast<uint8_t>(i);
+				}
+			}
+			ret.error += bestError;
+		}
+		return ret;
+	}
+
+	// Little-endian bit writer for the 128-bit BC7 block
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(uint8_t* pDst) : m_pDst(pDst), m_position(0)
+		{
+			memset(pDst, 0, 16);
+		}
+
+		void Write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; i++, m_position++)
+			{
+				m_pDst[m_position / 8] |= static_cast<uint8_t>(((value >> i) & 1) << (m_position % 8));
+			}
+		}
+
+	private:
+		uint8_t* m_pDst;
+		int m_position;
+	};
+
+	// BC7 mode 6: a single subset with RGBA endpoints and 4-bit indices. One mode is enough to
+	// beat BC1 and BC3 comfortably; the partitioned modes would improve blocks with several
+	// distinct colors at a much higher encoding cost.
+	void EncodeBC7(const Block& block, uint8_t* pDst)
+	{
+		float e0[4], e1[4];
+		ComputeAxisEndpoints(block, 4, e0, e1);
+		BC7Result best = EvaluateBC7(block, QuantizeBC7Endpoint(e0), QuantizeBC7Endpoint(e1));
+
+		for (int iteration = 0; iteration < 2 && best.error > 0.0f; iteration++)
+		{
+			float texelWeights[16];
+			for (int t = 0; t < 16; t++)
+			{
+				texelWeights[t] = BC7_WEIGHTS[best.indices[t]] / 64.0f;
+			}
+			if (!SolveEndpoints(block, texelWeights, 4, e0, e1))
+			{
+				break;
+			}
+			BC7Result refined = EvaluateBC7(block, QuantizeBC7Endpoint(e0), QuantizeBC7Endpoint(e1));
+			if (refined.error >= best.error)
+			{
+				break;
+			}
+			best = refined;
+		}
+
+		// The first texel's index is stored without its top bit, so it must be below 8. Swapping
+		// the endpoints mirrors every index.
+		if (best.indices[0] >= 8)
+		{
+			std::swap(best.endpoints[0], best.endpoints[1]);
+			for (auto& index : best.indices)
+			{
+				index = static_cast<uint8_t>(15 - index);
+			}
+		}
+
+		BitWriter writer(pDst);
+		writer.Write(1 << 6, 7);
+		for (int c = 0; c < 4; c++)
+		{
+			writer.Write(best.endpoints[0].value[c], 7);
+			writer.Write(best.endpoints[1].value[c], 7);
+		}
+		writer.Write(best.endpoints[0].pbit, 1);
+		writer.Write(best.endpoints[1].pbit, 1);
+		writer.Write(best.indices[0], 3);
+		for (int t = 1; t < 16; t++)
+		{
+			writer.Write(best.indices[t], 4);
+		}
+	}
+
+	uint32_t GetBlockSize(TextureCompression compression)
+	{
+		return compression == TextureCompression::eBC1 ? 8 : 16;
+	}
+
+	uint32_t GetBlockFormat(TextureCompression compression, bool linear)
+	{
+		switch (compression)
+		{
+		case TextureCompression::eBC1: return linear ? FORMAT_BC1_RGB_UNORM_BLOCK : FORMAT_BC1_RGB_SRGB_BLOCK;
+		case TextureCompression::eBC3: return linear ? FORMAT_BC3_UNORM_BLOCK : FORMAT_BC3_SRGB_BLOCK;
+		case TextureCompression::eBC5: return FORMAT_BC5_UNORM_BLOCK;
+		case TextureCompression::eBC7: return linear ? FORMAT_BC7_UNORM_BLOCK : FORMAT_BC7_SRGB_BLOCK;
+		default: return 0;
+		}
+	}
+
+	// Encodes one row of blocks of a mip level. Blocks hanging over the edge of the image
+	// repeat its last row and column.
+	void EncodeBlockRow(const uint8_t* pSrc, uint32_t width, uint32_t height, uint32_t blockRow,
+		TextureCompression compression, uint8_t* pDst)
+	{
+		const uint32_t blockSize = GetBlockSize(compression);
+		const uint32_t blocksX = (width + 3) / 4;
+		for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+		{
+			Block block;
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				uint32_t x = std::min(blockX * 4 + i % 4, width - 1);
+				uint32_t y = std::min(blockRow * 4 + i / 4, height - 1);
+				const uint8_t* pTexel = pSrc + (static_cast<size_t>(y) * width + x) * 4;
+				for (int c = 0; c < 4; c++)
+				{
+					block[i][c] = pTexel[c];
+				}
+			}
+
+			uint8_t* pBlock = pDst + blockX * blockSize;
+			switch (compression)
+			{
+			case TextureCompression::eBC1:
+				EncodeBC1(block, pBlock);
+				break;
+			case TextureCompression::eBC3:
+				EncodeBC4(block, 3, pBlock);
+				EncodeBC1(block, pBlock + 8);
+				break;
+			case TextureCompression::eBC5:
+				EncodeBC4(block, 0, pBlock);
+				EncodeBC4(block, 1, pBlock + 8);
+				break;
+			case TextureCompression::eBC7:
+				EncodeBC7(block, pBlock);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	// Decoding follows the block layouts of the BC specification rather than the encoder above,
+	// so that it can check the encoder's output independently
+
+	// BC4 block into one channel of 16 RGBA texels
+	void DecodeBC4(const uint8_t* pSrc, uint8_t* pTexels, int channel)
+	{
+		const int e0 = pSrc[0];
+		const int e1 = pSrc[1];
+		int palette[8] = { e0, e1 };
+		if (e0 > e1)
+		{
+			for (int i = 1; i < 7; i++)
+			{
+				palette[i + 1] = ((7 - i) * e0 + i * e1) / 7;
+			}
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+			{
+				palette[i + 1] = ((5 - i) * e0 + i * e1) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++)
+		{
+			indices |= static_cast<uint64_t>(pSrc[2 + i]) << (8 * i);
+		}
+		for (int t = 0; t < 16; t++)
+		{
+			pTexels[4 * t + channel] = static_cast<uint8_t>(palette[(indices >> (3 * t)) & 7]);
+		}
+	}
+
+	// BC1 block into the RGB of 16 texels. In the three color mode the last index is transparent
+	// black, which sets alpha when hasAlpha is false, as for BC1 itself.
+	void DecodeBC1(const uint8_t* pSrc, uint8_t* pTexels, bool hasAlpha)
+	{
+		uint16_t color0, color1;
+		uint32_t indices;
+		memcpy(&color0, pSrc, 2);
+		memcpy(&color1, pSrc + 2, 2);
+		memcpy(&indices, pSrc + 4, 4);
+		int palette[4][4] = {};
+		UnpackRgb565(color0, palette[0]);
+		UnpackRgb565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			if (color0 > color1 || hasAlpha)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			}
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			palette[i][3] = 255;
+		}
+		if (color0 <= color1 && !hasAlpha)
+		{
+			palette[3][3] = 0;
+		}
+		for (int t = 0; t < 16; t++)
+		{
+			const int* pColor = palette[(indices >> (2 * t)) & 3];
+			for (int c = 0; c < (hasAlpha ? 3 : 4); c++)
+			{
+				pTexels[4 * t + c] = static_cast<uint8_t>(pColor[c]);
+			}
+		}
+	}
+
+	// Little-endian bit reader for the 128-bit BC7 block
+	class BitReader
+	{
+	public:
+		explicit BitReader(const uint8_t* pSrc) : m_pSrc(pSrc), m_position(0)
+		{
+		}
+
+		uint32_t Read(int bits)
+		{
+			uint32_t ret = 0;
+			for (int i = 0; i < bits; i++, m_position++)
+			{
+				ret |= ((m_pSrc[m_position / 8] >> (m_position % 8)) & 1u) << i;
+			}
+			return ret;
+		}
+
+	private:
+		const uint8_t* m_pSrc;
+		int m_position;
+	};
+
+	// BC7 block into 16 RGBA texels. Only mode 6, the one the encoder writes, is supported.
+	void DecodeBC7(const uint8_t* pSrc, uint8_t* pTexels)
+	{
+		BitReader reader(pSrc);
+		int mode = 0;
+		while (mode < 8 && reader.Read(1) == 0)
+		{
+			mode++;
+		}
+		if (mode != 6)
+		{
+			throw std::runtime_error("Decoding BC7 mode " + std::to_string(mode) + " blocks is not supported");
+		}
+
+		int endpoints[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = reader.Read(7);
+			endpoints[1][c] = reader.Read(7);
+		}
+		for (auto& endpoint : endpoints)
+		{
+			const int pbit = reader.Read(1);
+			for (int& value : endpoint)
+			{
+				value = (value << 1) | pbit;
+			}
+		}
+		for (int t = 0; t < 16; t++)
+		{
+			// The first index is stored without its top bit, which is always 0
+			const int weight = BC7_WEIGHTS[reader.Read(t == 0 ? 3 : 4)];
+			for (int c = 0; c < 4; c++)
+			{
+				pTexels[4 * t + c] = static_cast<uint8_t>(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+			}
+		}
+	}
+
+	TextureCompression GetBlockCompression(uint32_t format)
+	{
+		switch (format)
+		{
+		case FORMAT_BC1_RGB_UNORM_BLOCK: case FORMAT_BC1_RGB_SRGB_BLOCK: return TextureCompression::eBC1;
+		case FORMAT_BC3_UNORM_BLOCK: case FORMAT_BC3_SRGB_BLOCK: return TextureCompression::eBC3;
+		case FORMAT_BC5_UNORM_BLOCK: return TextureCompression::eBC5;
+		case FORMAT_BC7_UNORM_BLOCK: case FORMAT_BC7_SRGB_BLOCK: return TextureCompression::eBC7;
+		default: return TextureCompression::eNone;
+		}
+	}
+}
+
+void GenerateMipChain(TextureData& image, bool linear, MipFilter filter)
+{
+	assert(image.format == 0 && image.mipOffsets.size() == 1);
+	ThreadPool& threadPool = ThreadPool::GetDefault();
+
+	// Reserve everything up front so that appending levels doesn't reallocate
+	const uint32_t levelCount = GetMipLevelCount(image.width, image.height);
+	size_t totalSize = 0;
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		totalSize += 4ull * std::max(image.width >> level, 1u) * std::max(image.height >> level, 1u);
+	}
+	image.pixels.reserve(totalSize);
+
+	// Every level is filtered from the previous one at full float precision in linear space,
+	// and only rounded to 8 bits for storage
+	uint32_t srcWidth = image.width;
+	uint32_t srcHeight = image.height;
+	std::vector<float> src(4ull * srcWidth * srcHeight);
+	std::vector<float> dst;
+	threadPool.ParallelFor(srcHeight, [&](size_t y) {
+		DecodeTexels(image.pixels.data() + 4 * y * srcWidth, src.data() + 4 * y * srcWidth, srcWidth, linear);
+	});
+
+	for (uint32_t level = 1; level < levelCount; level++)
+	{
+		const uint32_t width = std::max(srcWidth >> 1, 1u);
+		const uint32_t height = std::max(srcHeight >> 1, 1u);
+		DownsampleLevel(src, srcWidth, srcHeight, dst, width, height, filter);
+
+		const size_t offset = image.pixels.size();
+		image.pixels.resize(offset + 4ull * width * height);
+		image.mipOffsets.push_back(offset);
+		threadPool.ParallelFor(height, [&](size_t y) {
+			EncodeTexels(dst.data() + 4 * y * width, image.pixels.data() + offset + 4 * y * width, width, linear);
+		});
+
+		std::swap(src, dst);
+		srcWidth = width;
+		srcHeight = height;
+	}
+}
+
+TextureData CompressTexture(const TextureData& image, TextureCompression compression, bool linear)
+{
+	assert(image.format == 0 && compression != TextureCompression::eNone);
+	const uint32_t blockSize = GetBlockSize(compression);
+
+	TextureData ret;
+	ret.width = image.width;
+	ret.height = image.height;
+	ret.format = GetBlockFormat(compression, linear);
+	ret.mipOffsets.clear();
+
+	// Every row of blocks of every level is a separate task
+	struct BlockRow
+	{
+		uint32_t level;
+		uint32_t row;
+	};
+	std::vector<BlockRow> rows;
+	size_t size = 0;
+	for (uint32_t level = 0; level < image.mipOffsets.size(); level++)
+	{
+		const uint32_t width = std::max(image.width >> level, 1u);
+		const uint32_t height = std::max(image.height >> level, 1u);
+		ret.mipOffsets.push_back(size);
+		size += static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+		for (uint32_t row = 0; row < (height + 3) / 4; row++)
+		{
+			rows.push_back({ level, row });
+		}
+	}
+	ret.pixels.resize(size);
+
+	ThreadPool::GetDefault().ParallelFor(rows.size(), [&](size_t i) {
+		const BlockRow& row = rows[i];
+		const uint32_t width = std::max(image.width >> row.level, 1u);
+		const uint32_t height = std::max(image.height >> row.level, 1u);
+		const size_t rowSize = static_cast<size_t>((width + 3) / 4) * blockSize;
+		EncodeBlockRow(image.pixels.data() + image.mipOffsets[row.level], width, height, row.row, compression,
+			ret.pixels.data() + ret.mipOffsets[row.level] + row.row * rowSize);
+	});
+	return ret;
+}
+
+TextureData DecompressTexture(const TextureData& image)
+{
+	const TextureCompression compression = GetBlockCompression(image.format);
+	if (compression == TextureCompression::eNone)
+	{
+		throw std::runtime_error("Unsupported texture format " + std::to_string(image.format));
+	}
+	const uint32_t blockSize = GetBlockSize(compression);
+
+	TextureData ret;
+	ret.width = image.width;
+	ret.height = image.height;
+	ret.mipOffsets.clear();
+	size_t size = 0;
+	for (uint32_t level = 0; level < image.mipOffsets.size(); level++)
+	{
+		ret.mipOffsets.push_back(size);
+		size += 4ull * std::max(image.width >> level, 1u) * std::max(image.height >> level, 1u);
+	}
+	ret.pixels.resize(size);
+
+	for (uint32_t level = 0; level < image.mipOffsets.size(); level++)
+	{
+		const uint32_t width = std::max(image.width >> level, 1u);
+		const uint32_t height = std::max(image.height >> level, 1u);
+		const uint32_t blocksX = (width + 3) / 4;
+		const uint32_t blocksY = (height + 3) / 4;
+		if (image.mipOffsets[level] + static_cast<size_t>(blocksX) * blocksY * blockSize > image.pixels.size())
+		{
+			throw std::runtime_error("Block-compressed texture is truncated");
+		}
+		for (uint32_t blockY = 0; blockY < blocksY; blockY++)
+		{
+			for (uint32_t blockX = 0; blockX < blocksX; blockX++)
+			{
+				const uint8_t* pBlock = image.pixels.data() + image.mipOffsets[level]
+					+ (static_cast<size_t>(blockY) * blocksX + blockX) * blockSize;
+				uint8_t texels[16 * 4];
+				switch (compression)
+				{
+				case TextureCompression::eBC1:
+					DecodeBC1(pBlock, texels, false);
+					break;
+				case TextureCompression::eBC3:
+					DecodeBC4(pBlock, texels, 3);
+					DecodeBC1(pBlock + 8, texels, true);
+					break;
+				case TextureCompression::eBC5:
+					DecodeBC4(pBlock, texels, 0);
+					DecodeBC4(pBlock + 8, texels, 1);
+					for (int t = 0; t < 16; t++)
+					{
+						texels[4 * t + 2] = 0;
+						texels[4 * t + 3] = 255;
+					}
+					break;
+				default:
+					DecodeBC7(pBlock, texels);
+					break;
+				}
+
+				// Texels of blocks hanging over the edge of the level are dropped
+				for (uint32_t i = 0; i < 16; i++)
+				{
+					const uint32_t x = blockX * 4 + i % 4;
+					const uint32_t y = blockY * 4 + i / 4;
+					if (x < width && y < height)
+					{
+						memcpy(ret.pixels.data() + ret.mipOffsets[level] + (static_cast<size_t>(y) * width + x) * 4,
+							texels + 4 * i, 4);
+					}
+				}
+			}
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "TextureLoading.h"
+
+// CPU-side texture cooking: mip generation and block compression of decoded RGBA images, so
+// that textures can be stored and sampled at a fraction of their size. Everything here runs
+// on the CPU and is safe to call from worker threads.
+
+enum class TextureCompression
+{
+	eNone,
+	// Opaque RGB at 4 bits per texel
+	eBC1,
+	// RGBA at 8 bits per texel, with alpha encoded separately from color
+	eBC3,
+	// Two independent channels at 8 bits per texel, for tangent space normal maps whose z is
+	// reconstructed in the shader
+	eBC5,
+	// RGBA at 8 bits per texel, with much better quality than BC1 or BC3, for albedo
+	eBC7
+};
+
+enum class MipFilter
+{
+	// Average of each texel's footprint, which is exactly 2x2 texels for even sizes
+	eBox,
+	// Kaiser-windowed sinc, which keeps distant mips sharper at a few times the cost
+	eKaiser
+};
+
+// Extends a single-level RGBA image with the rest of its mip chain, down to 1x1 along the longer
+// side as Vulkan expects. Unless linear is set the texels are taken to be sRGB-encoded and are
+// filtered in linear space. Rows of each level are filtered in parallel on the worker pool,
+// with AVX2 where the CPU supports it.
+void GenerateMipChain(TextureData& image, bool linear, MipFilter filter = MipFilter::eBox);
+
+// Encodes every mip level of an RGBA image in the block format, with blocks encoded in parallel
+// on the worker pool. The result carries the matching VkFormat, which is sRGB unless linear is
+// set. BC5 is always linear.
+TextureData CompressTexture(const TextureData& image, TextureCompression compression, bool linear);
+
+// Decodes every mip level of a texture in one of the block formats CompressTexture produces
+// back to RGBA, for measuring the encoder's error. BC5 decodes to red and green with blue 0 and
+// alpha 255. Only mode 6 BC7 blocks are supported, since the encoder writes no others.
+TextureData DecompressTexture(const TextureData& image);
@@ -0,0 +1,143 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Shared between the caller of ParallelFor and any helper tasks. Helpers that only get
+	// scheduled after all the work is done find nothing left and exit, so the state must
+	// outlive the call itself.
+	struct ParallelForState
+	{
+		ParallelForState(size_t count, const std::function<void(size_t)>& func) :
+			count(count), next(0), completed(0), func(func)
+		{
+		}
+
+		// Claims and runs indices until there are none left
+		void Work()
+		{
+			for (size_t i = next++; i < count; i = next++)
+			{
+				try
+				{
+					func(i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!exception)
+					{
+						exception = std::current_exception();
+					}
+				}
+				if (++completed == count)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					condition.notify_all();
+				}
+			}
+		}
+
+		const size_t count;
+		std::atomic<size_t> next;
+		std::atomic<size_t> completed;
+		std::function<void(size_t)> func;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::exception_ptr exception;
+	};
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount) : m_stopping(false)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_threads.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_condition.notify_all();
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::GetDefault()
+{
+	static ThreadPool s_pool;
+	return s_pool;
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (count == 1)
+	{
+		func(0);
+		return;
+	}
+
+	auto state = std::make_shared<ParallelForState>(count, func);
+
+	// The calling thread is one of the workers, so one fewer helper is needed
+	size_t helperCount = std::min<size_t>(m_threads.size(), count - 1);
+	for (size_t i = 0; i < helperCount; i++)
+	{
+		Enqueue([state]() { state->Work(); });
+	}
+	state->Work();
+
+	// Wait for indices claimed by helpers to finish
+	{
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->condition.wait(lock, [&]() { return state->completed == count; });
+	}
+	if (state->exception)
+	{
+		std::rethrow_exception(state->exception);
+	}
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_condition.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+			if (m_stopping && m_tasks.empty())
+			{
+				return;
+			}
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed-size pool of worker threads for CPU-side asset processing
+class ThreadPool
+{
+public:
+	// A thread count of 0 uses one thread per hardware thread
+	explicit ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool& other) = delete;
+	ThreadPool& operator=(const ThreadPool& other) = delete;
+
+	// Shared pool used by the asset loading code
+	static ThreadPool& GetDefault();
+
+	uint32_t GetThreadCount() const
+	{
+		return static_cast<uint32_t>(m_threads.size());
+	}
+
+	// Queues a task, returning a future for its result
+	template<typename F>
+	auto Submit(F&& func) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+	{
+		using Result = std::invoke_result_t<std::decay_t<F>>;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+		std::future<Result> ret = task->get_future();
+		Enqueue([task]() { (*task)(); });
+		return ret;
+	}
+
+	// Runs func(i) for every i in [0, count) and waits for all of them to finish. The calling
+	// thread takes part in the work, so this is safe to call from inside a pool task.
+	// The first exception thrown by any invocation is rethrown on the calling thread.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+private:
+	void Enqueue(std::function<void()> task);
+	void WorkerLoop();
+
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stopping;
+};
@@ -1,5 +1,6 @@
 #include "VulkanApp.h"
 
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <optional>
@@ -13,6 +14,9 @@ using namespace DirectX;
 
 namespace
 {
+	// Memory for the finer mip levels of streamed textures, beyond their always-resident tails
+	constexpr uint64_t TEXTURE_STREAMING_BUDGET = 256 * 1024 * 1024;
+
 	// GLFW error callback that just throws, reporting the error
 	void GLFWErrorCallback(int error, const char* text)
 	{
@@ -66,6 +70,18 @@ namespace
 		}
 	}
 
+	bool IsDeviceExtensionSupported(const vk::PhysicalDevice& physicalDevice, const char* extension)
+	{
+		for (const auto& supportedExtension : physicalDevice.enumerateDeviceExtensionProperties())
+		{
+			if (strcmp(supportedExtension.extensionName, extension) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
 	// Iterate through Vulkan optional feature structs
 	bool FeatureSupportHelper(const vk::Bool32* pRequired, const vk::Bool32* pSupported, int nFields)
 	{
@@ -130,6 +146,20 @@ namespace
 			throw std::runtime_error("Required Vulkan optional features are not available");
 		}
 	}
+
+	// Parameters pushed per draw, matching DrawConstants in Common.hlsli
+	struct DrawConstants
+	{
+		VertexQuantization quantization;
+		uint32_t transformOffset;
+		uint32_t textureIndex;
+		uint32_t boundsOffset;
+	};
+
+	vk::IndexType ToVkIndexType(IndexType type)
+	{
+		return type == IndexType::eUint16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+	}
 }
 
 VulkanApp::VulkanApp() : 
@@ -140,7 +170,11 @@ VulkanApp::VulkanApp() :
 	m_aspectRatio(0.0f),
 	m_window(640, 480, L"Vulkan App"),
 	m_sizeChanged(false),
-	m_vertexBuffer(0)
+	m_memoryBudgetSupported(false),
+	m_vertexBuffer(0),
+	m_meshBounds(0),
+	m_texture(0),
+	m_loadStartTime(0.0)
 {
 	m_window.OnTick.Register(this, &VulkanApp::Tick);
 	m_window.OnResize.Register(this, &VulkanApp::OnResize);
@@ -170,8 +204,13 @@ void VulkanApp::CreateDeviceDependentResources()
 	allocatorInfo.device = *m_device;
 	allocatorInfo.instance = *m_instance;
 	allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_3;
+	if (m_memoryBudgetSupported)
+	{
+		allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+	}
 	m_allocator = UniqueAllocator(allocatorInfo);
 	m_resourceManager = ResourceManager(*m_device, *m_allocator, m_gfxQueue, m_gfxQueueIdx);
+	m_resourceManager.SetTextureStreamingBudget(TEXTURE_STREAMING_BUDGET);
 
 	// Create per-frame resources so we can use double buffering
 	for (auto& frame : m_frames)
@@ -179,17 +218,28 @@ void VulkanApp::CreateDeviceDependentResources()
 		frame = FrameResources(*m_device, m_gfxQueueIdx);
 	}
 
-	m_mesh = LoadModel(ASSET_PATH + "/BoxTextured.gltf"s)[0];
-	m_vertexBuffer = m_resourceManager.CreateVertices(*m_device, m_mesh.vertices.data(),
-		m_mesh.vertices.size() * sizeof(m_mesh.vertices[0]));
-	m_indexBuffer = m_resourceManager.CreateIndices(*m_device, m_mesh.indices.data(),
-		m_mesh.indices.size() * sizeof(m_mesh.indices[0]));
-	m_texture = m_resourceManager.CreateTexture(*m_device, ASSET_PATH + "/container.jpg"s, false, true);
+	// Assets load on the worker pool so the first frame doesn't wait for them. Nothing is drawn
+	// until the model arrives, and a white placeholder stands in for the texture until then.
+	m_loadStartTime = GetTime();
+	ModelLoadOptions loadOptions;
+	loadOptions.quantizeVertices = true;
+	loadOptions.optimizeIndices = true;
+	loadOptions.lodCount = 3;
+	loadOptions.preTransformVertices = false;
+	m_pendingModel = LoadModelAsync(ASSET_PATH + "/BoxTextured.gltf"s, loadOptions);
+	m_pendingTexture = LoadTextureDataAsync(ASSET_PATH + "/container.jpg"s, TextureCompression::eBC7, false);
+	TextureData placeholder;
+	placeholder.width = 1;
+	placeholder.height = 1;
+	placeholder.pixels = { 255, 255, 255, 255 };
+	m_texture = m_resourceManager.CreateTexture(*m_device, placeholder, false, false);
 
 	// Create the pipeline layout and pipeline
 	// This will be removed later when the engine becomes dynamic
 	vk::DescriptorSetLayout descriptorSetLayout = m_resourceManager.GetDescriptorSetLayout();
-	vk::PipelineLayoutCreateInfo layoutInfo({}, descriptorSetLayout);
+	// Per-draw vertex decode parameters are passed as push constants
+	vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eAllGraphics, 0, sizeof(DrawConstants));
+	vk::PipelineLayoutCreateInfo layoutInfo({}, descriptorSetLayout, pushConstantRange);
 	m_pipelineLayout = m_device->createPipelineLayoutUnique(layoutInfo);
 
 	// Input assembly state
@@ -225,11 +275,23 @@ void VulkanApp::CreateDeviceDependentResources()
 
 	// Create shaders for our triangle. According to the spec, you don't need to keep the vkShaderModules
 	// around after creating the pipeline, so they are not stored in the main class.
-	auto vertexShader = CreateShader(*m_device, SHADER_PATH + "/TriangleVS.spv"s);
-	builder.AddShaderStage(vk::ShaderStageFlagBits::eVertex, *vertexShader);
+	// There is a vertex shader for each vertex format the importer produces, since the format
+	// depends on the file as well as the load options. The mesh's pipeline is picked by its type.
+	const std::array<std::pair<VertexType, std::string>, 4> vertexShaderFiles = {{
+		{ VertexType::eP3N3, "/TriangleP3N3VS.spv" },
+		{ VertexType::eP3N3T3U2, "/TriangleVS.spv" },
+		{ VertexType::eP3N3Packed, "/TriangleP3N3PackedVS.spv" },
+		{ VertexType::eP3N3T3U2Packed, "/TrianglePackedVS.spv" }
+	}};
 	auto pixelShader = CreateShader(*m_device, SHADER_PATH + "/TrianglePS.spv"s);
 	builder.AddShaderStage(vk::ShaderStageFlagBits::eFragment, *pixelShader);
-	m_pipeline = builder.CreatePipeline(*m_device, *m_pipelineLayout);
+	for (const auto& [type, file] : vertexShaderFiles)
+	{
+		auto vertexShader = CreateShader(*m_device, SHADER_PATH + file);
+		PipelineBuilder vertexBuilder = builder;
+		vertexBuilder.AddShaderStage(vk::ShaderStageFlagBits::eVertex, *vertexShader);
+		m_pipelines[type] = vertexBuilder.CreatePipeline(*m_device, *m_pipelineLayout);
+	}
 }
 
 void VulkanApp::CreateWindowSizeDependentResources()
@@ -340,6 +402,7 @@ void VulkanApp::CreateDevice(std::vector<const char*>& enabledLayers)
 	vk::PhysicalDeviceVulkan13Features required13Features;
 	// Enable the features we require for the app
 	required10Features.samplerAnisotropy = true;
+	required10Features.textureCompressionBC = true;
 	required12Features.scalarBlockLayout = true;
 	required12Features.runtimeDescriptorArray = true;
 	required12Features.descriptorIndexing = true;
@@ -351,6 +414,7 @@ void VulkanApp::CreateDevice(std::vector<const char*>& enabledLayers)
 	required12Features.descriptorBindingUniformBufferUpdateAfterBind = true;
 	required12Features.descriptorBindingUniformTexelBufferUpdateAfterBind = true;
 	required12Features.descriptorBindingVariableDescriptorCount = true;
+	required12Features.timelineSemaphore = true;
 	required13Features.dynamicRendering = true;
 	required13Features.synchronization2 = true;
 	// Check the physical device supports required features
@@ -369,6 +433,13 @@ void VulkanApp::CreateDevice(std::vector<const char*>& enabledLayers)
 			"VK_KHR_swapchain"
 	};
 	VerifyDeviceExtensionSupport(m_physicalDevice, requiredExtensions);
+	// Optional: lets VMA report the heap budgets the driver actually grants, rather than a
+	// fixed fraction of each heap, for the texture streaming budget
+	m_memoryBudgetSupported = IsDeviceExtensionSupported(m_physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (m_memoryBudgetSupported)
+	{
+		requiredExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
 
 	// Now create the logical device
 	float queuePriority = 1.0f;
@@ -451,19 +522,110 @@ void VulkanApp::Tick()
 	double dt = currTime - lastTime;
 	lastTime = currTime;
 
+	UpdatePendingAssets();
 	Update(currTime, dt);
+	m_resourceManager.UpdateTextureStreaming(*m_device);
 	Render();
 	m_frameCount++;
 	m_resourceManager.IncrementFrameCount();
 }
 
+void VulkanApp::UpdatePendingAssets()
+{
+	// The CPU side of the loads ran on the worker pool, so all that's left here is the upload.
+	// Assets that fail to load are reported and skipped rather than ending the frame loop.
+	if (m_pendingModel.IsReady())
+	{
+		std::optional<Model> model;
+		try
+		{
+			model = m_pendingModel.Take();
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Failed to load the model: " << e.what() << "\n";
+		}
+		if (model)
+		{
+			UploadModel(*model);
+		}
+	}
+	if (m_pendingTexture.IsReady())
+	{
+		// The placeholder stays if the texture fails to load
+		std::shared_ptr<TextureData> data;
+		try
+		{
+			data = std::make_shared<TextureData>(m_pendingTexture.Take());
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Failed to load the texture: " << e.what() << "\n";
+		}
+		// Only the mip tail is uploaded now; finer levels follow as the texture's size on screen
+		// calls for them
+		if (data)
+		{
+			const uint32_t placeholder = m_texture;
+			m_texture = m_resourceManager.CreateStreamedTexture(*m_device, std::move(data), false);
+			m_resourceManager.ReleaseTexture(placeholder);
+		}
+	}
+}
+
+void VulkanApp::UploadModel(Model& model)
+{
+	// Report the time since the load started so cold (import) and warm (mesh cache) starts can
+	// be compared
+	std::cout << "Model ready " << 1000.0 * (GetTime() - m_loadStartTime) << " ms after loading started\n";
+	m_mesh = std::move(model.meshes[0]);
+	if (m_pipelines.find(m_mesh.type) == m_pipelines.end())
+	{
+		throw std::runtime_error("No vertex shader for the mesh's vertex format");
+	}
+	// Each instance of the mesh gets its own slot in the transform buffer
+	for (const auto& instance : model.instances)
+	{
+		if (instance.meshIndex == 0)
+		{
+			uint32_t transform = m_resourceManager.CreateTransform(&instance.transform, sizeof(XMFLOAT4X4));
+			m_instances.push_back({ transform, instance.transform, 0 });
+		}
+	}
+	// All of the mesh's buffers go up in one submission, which rendering is ordered after,
+	// so there's no need to wait for it
+	m_resourceManager.BeginUploadBatch();
+	const MeshBounds bounds{ m_mesh.bounds.Center, m_mesh.bounds.Extents,
+		m_mesh.boundingSphere.Center, m_mesh.boundingSphere.Radius };
+	m_meshBounds = m_resourceManager.CreateBounds(*m_device, bounds);
+	m_vertexBuffer = m_resourceManager.CreateVertices(*m_device, m_mesh.vertices.data(),
+		m_mesh.vertices.size() * sizeof(m_mesh.vertices[0]));
+	// Every level of detail gets its own range of the index heap, all sharing the vertices
+	const vk::IndexType indexType = ToVkIndexType(m_mesh.indexType);
+	const uint32_t indexCount = static_cast<uint32_t>(m_mesh.indices.size());
+	m_lods.push_back({ m_resourceManager.CreateIndices(*m_device, m_mesh.indices.data(), indexCount, indexType),
+		indexCount, 0.0f });
+	for (const auto& lod : m_mesh.lods)
+	{
+		m_lods.push_back({ m_resourceManager.CreateIndices(*m_device, m_mesh.lodIndices.data() + lod.indexOffset,
+			lod.indexCount, indexType), lod.indexCount, lod.error });
+	}
+	m_resourceManager.EndUploadBatch(*m_device, false);
+	const GeometryHeapStats& heapStats = m_resourceManager.GetGeometryStats();
+	std::cout << "Geometry heaps: " << heapStats.uploadedBytes / 1024 << " KB uploaded, "
+		<< heapStats.savedBytes / 1024 << " KB saved by " << heapStats.dedupCount << " duplicate uploads\n";
+}
+
 void VulkanApp::Update(double t, double dt)
 {
 	static double lastFrameTimeUpdate = t;
 	if (t - lastFrameTimeUpdate > 1.0)
 	{
 		// Display in ms
-		m_window.SetTitle("Frame Time: " + std::to_string(1000.0 * dt) + " ms");
+		const TextureStreamingStats& streamingStats = m_resourceManager.GetTextureStreamingStats();
+		m_window.SetTitle("Frame Time: " + std::to_string(1000.0 * dt) + " ms, VRAM: "
+			+ std::to_string(streamingStats.deviceUsageBytes >> 20) + " / "
+			+ std::to_string(streamingStats.deviceBudgetBytes >> 20) + " MB");
 		lastFrameTimeUpdate = t;
 	}
 
@@ -474,11 +636,39 @@ void VulkanApp::Update(double t, double dt)
 	auto focus = XMVectorZero();
 	auto up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 	auto view = XMMatrixLookAtRH(eye, focus, up);
-	auto proj = XMMatrixPerspectiveFovRH(XMConvertToRadians(80.0f), m_aspectRatio, 0.1f, 100.0f);
-	auto model = XMMatrixScaling(2.0f, 2.0f, 2.0f) 
+	const float fovY = XMConvertToRadians(80.0f);
+	constexpr float modelScale = 2.0f;
+	auto proj = XMMatrixPerspectiveFovRH(fovY, m_aspectRatio, 0.1f, 100.0f);
+	auto model = XMMatrixScaling(modelScale, modelScale, modelScale) 
 		* XMMatrixRotationRollPitchYaw(4.0f * sinf(t), 2.5f * cosf(t), 0.0f);
-	auto viewProj = model * view * proj;
+	auto viewProj = view * proj;
 	XMStoreFloat4x4(&globalConstants.viewProj, XMMatrixTranspose(viewProj));
+
+	for (auto& instance : m_instances)
+	{
+		// Transforms are read as rows by the shaders, so they are stored without transposing
+		auto world = XMLoadFloat4x4(&instance.modelTransform) * model;
+		XMFLOAT4X4 transform;
+		XMStoreFloat4x4(&transform, world);
+		memcpy(m_resourceManager.GetTransform(instance.transform), &transform, sizeof(transform));
+
+		// Draw the coarsest level of detail whose error projects to less than a pixel at the
+		// nearest point of the mesh's bounding sphere
+		float scale = std::max({ XMVectorGetX(XMVector3Length(world.r[0])),
+			XMVectorGetX(XMVector3Length(world.r[1])), XMVectorGetX(XMVector3Length(world.r[2])) });
+		auto center = XMVector3Transform(XMLoadFloat3(&m_mesh.boundingSphere.Center), world);
+		float radius = scale * m_mesh.boundingSphere.Radius;
+		float distance = std::max(XMVectorGetX(XMVector3Length(center - eye)) - radius, 0.1f);
+		float pixelsPerUnit = m_backBufferExtent.height / (2.0f * tanf(0.5f * fovY) * distance);
+		// The texture spans the mesh, so it needs about as many texels as the mesh covers pixels
+		m_resourceManager.RequestTextureResolution(m_texture, 2.0f * radius * pixelsPerUnit);
+
+		instance.lod = 0;
+		while (instance.lod + 1 < m_lods.size() && scale * m_lods[instance.lod + 1].error * pixelsPerUnit < 1.0f)
+		{
+			instance.lod++;
+		}
+	}
 	
 	void* ptr = m_resourceManager.GetGlobalConstants();
 	memcpy(ptr, &globalConstants, sizeof(globalConstants));
@@ -500,6 +690,9 @@ void VulkanApp::Render()
 	auto& frame = m_frames[frameIdx];
 
 	ThrowIfFailed(m_device->waitForFences(*frame.renderFence, true, UINT64_MAX));
+	// The frame that last used this frame's descriptor set is done, so textures created or
+	// swapped since can be written to it
+	m_resourceManager.UpdateFrameDescriptors(*m_device);
 	auto [result, swapchainImageIdx] = m_device->acquireNextImageKHR(*m_swapchain, UINT64_MAX, *frame.imageReadySemaphore);
 	if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR)
 	{
@@ -557,8 +750,12 @@ void VulkanApp::Render()
 
 		frame.commandBuffer->beginRendering(renderInfo);
 
-		// Bind the pipeline
-		frame.commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *m_pipeline);
+		// Bind the pipeline that decodes the mesh's vertex format. There's nothing to draw before
+		// the mesh has loaded, which is the only time it can't be bound.
+		if (!m_instances.empty())
+		{
+			frame.commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *m_pipelines.at(m_mesh.type));
+		}
 		// Set dynamic state that we didn't specify in our pipeline
 		frame.commandBuffer->setViewport(0, m_screenViewport);
 		frame.commandBuffer->setScissor(0, m_screenScissor);
@@ -566,10 +763,19 @@ void VulkanApp::Render()
 		// Bind descriptor sets from our Resource Manager
 		frame.commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *m_pipelineLayout, 
 			0, m_resourceManager.GetDescriptorSet(), {});
-		// Bind the index buffer from the Resource Manager
-		frame.commandBuffer->bindIndexBuffer(m_resourceManager.GetIndexBuffer(), 0, vk::IndexType::eUint32);
-
-		frame.commandBuffer->drawIndexed(m_mesh.indices.size(), 1, 0, 0, 0);
+		for (const auto& instance : m_instances)
+		{
+			// Bind the level's range of the index buffer from the Resource Manager, at the mesh's
+			// index width
+			const MeshLodRange& lod = m_lods[instance.lod];
+			frame.commandBuffer->bindIndexBuffer(m_resourceManager.GetIndexBuffer(), lod.indexBuffer,
+				ToVkIndexType(m_mesh.indexType));
+
+			DrawConstants drawConstants{ m_mesh.quantization, instance.transform, m_texture, m_meshBounds };
+			frame.commandBuffer->pushConstants(*m_pipelineLayout, vk::ShaderStageFlagBits::eAllGraphics,
+				0, sizeof(DrawConstants), &drawConstants);
+			frame.commandBuffer->drawIndexed(lod.indexCount, 1, 0, 0, 0);
+		}
 
 		frame.commandBuffer->endRendering();
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <unordered_map>
+
 #include <vulkan/vulkan.hpp>
 #include <vma/vk_mem_alloc.h>
 
+#include "AssetLoading.h"
 #include "Resources.h"
 #include "Window.h"
 #include "ModelLoading.h"
@@ -35,6 +38,10 @@ private:
 		vk::UniqueCommandBuffer commandBuffer;
 	};
 
+	// Uploads any assets that finished loading since the last frame
+	void UpdatePendingAssets();
+	// Uploads the first mesh of a loaded model and creates its instances
+	void UploadModel(Model& model);
 	// CPU code, updating uniforms, organizing scene data etc.
 	void Update(double t, double dt);
 	// Rendering logic
@@ -95,15 +102,49 @@ private:
 	// Flag to check each frame if the window size changed
 	bool m_sizeChanged;
 
+	// Whether VK_EXT_memory_budget is enabled, for accurate VMA heap budgets
+	bool m_memoryBudgetSupported;
+
 	// To be removed from this class later once the pipelines aren't hard-coded
-	vk::UniquePipeline m_pipeline;
+	// One pipeline per vertex format, since each needs its own vertex shader
+	std::unordered_map<VertexType, vk::UniquePipeline> m_pipelines;
 	vk::UniquePipelineLayout m_pipelineLayout;
 
 	// Graphics resource management	
 	ResourceManager m_resourceManager;
 
+	// A range of the index buffer that draws m_mesh at some level of detail
+	struct MeshLodRange
+	{
+		uint32_t indexBuffer;
+		uint32_t indexCount;
+		// Geometric error in model units, 0 for the full mesh
+		float error;
+	};
+
 	Mesh m_mesh;
 	uint32_t m_vertexBuffer;
-	uint32_t m_indexBuffer;
+	// Byte offset of m_mesh's bounds in the bounds buffer
+	uint32_t m_meshBounds;
+	// A placement of m_mesh in the scene
+	struct DrawInstance
+	{
+		// Byte offset in the transform buffer
+		uint32_t transform;
+		// Transform from the model file, before animation
+		DirectX::XMFLOAT4X4 modelTransform;
+		// Index into m_lods chosen for this frame
+		uint32_t lod;
+	};
+
+	// The full mesh first, then the simplified levels from finest to coarsest
+	std::vector<MeshLodRange> m_lods;
+	std::vector<DrawInstance> m_instances;
+	// Placeholder texture until the real one has loaded
 	uint32_t m_texture;
+
+	// Loads still running on the worker pool
+	AssetHandle<Model> m_pendingModel;
+	AssetHandle<TextureData> m_pendingTexture;
+	double m_loadStartTime;
 };
\ No newline at end of file